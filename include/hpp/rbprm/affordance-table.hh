@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_AFFORDANCE_TABLE_HH
+# define HPP_RBPRM_AFFORDANCE_TABLE_HH
+
+# include <hpp/rbprm/config.hh>
+# include <hpp/rbprm/rbprm-limb.hh>
+# include <hpp/model/fwd.hh>
+
+# include <map>
+# include <string>
+# include <vector>
+
+namespace hpp {
+  namespace rbprm {
+    typedef std::map<std::string, std::vector<model::CollisionObjectPtr_t> > affMap_t;
+    typedef std::map<std::string, std::vector<std::string> > T_AffordanceFilters;
+
+    /// Affordance objects to consider for contact creation for each limb of a robot,
+    /// resolved once from an affordance map and the affordance filters of the limbs.
+    /// Limbs are addressed by their index in the T_Limb of the robot, the table remaining
+    /// valid as long as it is used with the same affordances, filters and limbs.
+    class HPP_RBPRM_DLLAPI AffordanceTable
+    {
+    public:
+        AffordanceTable();
+
+        /// \return whether the table was compiled from these affordances and filters
+        bool matches(const affMap_t& affordances, const T_AffordanceFilters& affFilters) const;
+
+        /// Resolves the affordance objects of each limb.
+        /// Limbs without affordance objects are reported when their objects are requested.
+        /// \param limbs the limbs of the robot
+        /// \param affordances the set of 3D objects to consider for contact creation
+        /// \param affFilters the affordance types to be used by each limb. All the affordances
+        /// are used by a limb for which no filter is set.
+        void compile(const T_Limb& limbs, const affMap_t& affordances, const T_AffordanceFilters& affFilters);
+
+        /// Empties the table, which is then compiled again at the next use
+        void clear();
+
+        /// \return the index of a limb in the table
+        std::size_t index(const std::string& limb) const;
+
+        /// \return the affordance objects of the limb at a given index
+        /// throws if no object is found for the limb
+        const model::ObjectVector_t& objects(const std::size_t limbIndex) const;
+        const model::ObjectVector_t& objects(const std::string& limb) const {return objects(index(limb));}
+
+        bool empty() const {return limbs_.empty();}
+        /// number of compilations since the creation of the table
+        std::size_t compilations() const {return compilations_;}
+
+    private:
+        affMap_t affordances_;
+        T_AffordanceFilters affFilters_;
+        std::vector<std::string> limbs_;
+        std::vector<model::ObjectVector_t> objects_;
+        std::size_t compilations_;
+    }; // class AffordanceTable
+  } // namespace rbprm
+} // namespace hpp
+
+#endif // HPP_RBPRM_AFFORDANCE_TABLE_HH
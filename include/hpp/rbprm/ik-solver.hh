@@ -1,36 +1,43 @@
-//
-// Copyright (c) 2014 CNRS
-// Authors: Steve Tonneau (steve.tonneau@laas.fr)
-//
-// This file is part of hpp-rbprm.
-// hpp-rbprm is free software: you can redistribute it
-// and/or modify it under the terms of the GNU Lesser General Public
-// License as published by the Free Software Foundation, either version
-// 3 of the License, or (at your option) any later version.
-//
-// hpp-rbprm is distributed in the hope that it will be
-// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
-// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
-// General Lesser Public License for more details.  You should have
-// received a copy of the GNU Lesser General Public License along with
-// hpp-core  If not, see
-// <http://www.gnu.org/licenses/>.
-
-#ifndef _CLASS_IKSOLVER
-#define _CLASS_IKSOLVER
-
-#include "hpp/rbprm/rbprm-limb.hh"
-
-namespace hpp
-{
-namespace rbprm
-{
-namespace ik
-{
-    typedef Eigen::Ref<Eigen::Vector3d> Vector3dRef;
-
-    bool apply  (RbPrmLimb& limb, const fcl::Vec3f &target, const fcl::Matrix3f &targetRotation, model::ConfigurationOut_t configuration);
-} // namespace ik
-} // namespace rbprm
-} // namespace hpp
-#endif //_CLASS_IKSOLVER
+#ifndef _CLASS_IKSOLVER
+#define _CLASS_IKSOLVER
+
+#include "hpp/rbprm/rbprm-limb.hh"
+
+#include <vector>
+
+namespace hpp
+{
+namespace rbprm
+{
+namespace ik
+{
+    typedef Eigen::Ref<Eigen::Vector3d> Vector3dRef;
+
+    /// Outcome of an inverse kinematics resolution
+    struct HPP_RBPRM_DLLAPI IKReport
+    {
+        bool success_;
+        /// number of configuration updates
+        std::size_t nbIterations_;
+        /// norm of the final task error
+        double error_;
+    };
+
+    /// Damped least squares inverse kinematics of a limb, placing the origin of the
+    /// effector joint at a target position and, for _6_DOF contacts, orientation.
+    /// Only the limb dofs of configuration are modified, starting from their current
+    /// values, so that a sample provides a warm start. The limb jacobian is fixed size
+    /// for limbs of at most 7 dofs. Joint bounds are not enforced.
+    /// \param device robot used to compute the kinematics, possibly a copy of the robot of the limb
+    /// \param rotationFilter constrained axes of the orientation, in the world frame
+    /// \param tolerance the resolution stops when the norm of the error is below it
+    /// \param maxIterations maximal number of configuration updates
+    HPP_RBPRM_DLLAPI IKReport apply(const model::DevicePtr_t& device, const RbPrmLimb& limb,
+                                    model::ConfigurationOut_t configuration,
+                                    const fcl::Vec3f& positionTarget, const fcl::Matrix3f& rotationTarget,
+                                    const std::vector<bool>& rotationFilter = std::vector<bool>(3, true),
+                                    const double tolerance = 1e-4, const std::size_t maxIterations = 20);
+} // namespace ik
+} // namespace rbprm
+} // namespace hpp
+#endif //_CLASS_IKSOLVER
@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_KINEMATICS_WORKSPACE_HH
+# define HPP_RBPRM_KINEMATICS_WORKSPACE_HH
+
+# include <hpp/rbprm/config.hh>
+# include <hpp/model/device.hh>
+# include <hpp/util/pointer.hh>
+
+namespace hpp {
+  namespace rbprm {
+
+    HPP_PREDEF_CLASS(KinematicsLock);
+
+    /// Lock serializing the contact queries using the device of a full body.
+    /// It can be acquired several times by the same thread.
+    class HPP_RBPRM_DLLAPI KinematicsLock
+    {
+    public:
+        static KinematicsLockPtr_t create();
+        ~KinematicsLock();
+
+        void lock();
+        void unlock();
+
+    private:
+        KinematicsLock();
+        KinematicsLock(const KinematicsLock&);
+        KinematicsLock& operator=(const KinematicsLock&);
+
+    private:
+        /// omp_nest_lock_t, kept out of the header so that it does not depend on OpenMP
+        void* lock_;
+    }; // class KinematicsLock
+
+    /// Configuration and joint transforms of a robot during a contact query.
+    /// The workspace saves the configuration and the computation flag of the device
+    /// when it is created, and restores them when it is destroyed, so that a query
+    /// leaves the device as it found it. The forward kinematics are only computed again
+    /// if the configuration was changed during the query. While it exists, the workspace holds the lock
+    /// of the device: queries on the same device run one at a time, and workspaces
+    /// can be nested within a query.
+    class HPP_RBPRM_DLLAPI KinematicsWorkspace
+    {
+    public:
+        /// \param device robot used by the query
+        /// \param lock lock associated with the device
+        KinematicsWorkspace(const model::DevicePtr_t& device, const KinematicsLockPtr_t& lock);
+        /// \param flag computations done by the forward kinematics during the query
+        KinematicsWorkspace(const model::DevicePtr_t& device, const KinematicsLockPtr_t& lock,
+                            const model::Device::Computation_t flag);
+        ~KinematicsWorkspace();
+
+        /// Sets the configuration of the robot and updates its joint transforms
+        void configuration(model::ConfigurationIn_t configuration);
+        model::ConfigurationIn_t configuration() const {return device_->currentConfiguration();}
+        /// configuration of the device when the workspace was created
+        const model::Configuration_t& saved() const {return saved_;}
+
+    public:
+        const model::DevicePtr_t device_;
+
+    private:
+        KinematicsWorkspace(const KinematicsWorkspace&);
+        KinematicsWorkspace& operator=(const KinematicsWorkspace&);
+
+    private:
+        const KinematicsLockPtr_t lock_;
+        const model::Configuration_t saved_;
+        const model::Device::Computation_t flag_;
+        /// whether configuration() was called
+        bool modified_;
+    }; // class KinematicsWorkspace
+
+  } // namespace rbprm
+} // namespace hpp
+
+#endif // HPP_RBPRM_KINEMATICS_WORKSPACE_HH
@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau
+//
+// This file is part of hpp-rbprm
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-core is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_LIMB_COLLISION_VALIDATION_HH
+# define HPP_RBPRM_LIMB_COLLISION_VALIDATION_HH
+
+# include <hpp/core/collision-validation.hh>
+# include <hpp/core/relative-motion.hh>
+# include <hpp/rbprm/config.hh>
+
+# include <set>
+# include <vector>
+
+namespace hpp {
+  namespace rbprm {
+
+    class LimbCollisionValidation;
+    typedef boost::shared_ptr <LimbCollisionValidation> LimbCollisionValidationPtr_t;
+
+    /// \addtogroup validation
+    /// \{
+
+    /// Collision validation of the configurations of a limb.
+    /// When a configuration only differs from the current configuration of the robot
+    /// by the limb degrees of freedom, only the positions of the joints of the limb
+    /// are updated, and only the collision pairs involving the limb bodies are tested.
+    /// Other configurations are validated as by core::CollisionValidation.
+    ///
+    class HPP_RBPRM_DLLAPI LimbCollisionValidation : public core::CollisionValidation
+    {
+    public:
+      /// \param robot the robot owning the limb
+      /// \param limb root joint of the limb. It can not be the root joint of the robot.
+      static LimbCollisionValidationPtr_t create (const model::DevicePtr_t& robot,
+                                                  const model::JointPtr_t& limb);
+
+      /// Compute whether the configuration is valid
+      ///
+      /// \param config the config to check for validity
+      /// \return whether the whole config is valid.
+      virtual bool validate (const core::Configuration_t& config);
+
+      /// Compute whether the configuration is valid
+      ///
+      /// \param config the config to check for validity,
+      /// \retval validationReport report on validation. This parameter will
+      ///         dynamically cast into CollisionValidationReport type,
+      /// \return whether the whole config is valid.
+      virtual bool validate (const core::Configuration_t& config,
+                 core::ValidationReportPtr_t& validationReport);
+
+      /// Add an obstacle, tested against every body of the robot
+      virtual void addObstacle (const model::CollisionObjectPtr_t& object);
+
+      /// Remove the collision pairs between a joint and an obstacle
+      virtual void removeObstacleFromJoint (const model::JointPtr_t& joint,
+                                            const model::CollisionObjectPtr_t& obstacle);
+
+      /// Remove the collision pairs between bodies which can not move relatively to each other
+      virtual void filterCollisionPairs (const core::RelativeMotion::matrix_type& relMotion);
+
+      /// \return whether a configuration only differs from the current configuration
+      /// of the robot by the limb degrees of freedom
+      bool limbOnly (const core::Configuration_t& config) const;
+
+      /// \return whether the collisions between a joint of the limb and an obstacle are tested
+      bool hasCollisionPair (const model::JointPtr_t& joint, const model::CollisionObjectPtr_t& obstacle) const;
+
+      /// obstacles added to the validation
+      const model::ObjectVector_t& obstacles () const {return obstacles_;}
+
+    public:
+      const model::JointPtr_t limb_;
+
+    protected:
+      LimbCollisionValidation (const model::DevicePtr_t& robot, const model::JointPtr_t& limb);
+
+    private:
+      struct CollisionPair
+      {
+          model::JointPtr_t joint_;
+          model::CollisionObjectPtr_t object1_;
+          model::CollisionObjectPtr_t object2_;
+      };
+      typedef std::vector<CollisionPair> T_CollisionPair;
+
+      void addCollisionPair (const model::JointPtr_t& joint, const model::CollisionObjectPtr_t& object1,
+                             const model::CollisionObjectPtr_t& object2);
+
+    private:
+      const model::DevicePtr_t robot_;
+      /// joints of the limb subtree
+      model::JointVector_t joints_;
+      std::set<model::JointPtr_t> jointSet_;
+      /// range of the limb subtree in the configuration
+      std::size_t startRank_, endRank_;
+      T_CollisionPair collisionPairs_;
+      model::ObjectVector_t obstacles_;
+      fcl::CollisionRequest collisionRequest_;
+      core::ValidationReportPtr_t unusedReport_;
+    }; // class LimbCollisionValidation
+    /// \}
+  } // namespace rbprm
+} // namespace hpp
+
+#endif // HPP_RBPRM_LIMB_COLLISION_VALIDATION_HH
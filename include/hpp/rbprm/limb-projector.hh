@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_LIMB_PROJECTOR_HH
+# define HPP_RBPRM_LIMB_PROJECTOR_HH
+
+# include <hpp/rbprm/config.hh>
+# include <hpp/rbprm/rbprm-limb.hh>
+# include <hpp/core/fwd.hh>
+# include <hpp/constraints/fwd.hh>
+
+# include <vector>
+
+namespace hpp {
+  namespace rbprm {
+
+    /// Inverse kinematics solver placing the effector of a limb at a target
+    /// transform, the joints outside of the limb being locked.
+    /// The projector and its constraints are built once: only the locked joint values
+    /// and the targets are updated between two projections.
+    class HPP_RBPRM_DLLAPI LimbProjector
+    {
+    public:
+        /// \param device robot on which the limb is projected, possibly a copy of the robot of the limb
+        /// \param limb projected limb
+        /// \param rotationFilter constrained axes of the effector orientation, for _6_DOF contacts
+        static LimbProjectorPtr_t create(const model::DevicePtr_t& device, const RbPrmLimb& limb,
+                                         const std::vector<bool>& rotationFilter);
+
+    public:
+        /// Projects the limb so that the effector reaches its targets. The locked joints keep
+        /// their values in the current configuration of device_.
+        /// \param configuration initial configuration of the solver, updated with the solution
+        /// \return whether the solver converged
+        bool apply(model::ConfigurationOut_t configuration, const fcl::Matrix3f& rotationTarget, const fcl::Vec3f& positionTarget);
+
+    public:
+        const model::DevicePtr_t device_;
+        const std::vector<bool> rotationFilter_;
+
+    private:
+        LimbProjector(const model::DevicePtr_t& device, const RbPrmLimb& limb, const std::vector<bool>& rotationFilter);
+
+    private:
+        core::ConfigProjectorPtr_t proj_;
+        constraints::PositionPtr_t position_;
+        constraints::OrientationPtr_t orientation_;
+    }; // class LimbProjector
+
+    /// \return the projector of a limb for a robot, built at the first call for this robot
+    /// and rotation filter. Thread safe, but a projector must not be applied concurrently.
+    HPP_RBPRM_DLLAPI LimbProjectorPtr_t GetLimbProjector(RbPrmLimb& limb, const model::DevicePtr_t& device,
+                                                         const std::vector<bool>& rotationFilter);
+
+  } // namespace rbprm
+} // namespace hpp
+
+#endif // HPP_RBPRM_LIMB_PROJECTOR_HH
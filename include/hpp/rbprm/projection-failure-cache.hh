@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_PROJECTION_FAILURE_CACHE_HH
+# define HPP_RBPRM_PROJECTION_FAILURE_CACHE_HH
+
+# include <hpp/rbprm/config.hh>
+# include <hpp/rbprm/sampling/candidate-set.hh>
+# include <hpp/model/fwd.hh>
+
+# include <list>
+# include <map>
+# include <string>
+
+namespace hpp {
+  namespace rbprm {
+  namespace sampling{
+    class SampleDB;
+  } // namespace sampling
+
+    /// Bounded record of the contact candidates of a limb that recently failed to
+    /// give a contact: the projection of the sample on the contacted triangle failed,
+    /// the projected configuration was in collision, or the contact was not stable enough.
+    /// Failures are identified by the sample, the contacted triangle, the rest of the
+    /// robot configuration quantized to a given resolution, the limbs already in contact
+    /// and the collision validation used. They are thus approximate:
+    /// a candidate failing for a configuration may succeed for a close one.
+    /// The least recently recorded failures are dropped beyond the capacity.
+    /// The capacity is null by default, which disables the cache.
+    class HPP_RBPRM_DLLAPI ProjectionFailureCache
+    {
+    public:
+        enum Failure
+        {
+            PROJECTION_FAILURE = 0,
+            COLLISION_FAILURE = 1,
+            STABILITY_FAILURE = 2
+        };
+
+        struct Key
+        {
+            const sampling::SampleStorage* storage_;
+            std::size_t sample_;
+            const fcl::CollisionGeometry* geometry_;
+            int triangle_;
+            /// hash of the quantized configuration, the contacts and the validation
+            std::size_t context_;
+            bool operator<(const Key& other) const;
+        };
+
+        struct Record
+        {
+            Failure failure_;
+            /// robustness of the contact, for stability failures
+            double robustness_;
+        };
+
+    public:
+        /// \param capacity maximal number of failures recorded
+        /// \param resolution quantization step of the configuration, in configuration units
+        ProjectionFailureCache(const std::size_t capacity = 0, const double resolution = 1e-3);
+
+        /// Hashes the quantized configuration of the robot, except for the dofs of a limb,
+        /// with the limbs in contact and the identity of the collision validation.
+        /// \param limbDofs range of the limb dofs in the configuration
+        /// \param contacts contact status of the limbs, as State::contacts_
+        /// \param validation collision validation of the projected configurations
+        std::size_t context(model::ConfigurationIn_t configuration, const std::pair<std::size_t, std::size_t>& limbDofs,
+                            const std::map<std::string, bool>& contacts, const void* validation) const;
+        Key key(const sampling::OctreeReport& report, const std::size_t context) const;
+
+        /// Drops the failures if the samples of the database changed since the last call.
+        void update(const sampling::SampleDB& database);
+        /// \return whether the candidate identified by key failed recently. Counts a hit or a miss. Thread safe.
+        bool find(const Key& key, Record& record);
+        /// Records a failure. Thread safe.
+        void insert(const Key& key, const Failure failure, const double robustness = 0.);
+        void clear();
+
+        bool enabled() const {return capacity_ > 0;}
+        std::size_t size() const {return records_.size();}
+        std::size_t hits() const {return hits_;}
+        std::size_t misses() const {return misses_;}
+        /// fraction of the lookups finding a failure
+        double hitRate() const;
+        void resetCounters();
+
+    public:
+        std::size_t capacity_;
+        double resolution_;
+
+    private:
+        typedef std::list<Key> T_Order;
+        typedef std::map<Key, std::pair<Record, T_Order::iterator> > T_Records;
+        T_Records records_;
+        /// keys from the oldest to the newest record
+        T_Order order_;
+        const fcl::CollisionGeometry* octree_;
+        std::size_t nbSamples_;
+        std::size_t hits_;
+        std::size_t misses_;
+    }; // class ProjectionFailureCache
+
+  } // namespace rbprm
+} // namespace hpp
+
+#endif // HPP_RBPRM_PROJECTION_FAILURE_CACHE_HH
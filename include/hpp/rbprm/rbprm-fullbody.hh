@@ -24,6 +24,8 @@
 #include <hpp/model/device.hh>
 #include <hpp/model/fwd.hh>
 #include <hpp/rbprm/rbprm-limb.hh>
+#include <hpp/rbprm/kinematics-workspace.hh>
+#include <hpp/rbprm/affordance-table.hh>
 #include <hpp/core/collision-validation.hh>
 #include <hpp/rbprm/sampling/heuristic.hh>
 
@@ -41,7 +43,6 @@ namespace hpp {
     ///
     class RbPrmFullBody;
     typedef boost::shared_ptr <RbPrmFullBody> RbPrmFullBodyPtr_t;
-		typedef std::map<std::string, std::vector<model::CollisionObjectPtr_t> > affMap_t;
 
     class HPP_RBPRM_DLLAPI RbPrmFullBody
     {
@@ -72,17 +73,24 @@ namespace hpp {
         /// This can be problematic in terms of performance. The default value is 3 cm.
         /// \param resolution, resolution of the octree voxels. The samples generated are stored in an octree data
         /// \param disableEffectorCollision, whether collision detection should be disabled for end effector bones
+        /// \param nbThreads number of threads used to generate the samples. 0 uses all available threads
+        /// \param storeJacobians if false, sample jacobians are not stored but computed on demand,
+        /// which reduces the memory used by the database
+        /// \param encoding encoding of the sample configurations and effector positions. Compact encodings
+        /// reduce the memory used by the database, samples being decoded when loaded
         void AddLimb(const std::string& id, const std::string& name, const std::string& effectorName, const fcl::Vec3f &offset,
                      const fcl::Vec3f &normal,const double x, const double y,
                      const model::ObjectVector_t &collisionObjects,
                      const std::size_t nbSamples, const std::string& heuristic = "static", const double resolution = 0.03,
-                     ContactType contactType = _6_DOF, const bool disableEffectorCollision = false);
+                     ContactType contactType = _6_DOF, const bool disableEffectorCollision = false, const std::size_t nbThreads = 0,
+                     const bool storeJacobians = true, const sampling::SampleEncoding encoding = sampling::DOUBLE_ENCODING);
 
         /// Creates a Limb for the robot,
         /// identified by its name. Stores a sample
         /// container, used for requests
         ///
-        /// \param database: path to the sample database used for the limbs
+        /// \param database: path to the sample database used for the limbs. Both the text
+        /// and the binary formats are accepted, the format being detected from the file content.
         /// \param id: user defined id for the limb. Must be unique.
         /// The id is used if several contact points are defined for the same limb (ex: the knee and the foot)
         /// \param collisionObjects objects to be considered for collisions with the limb. TODO remove
@@ -90,8 +98,11 @@ namespace hpp {
         /// of the unit voxel of the octree. The larger they are, the more samples will be considered as candidates for contact.
         /// This can be problematic in terms of performance. The default value is 3 cm.
         /// \param disableEffectorCollision, whether collision detection should be disabled for end effector bones
+        /// \param shareDatabase if true, the sample database is obtained from the sampling::DatabaseRegistry,
+        /// and shared with the other limbs loaded from the same file. The database must then not be modified.
         void AddLimb(const std::string& database, const std::string& id, const model::ObjectVector_t &collisionObjects,
-                      const std::string& heuristicName, const bool loadValues, const bool disableEffectorCollision = false);
+                      const std::string& heuristicName, const bool loadValues, const bool disableEffectorCollision = false,
+                      const bool shareDatabase = false);
 
         /// Add a new heuristic for biasing sample candidate selection
         ///
@@ -100,6 +111,19 @@ namespace hpp {
         /// \return whether the heuristic has been added. False is returned if a heuristic with that name already exists.
         bool AddHeuristic(const std::string& name, const sampling::heuristic func);
 
+        /// Sets the number of threads used to compute contacts. The contact candidates
+        /// are projected by windows of nbThreads candidates, each thread working on
+        /// its own copy of the robot. The contact selected is the same as in a serial search.
+        /// Heuristics, collision validation and balance are still evaluated serially.
+        /// \param nbThreads number of threads. 1 (default) computes contacts serially,
+        /// 0 uses all available threads
+        void SetContactSearchThreads(const std::size_t nbThreads);
+
+        /// Selects the solver projecting the limbs on the contact surfaces.
+        /// \param dampedLeastSquares if true, ik::apply is used instead of a ConfigProjector (default)
+        void SetDampedLeastSquaresProjection(const bool dampedLeastSquares) {dampedLeastSquaresProjection_ = dampedLeastSquares;}
+        bool GetDampedLeastSquaresProjection() const {return dampedLeastSquaresProjection_;}
+
     public:
         typedef std::map<std::string, std::vector<std::string> > T_LimbGroup;
 
@@ -107,6 +131,14 @@ namespace hpp {
         const rbprm::T_Limb& GetLimbs() {return limbs_;}
         const T_LimbGroup& GetGroups() {return limbGroups_;}
         const core::CollisionValidationPtr_t& GetCollisionValidation() {return collisionValidation_;}
+        /// copies of device_ used by the parallel contact search, one per thread. Empty for a serial search
+        const std::vector<model::DevicePtr_t>& GetContactSearchDevices() const {return contactSearchDevices_;}
+        /// lock of device_, held by the KinematicsWorkspace of the contact queries
+        const KinematicsLockPtr_t& GetKinematicsLock() const {return kinematicsLock_;}
+        /// affordance objects of each limb, compiled again only when the affordances,
+        /// the filters or the limbs have changed since the last call.
+        /// The kinematics lock must be held while the table is used
+        const AffordanceTable& GetAffordanceTable(const affMap_t& affordances, const T_AffordanceFilters& affFilters);
         const model::DevicePtr_t device_;
 
     private:
@@ -115,6 +147,10 @@ namespace hpp {
         rbprm::T_Limb limbs_;
         T_LimbGroup limbGroups_;
         sampling::HeuristicFactory factory_;
+        std::vector<model::DevicePtr_t> contactSearchDevices_;
+        bool dampedLeastSquaresProjection_;
+        const KinematicsLockPtr_t kinematicsLock_;
+        AffordanceTable affordanceTable_;
 
     private:
         void AddLimbPrivate(rbprm::RbPrmLimbPtr_t limb, const std::string& id, const std::string& name,
@@ -136,6 +172,12 @@ namespace hpp {
         const std::map<std::string, std::vector<std::string> >& affFilters,
         const fcl::Vec3f& direction, const double robustnessTreshold);
 
+      friend std::vector<hpp::rbprm::State> HPP_RBPRM_DLLAPI ComputeContacts(
+        const hpp::rbprm::RbPrmFullBodyPtr_t& body,
+        const std::vector<model::Configuration_t>& configurations, const affMap_t& affordances,
+        const std::map<std::string, std::vector<std::string> >& affFilters,
+        const std::vector<fcl::Vec3f>& directions, const double robustnessTreshold);
+
       friend hpp::rbprm::State HPP_RBPRM_DLLAPI ComputeContacts(
 				const hpp::rbprm::State& previous, const hpp::rbprm::RbPrmFullBodyPtr_t& body,
 				model::ConfigurationIn_t configuration,
@@ -163,6 +205,26 @@ namespace hpp {
       const std::map<std::string, std::vector<std::string> >& affFilters, const fcl::Vec3f& direction,
       const double robustnessTreshold = 0);
 
+    /// Generates a balanced contact configuration for each configuration of a batch,
+    /// as the single configuration version does. Affordance filtering is done once
+    /// for the whole batch, and the device is locked only once.
+    /// Candidate evaluation is parallelized with RbPrmFullBody::SetContactSearchThreads.
+    ///
+    /// \param body The considered FullBody robot for which to generate contacts
+    /// \param configurations Full body configurations to compute contacts for.
+    /// \param affordances the set of 3D objects to consider for contact creation.
+    /// \param affFilters a vector of strings determining which affordance
+    ///  types are to be used in generating contacts for each limb.
+    /// \param directions An estimation of the direction of motion for each configuration,
+    /// or a single direction shared by all configurations.
+    /// \param robustnessTreshold minimum value of the static equilibrium robustness criterion required to accept the configuration (0 by default).
+    /// \return a State for each configuration, in the same order.
+    std::vector<hpp::rbprm::State> HPP_RBPRM_DLLAPI ComputeContacts(
+      const hpp::rbprm::RbPrmFullBodyPtr_t& body, const std::vector<model::Configuration_t>& configurations,
+      const affMap_t& affordances,
+      const std::map<std::string, std::vector<std::string> >& affFilters, const std::vector<fcl::Vec3f>& directions,
+      const double robustnessTreshold = 0);
+
     /// Generates a balanced contact configuration, considering the
     /// given current configuration of the robot, and a previous, balanced configuration.
     /// Existing contacts are maintained provided joint limits and balance remains respected.
@@ -197,9 +259,6 @@ namespace hpp {
                                                const fcl::Matrix3f& rotationTarget, const std::vector<bool>& rotationFilter, const fcl::Vec3f& positionTarget, const fcl::Vec3f& normal,
                                                const hpp::rbprm::State& current, bool& success);
 
-    hpp::model::ObjectVector_t HPP_RBPRM_DLLAPI getAffObjectsForLimb(const std::string& limb,
-        const affMap_t& affordances, const std::map<std::string, std::vector<std::string> >& affFilters);
-
   } // namespace rbprm
 
 } // namespace hpp
@@ -22,7 +22,9 @@
 # include <hpp/rbprm/config.hh>
 # include <hpp/rbprm/sampling/sample-db.hh>
 # include <hpp/rbprm/sampling/heuristic.hh>
+# include <hpp/rbprm/projection-failure-cache.hh>
 # include <hpp/model/device.hh>
+# include <hpp/core/fwd.hh>
 
 namespace hpp {
   namespace rbprm {
@@ -36,6 +38,20 @@ namespace hpp {
 
 
     HPP_PREDEF_CLASS(RbPrmLimb);
+    HPP_PREDEF_CLASS(LimbProjector);
+
+    /// Samples of the voxels of a limb octree in collision with obstacles, for a
+    /// database state, an octree transform and an obstacle set
+    struct BlockedSamples
+    {
+        BlockedSamples() : octree_(0), nbSamples_(0) {}
+        const fcl::CollisionGeometry* octree_;
+        std::size_t nbSamples_;
+        fcl::Transform3f root_;
+        model::ObjectVector_t obstacles_;
+        /// sorted by position in the database
+        std::vector<sampling::VoxelSampleId> samples_;
+    };
 
     /// Representation of a robot limb.
     /// Contains a SampleDB used for computing contact candidates
@@ -87,15 +103,35 @@ namespace hpp {
         /// This can be problematic in terms of performance. The default value is 3 cm.
         /// \param contactType Whether the contact is a surface contact (orientation matters) or a punctual contact
         /// \param disableEndEffectorCollision Whether the end effector bodies should be counted for collision detection
+        /// \param nbThreads number of threads used to generate the samples. 0 uses all available threads.
+        /// The generated samples do not depend on the number of threads.
+        /// \param storeJacobians if false, sample jacobians are computed on demand instead of being stored
+        /// \param encoding encoding of the sample configurations and effector positions
         static RbPrmLimbPtr_t create (const model::JointPtr_t limb, const std::string& effectorName, const fcl::Vec3f &offset,
                                       const fcl::Vec3f &normal,const double x, const double y,
                                       const std::size_t nbSamples, const sampling::heuristic evaluate = 0,
                                       const double resolution = 0.1, ContactType contactType = _6_DOF,
-                                      bool disableEndEffectorCollision = false);
+                                      bool disableEndEffectorCollision = false, const std::size_t nbThreads = 0,
+                                      const bool storeJacobians = true,
+                                      const sampling::SampleEncoding encoding = sampling::DOUBLE_ENCODING);
 
+        /// Creates a Limb from a limb file
+        /// \param sharedDatabase if not empty, database used by the limb instead of
+        /// the one stored in the file, which is then not read
         static RbPrmLimbPtr_t create (const model::DevicePtr_t device, std::ifstream& fileStream, const bool loadValues = true,
                                       const hpp::rbprm::sampling::heuristic evaluate = 0,
-                                      bool disableEndEffectorCollision = false);
+                                      bool disableEndEffectorCollision = false,
+                                      const sampling::SampleDBPtr_t& sharedDatabase = sampling::SampleDBPtr_t());
+
+        /// Creates a Limb from a memory mapped binary limb file.
+        /// If the file does not contain the sample jacobians, they are computed on demand.
+        /// \param sharedDatabase if not empty, database used by the limb instead of
+        /// the one stored in the file, which is then not read
+        static RbPrmLimbPtr_t create (const model::DevicePtr_t device, const sampling::binary::MappedFilePtr_t& file,
+                                      const bool loadValues = true,
+                                      const hpp::rbprm::sampling::heuristic evaluate = 0,
+                                      bool disableEndEffectorCollision = false,
+                                      const sampling::SampleDBPtr_t& sharedDatabase = sampling::SampleDBPtr_t());
 
     public:
         ~RbPrmLimb();
@@ -113,8 +149,31 @@ namespace hpp {
         const double y_; // half length of contact surface
         const ContactType contactType_;
         sampling::heuristic evaluate_;
-        const sampling::SampleDB sampleContainer_;
+        /// owns sampleContainer_, possibly shared with other limbs
+        const sampling::SampleDBPtr_t sampleDatabase_;
+        sampling::SampleDB& sampleContainer_;
         const bool disableEndEffectorCollision_;
+        /// broadphase structure on the affordance objects last used for contact generation
+        sampling::AffordanceIndexPtr_t affordanceIndex_;
+        /// collisions with the affordance objects of the last contact generation,
+        /// tested again while the root barely moves
+        sampling::CandidateCache candidateCache_;
+        /// inverse kinematics solvers of the limb, one per robot copy and rotation filter.
+        /// Accessed through GetLimbProjector
+        std::vector<LimbProjectorPtr_t> projectors_;
+        /// candidates that recently failed to give a contact, skipped by the contact search.
+        /// Disabled by default
+        ProjectionFailureCache projectionFailures_;
+        /// positions in sampleContainer_.samples_ of samples free of self collisions,
+        /// by increasing distance of the effector to the limb origin. They are tried
+        /// first when no contact is found for the limb. Computed on first use by GetFallbackSamples
+        std::vector<std::size_t> fallbackSamples_;
+        /// octree and number of samples of sampleContainer_ when fallbackSamples_ was computed
+        const fcl::CollisionGeometry* fallbackOctree_;
+        std::size_t fallbackNbSamples_;
+        /// fallback samples with an effector in collision with the obstacles of the
+        /// last fallback search, skipped when trying the fallback samples
+        BlockedSamples blockedSamples_;
 
     protected:
 
@@ -122,11 +181,18 @@ namespace hpp {
                  const fcl::Vec3f &normal,const double x, const double y,
                  const std::size_t nbSamples, const sampling::heuristic evaluate,
                  const double resolution, ContactType contactType,
-                 bool disableEndEffectorCollision = false);
+                 bool disableEndEffectorCollision = false, const std::size_t nbThreads = 0,
+                 const bool storeJacobians = true, const sampling::SampleEncoding encoding = sampling::DOUBLE_ENCODING);
 
       RbPrmLimb (const model::DevicePtr_t device, std::ifstream& fileStream, const bool loadValues,
                  const hpp::rbprm::sampling::heuristic evaluate,
-                 bool disableEndEffectorCollision = false);
+                 bool disableEndEffectorCollision = false,
+                 const sampling::SampleDBPtr_t& sharedDatabase = sampling::SampleDBPtr_t());
+
+      RbPrmLimb (const model::DevicePtr_t device, const sampling::binary::MappedFilePtr_t& file, const bool loadValues,
+                 const hpp::rbprm::sampling::heuristic evaluate,
+                 bool disableEndEffectorCollision = false,
+                 const sampling::SampleDBPtr_t& sharedDatabase = sampling::SampleDBPtr_t());
       ///
       /// \brief Initialization.
       ///
@@ -137,8 +203,48 @@ namespace hpp {
     }; // class RbPrmLimb
 
 
+    /// Selects the samples of a limb tried first when looking for a collision free limb
+    /// configuration without contact: the most folded samples for which the limb is not
+    /// in collision in the current configuration of the robot.
+    /// Must be called again if the samples of the limb database are modified.
+    /// \param limb the limb, the robot kinematics being computed for its current configuration
+    /// \param validation validation of the limb configurations, typically without obstacles
+    /// \param maxSamples maximum number of samples selected
+    HPP_RBPRM_DLLAPI void ComputeFallbackSamples(RbPrmLimb& limb, const core::CollisionValidationPtr_t& validation,
+                                                 const std::size_t maxSamples = 1000);
+
+    /// Returns the fallback samples of a limb, computed with ComputeFallbackSamples
+    /// and a limb validation without obstacles on first use, or when the samples of
+    /// the limb database have changed since. The kinematics lock must be held.
+    /// \param limb the limb, the robot kinematics being computed for its current configuration
+    /// \param maxSamples maximum number of samples selected
+    /// \return positions in the sample container of the selected samples
+    HPP_RBPRM_DLLAPI const std::vector<std::size_t>& GetFallbackSamples(RbPrmLimb& limb, const std::size_t maxSamples = 1000);
+
     HPP_RBPRM_DLLAPI bool saveLimbInfoAndDatabase(const RbPrmLimbPtr_t limb, std::ofstream& dbFile);
 
+    /// Saves a limb and its database in the binary format.
+    /// dbFile must be opened in binary mode.
+    HPP_RBPRM_DLLAPI bool saveLimbInfoAndDatabaseBinary(const RbPrmLimbPtr_t limb, std::ofstream& dbFile);
+
+    /// Converts a limb file saved with saveLimbInfoAndDatabase into the binary format.
+    /// \param textFile path to the existing text database
+    /// \param binaryFile path of the binary database to write
+    /// \return whether the conversion succeeded
+    HPP_RBPRM_DLLAPI bool convertLimbDatabase(const std::string& textFile, const std::string& binaryFile);
+
+    /// Prunes the database of a limb file with sampling::prune, and saves it in the binary format.
+    /// \param inputFile path to the existing text or binary database
+    /// \param binaryFile path of the binary database to write
+    /// \param maxSamplesPerVoxel number of samples kept in a voxel
+    /// \param criterion how the kept samples are chosen
+    /// \param valueName value used to rank the samples, the static value if empty
+    /// \return the sizes of the database before and after pruning
+    HPP_RBPRM_DLLAPI sampling::PruningReport pruneLimbDatabase(const std::string& inputFile, const std::string& binaryFile,
+                                                               const std::size_t maxSamplesPerVoxel,
+                                                               const sampling::PruningCriterion criterion = sampling::PRUNE_BY_VALUE,
+                                                               const std::string& valueName = "");
+
   } // namespace rbprm
 } // namespace hpp
 
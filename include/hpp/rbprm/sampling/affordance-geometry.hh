@@ -0,0 +1,62 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_AFFORDANCE_GEOMETRY_HH
+# define HPP_RBPRM_AFFORDANCE_GEOMETRY_HH
+
+#include <hpp/rbprm/config.hh>
+#include <hpp/util/pointer.hh>
+#include <hpp/fcl/collision_object.h>
+
+#include <vector>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+
+    HPP_PREDEF_CLASS(AffordanceGeometry);
+
+    /// Normals and areas of the triangles of an affordance mesh, computed once per mesh.
+    /// They are expressed in the frame of the mesh, and shared by all the users of the mesh
+    /// through Get.
+    class HPP_RBPRM_DLLAPI AffordanceGeometry
+    {
+    public:
+        /// \return the triangle normals of a mesh, computed at the first call for this mesh.
+        /// Thread safe.
+        /// \param mesh a BVHModel<OBBRSS> of triangles
+        static AffordanceGeometryConstPtr_t Get(const boost::shared_ptr<const fcl::CollisionGeometry>& mesh);
+
+    public:
+        std::size_t size() const {return normals_.size();}
+
+    public:
+        /// unit normal of each triangle
+        std::vector<fcl::Vec3f> normals_;
+        /// area of each triangle
+        std::vector<double> areas_;
+
+    private:
+        AffordanceGeometry(const fcl::CollisionGeometry& mesh);
+    }; // class AffordanceGeometry
+
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_AFFORDANCE_GEOMETRY_HH
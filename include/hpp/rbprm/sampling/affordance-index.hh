@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_AFFORDANCE_INDEX_HH
+# define HPP_RBPRM_AFFORDANCE_INDEX_HH
+
+#include <hpp/rbprm/config.hh>
+#include <hpp/model/collision-object.hh>
+#include <hpp/fcl/BV/AABB.h>
+
+#include <vector>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+
+    HPP_PREDEF_CLASS(AffordanceIndex);
+
+    /// Static AABB tree on a set of affordance objects, used as a broadphase
+    /// to discard the objects out of reach of a limb before computing collisions.
+    /// The world bounding boxes of the objects are read when the index is created,
+    /// the objects must not move afterwards.
+    class HPP_RBPRM_DLLAPI AffordanceIndex
+    {
+    public:
+        static AffordanceIndexPtr_t create(const model::ObjectVector_t& objects);
+
+    public:
+        /// Finds the objects whose bounding box intersects a box
+        /// \param box bounding box in the world frame
+        /// \param result positions in objects_ of the intersected objects, in increasing order
+        void query(const fcl::AABB& box, std::vector<std::size_t>& result) const;
+
+    public:
+        const model::ObjectVector_t objects_;
+
+    private:
+        AffordanceIndex(const model::ObjectVector_t& objects);
+        std::size_t build(const std::size_t first, const std::size_t last);
+
+        struct Node
+        {
+            fcl::AABB box_;
+            /// index of the second child, the first one is the next node. 0 for leaves
+            std::size_t right_;
+            /// range of the leaf objects in order_
+            std::size_t first_;
+            std::size_t last_;
+        };
+
+    private:
+        std::vector<fcl::AABB> boxes_;
+        /// object positions, grouped by leaf
+        std::vector<std::size_t> order_;
+        /// nodes in depth first order, the root being the first one
+        std::vector<Node> nodes_;
+    }; // class AffordanceIndex
+
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_AFFORDANCE_INDEX_HH
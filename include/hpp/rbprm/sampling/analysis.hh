@@ -38,6 +38,10 @@ namespace hpp {
 
        bool AddAnalysis(const std::string& name, const evaluate func);
        T_evaluate evaluate_;
+       /// Block versions of the analyses, to be used with addBatchValue.
+       /// Built-in analyses are thread safe, those added with AddAnalysis
+       /// are evaluated sample by sample.
+       T_BatchEvaluate batchEvaluate_;
        rbprm::RbPrmFullBodyPtr_t device_;
   };
   } // namespace sampling
@@ -0,0 +1,179 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_BINARY_DATABASE_HH
+# define HPP_RBPRM_BINARY_DATABASE_HH
+
+#include <hpp/rbprm/config.hh>
+#include <hpp/util/pointer.hh>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <string>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+  /// Binary, memory mappable layout of a limb database.
+  ///
+  /// A limb file is made of a FileHeader, a LimbHeader and a database block.
+  /// A database block starts with a DatabaseHeader, followed by the
+  /// sample arenas, the value columns, the voxel index and the octree. All offsets
+  /// in the DatabaseHeader are expressed in bytes relatively to the start
+  /// of the block, and every section is 8 bytes aligned, so that each arena of a
+  /// mapped file is copied in a single block, without parsing.
+  /// Data is stored in native (little endian) order.
+  namespace binary{
+
+    const boost::uint32_t FORMAT_VERSION = 5;
+    const std::size_t NAME_SIZE = 128;
+    const std::size_t VALUE_NAME_SIZE = 56;
+
+    /// DatabaseHeader flags
+    const boost::uint64_t JACOBIANS_STORED = 1;
+
+    struct FileHeader
+    {
+        char magic_[8]; // "RBPRMDB"
+        boost::uint32_t version_;
+        boost::uint32_t flags_;
+    };
+
+    struct LimbHeader
+    {
+        char limb_[NAME_SIZE];
+        char effector_[NAME_SIZE];
+        double effectorDefaultRotation_[9]; // row major
+        double offset_[3];
+        double normal_[3];
+        double x_;
+        double y_;
+        boost::int64_t contactType_;
+    };
+
+    struct DatabaseHeader
+    {
+        boost::uint64_t nbSamples_;
+        boost::uint64_t length_;       // configuration size of a sample
+        boost::uint64_t startRank_;    // rank of the limb in the robot configuration
+        boost::uint64_t jacobianCols_; // number of dofs of the limb
+        boost::uint64_t nbValues_;
+        boost::uint64_t nbVoxels_;
+        double resolution_;
+        boost::uint64_t flags_;        // JACOBIANS_STORED if the jacobian sections are not empty
+        boost::uint64_t encoding_;     // SampleEncoding of configurations and effector positions
+        boost::uint64_t staticValuesOffset_;
+        boost::uint64_t effectorPositionsOffset_;
+        boost::uint64_t configurationsOffset_;
+        boost::uint64_t boundsOffset_;
+        boost::uint64_t jacobiansOffset_;
+        boost::uint64_t jacobianProductsOffset_;
+        boost::uint64_t valuesOffset_;
+        boost::uint64_t voxelsOffset_;
+        boost::uint64_t octreeOffset_;
+        boost::uint64_t octreeSize_;   // size of the serialized octomap, in bytes
+        boost::uint64_t endOffset_;
+    };
+
+    /// Samples are stored as the column arenas of a SampleStorage, one after the other:
+    /// static values (1 double per sample), effector positions (3), configurations (length_),
+    /// jacobians (6 x jacobianCols_, column major) and jacobian products (36, column major).
+    /// With a compact encoding, effector positions are stored as float and configurations as
+    /// float or uint16. For FIXED16_ENCODING, the configurations are followed by the lower and
+    /// upper bounds of each dof (length_ doubles each); this section is empty otherwise.
+    /// Sections are zero padded to a multiple of 8 bytes.
+    /// The jacobian sections are empty if the JACOBIANS_STORED flag is not set,
+    /// in which case jacobians are computed on demand after loading.
+    /// The id of a sample is its index in the arenas.
+
+    /// Value columns are stored as nbValues_ ValueHeader followed
+    /// by nbValues_ columns of nbSamples_ doubles. Unknown bounds are NaN.
+    struct ValueHeader
+    {
+        char name_[VALUE_NAME_SIZE];
+        double min_;
+        double max_;
+    };
+
+    /// Range of samples contained in an octree leaf, identified
+    /// by its octomap key and depth.
+    /// Samples are saved in the octree order, so that the voxel index and
+    /// the octree, serialized with octomap::AbstractOcTree::write, are used
+    /// as is when the database is loaded.
+    struct VoxelRecord
+    {
+        boost::uint16_t key_[3];
+        boost::uint16_t depth_;
+        boost::uint64_t first_;
+        boost::uint64_t count_;
+    };
+
+    BOOST_STATIC_ASSERT(sizeof(FileHeader)     % 8 == 0);
+    BOOST_STATIC_ASSERT(sizeof(LimbHeader)     % 8 == 0);
+    BOOST_STATIC_ASSERT(sizeof(DatabaseHeader) % 8 == 0);
+    BOOST_STATIC_ASSERT(sizeof(ValueHeader)    % 8 == 0);
+    BOOST_STATIC_ASSERT(sizeof(VoxelRecord)    % 8 == 0);
+
+    HPP_PREDEF_CLASS(MappedFile);
+    typedef boost::shared_ptr<MappedFile> MappedFilePtr_t;
+
+    /// Read only memory mapping of a binary limb database file.
+    /// Databases created from the file copy the data they use, and do not keep
+    /// a reference on the mapping, which can be released once they are loaded.
+    class HPP_RBPRM_DLLAPI MappedFile
+    {
+    public:
+        static MappedFilePtr_t create(const std::string& filename);
+
+    public:
+        const char* data() const {return static_cast<const char*>(region_.get_address());}
+        std::size_t size() const {return region_.get_size();}
+        const FileHeader& fileHeader() const;
+        const LimbHeader& limbHeader() const;
+        /// offset of the database block in the file
+        std::size_t databaseOffset() const;
+
+    private:
+        MappedFile(const std::string& filename);
+
+    private:
+        boost::interprocess::file_mapping file_;
+        boost::interprocess::mapped_region region_;
+    };
+
+    /// Checks whether a file is a binary limb database, by reading its magic number
+    HPP_RBPRM_DLLAPI bool IsBinaryDatabase(const std::string& filename);
+
+    /// Fills a FileHeader with the magic number and current version
+    HPP_RBPRM_DLLAPI FileHeader MakeFileHeader();
+
+    /// Copies a name in a fixed size field, throws if the name is too long
+    HPP_RBPRM_DLLAPI void WriteName(const std::string& name, char* field, const std::size_t fieldSize);
+
+    HPP_RBPRM_DLLAPI std::string ReadName(const char* field, const std::size_t fieldSize);
+
+  } // namespace binary
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_BINARY_DATABASE_HH
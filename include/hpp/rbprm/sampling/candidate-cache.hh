@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_CANDIDATE_CACHE_HH
+# define HPP_RBPRM_CANDIDATE_CACHE_HH
+
+#include <hpp/rbprm/config.hh>
+#include <hpp/rbprm/sampling/affordance-index.hh>
+#include <hpp/fcl/collision_data.h>
+#include <hpp/fcl/math/transform.h>
+
+#include <vector>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+
+    class SampleDB;
+
+    /// Colliding pairs of octree voxels and affordance triangles, found by GetCandidates
+    /// for a root transform. While the root stays close to this transform, as between
+    /// consecutive steps of an interpolation, only the cached pairs are tested again
+    /// under the current root transform: pairs no longer in collision are dropped, and
+    /// contact positions are those of the current transform. Objects entering the reach
+    /// of the octree are fully tested and added to the cache. A full query is done when
+    /// the root moved beyond the thresholds, or when the database or the affordance objects
+    /// changed. Pairs entering in collision with an already cached object are only found
+    /// by the next full query.
+    class HPP_RBPRM_DLLAPI CandidateCache
+    {
+    public:
+        struct Entry
+        {
+            fcl::Transform3f treeTrf_;
+            const SampleDB* database_;
+            const fcl::CollisionGeometry* octree_;
+            std::size_t nbSamples_;
+            model::ObjectVector_t affordances_;
+            /// positions in affordances_ of the tested objects, in increasing order
+            std::vector<std::size_t> objects_;
+            /// colliding voxel and triangle ids, for each tested object
+            std::vector<std::vector<std::pair<int, int> > > pairs_;
+        };
+        typedef boost::shared_ptr<const Entry> EntryConstPtr_t;
+
+    public:
+        /// \param translationThreshold maximal distance between the cached and the queried root positions
+        /// \param rotationThreshold maximal angle, in radians, between the cached and the queried root orientations
+        CandidateCache(const double translationThreshold = 0.05, const double rotationThreshold = 0.1);
+
+        /// \return the cached collisions if they can be reused for a query, an empty pointer otherwise.
+        /// Counts a hit or a miss. Thread safe.
+        EntryConstPtr_t find(const SampleDB& sc, const fcl::Transform3f& treeTrf, const AffordanceIndex& affordances);
+        /// Replaces the cached collisions. Thread safe.
+        void store(const EntryConstPtr_t& entry);
+        void clear();
+
+        std::size_t hits() const {return hits_;}
+        std::size_t misses() const {return misses_;}
+        void resetCounters();
+
+    public:
+        double translationThreshold_;
+        double rotationThreshold_;
+
+    private:
+        EntryConstPtr_t entry_;
+        std::size_t hits_;
+        std::size_t misses_;
+    }; // class CandidateCache
+
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_CANDIDATE_CACHE_HH
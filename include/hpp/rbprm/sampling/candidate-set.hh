@@ -0,0 +1,154 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_CANDIDATE_SET_HH
+# define HPP_RBPRM_CANDIDATE_SET_HH
+
+#include <hpp/rbprm/config.hh>
+#include <hpp/rbprm/sampling/sample.hh>
+#include <hpp/fcl/collision_data.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+
+    /// Collision report for a Sample for which the octree node is
+    /// colliding with the environment.
+    struct OctreeReport
+    {
+      OctreeReport(const Sample*, const fcl::Contact, const double, const fcl::Vec3f& normal);
+      /// Sample considered for contact generation
+      const Sample* sample_;
+      /// Contact information returned from fcl
+      fcl::Contact contact_;
+      /// heuristic evaluation of the sample
+      double value_;
+      /// normal vector of the surface in contact
+      fcl::Vec3f normal_;
+    };
+
+
+    /// Comparaison operator between Samples
+    /// Used to sort the contact candidates depending
+    /// on their heuristic value
+    struct sample_compare {
+      bool operator() (const OctreeReport& lhs, const OctreeReport& rhs) const{
+          return lhs.value_ > rhs.value_;
+      }
+    };
+
+    /// Contact candidates, iterated by decreasing heuristic value.
+    /// Candidates with the same value are iterated in insertion order.
+    /// Candidates are stored in a flat vector, and only ordered as they are
+    /// iterated: a partial sort is done on chunks of growing size, so that the
+    /// candidates that are never reached are never sorted.
+    /// Ordering is done lazily by const methods, a set must not be iterated
+    /// concurrently by several threads.
+    class HPP_RBPRM_DLLAPI CandidateSet
+    {
+    public:
+        /// Best first iterator on the candidates
+        class const_iterator : public std::iterator<std::forward_iterator_tag, const OctreeReport>
+        {
+        public:
+            const_iterator() : set_(0), pos_(0) {}
+            const OctreeReport& operator*() const {return set_->at(pos_);}
+            const OctreeReport* operator->() const {return &set_->at(pos_);}
+            const_iterator& operator++() {++pos_; return *this;}
+            const_iterator operator++(int) {const_iterator res(*this); ++pos_; return res;}
+            bool operator==(const const_iterator& other) const {return pos_ == other.pos_ && set_ == other.set_;}
+            bool operator!=(const const_iterator& other) const {return !(*this == other);}
+
+        private:
+            const_iterator(const CandidateSet* set, const std::size_t pos) : set_(set), pos_(pos) {}
+            const CandidateSet* set_;
+            std::size_t pos_;
+            friend class CandidateSet;
+        };
+
+    public:
+        /// \param maxSize number of best candidates kept, the others are discarded
+        CandidateSet(const std::size_t maxSize = std::numeric_limits<std::size_t>::max());
+
+        std::size_t size() const {return std::min(entries_.size(), maxSize_);}
+        bool empty() const {return entries_.empty();}
+        std::size_t maxSize() const {return maxSize_;}
+        void clear();
+        void reserve(const std::size_t nbCandidates) {entries_.reserve(nbCandidates);}
+
+        void insert(const OctreeReport& report);
+        /// Inserts all the candidates of another set, after the candidates
+        /// of this set with the same value. The other set is not ordered.
+        void insert(const CandidateSet& other);
+        template<class InputIterator>
+        void insert(InputIterator first, InputIterator last)
+        {
+            for(; first != last; ++first)
+                insert(*first);
+        }
+
+        const_iterator begin() const {return const_iterator(this, 0);}
+        const_iterator end() const {return const_iterator(this, size());}
+
+        /// \return the candidate of rank pos, ordering the candidates up to pos if required
+        const OctreeReport& at(const std::size_t pos) const
+        {
+            if(pos >= ordered_)
+                order(pos);
+            return entries_[pos].report_;
+        }
+
+    private:
+        struct Entry
+        {
+            Entry(const OctreeReport& report, const std::size_t rank) : report_(report), rank_(rank) {}
+            OctreeReport report_;
+            /// insertion rank, used to order candidates with the same value
+            std::size_t rank_;
+        };
+        struct entry_compare
+        {
+            bool operator() (const Entry& lhs, const Entry& rhs) const
+            {
+                return lhs.report_.value_ > rhs.report_.value_
+                    || (lhs.report_.value_ == rhs.report_.value_ && lhs.rank_ < rhs.rank_);
+            }
+        };
+        void order(const std::size_t pos) const;
+        void truncate();
+
+    private:
+        mutable std::vector<Entry> entries_;
+        /// number of candidates at the beginning of entries_ in their final order
+        mutable std::size_t ordered_;
+        std::size_t maxSize_;
+        std::size_t nextRank_;
+    }; // class CandidateSet
+
+    typedef CandidateSet T_OctreeReport;
+
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_CANDIDATE_SET_HH
@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_DATABASE_REGISTRY_HH
+# define HPP_RBPRM_DATABASE_REGISTRY_HH
+
+#include <hpp/rbprm/config.hh>
+#include <hpp/rbprm/sampling/sample-db.hh>
+
+#include <boost/cstdint.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <map>
+#include <string>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+
+    /// Process wide registry of the sample databases loaded from limb files,
+    /// allowing limbs of several RbPrmFullBody to share a single copy of a database.
+    /// A database is identified by its file path, the hash of the file content,
+    /// and whether its values were loaded. The registry only holds weak references:
+    /// a database is released when no limb uses it anymore.
+    /// Registered databases are read only, see SampleDB::readOnly_.
+    class HPP_RBPRM_DLLAPI DatabaseRegistry
+    {
+    public:
+        static DatabaseRegistry& Instance();
+
+        /// \return the registered database, or an empty pointer
+        SampleDBPtr_t find(const std::string& filename, const boost::uint64_t hash, const bool loadValues);
+
+        /// Registers a database, and makes it read only. If a database was already
+        /// registered for the same key, the registered database is kept and returned.
+        SampleDBPtr_t insert(const std::string& filename, const boost::uint64_t hash, const bool loadValues,
+                             const SampleDBPtr_t& database);
+
+        /// number of databases currently in use
+        std::size_t size();
+
+    private:
+        DatabaseRegistry() {}
+        void purge();
+
+        struct Key
+        {
+            std::string filename_;
+            boost::uint64_t hash_;
+            bool loadValues_;
+            bool operator<(const Key& other) const;
+        };
+        typedef std::map<Key, boost::weak_ptr<SampleDB> > T_Database;
+
+    private:
+        T_Database databases_;
+    }; // class DatabaseRegistry
+
+    /// 64 bits FNV-1a hash of a buffer
+    HPP_RBPRM_DLLAPI boost::uint64_t ContentHash(const char* data, const std::size_t size);
+
+    /// 64 bits FNV-1a hash of the content of a file
+    HPP_RBPRM_DLLAPI boost::uint64_t ContentHash(const std::string& filename);
+
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_DATABASE_REGISTRY_HH
@@ -21,7 +21,13 @@
 
 #include <hpp/rbprm/config.hh>
 #include <hpp/rbprm/sampling/sample.hh>
+#include <hpp/rbprm/sampling/candidate-set.hh>
+#include <hpp/rbprm/sampling/candidate-cache.hh>
+#include <hpp/rbprm/sampling/affordance-index.hh>
+#include <hpp/rbprm/sampling/affordance-geometry.hh>
 #include <hpp/rbprm/sampling/heuristic.hh>
+#include <hpp/rbprm/sampling/binary-database.hh>
+#include <hpp/rbprm/sampling/voxel-index.hh>
 #include <hpp/fcl/octree.h>
 #include <vector>
 #include <map>
@@ -31,33 +37,6 @@ namespace hpp {
   namespace rbprm {
   namespace sampling{
 
-    /// Collision report for a Sample for which the octree node is
-    /// colliding with the environment.
-    struct OctreeReport
-    {
-      OctreeReport(const Sample*, const fcl::Contact, const double, const fcl::Vec3f& normal);
-      /// Sample considered for contact generation
-      const Sample* sample_;
-      /// Contact information returned from fcl
-      fcl::Contact contact_;
-      /// heuristic evaluation of the sample
-      double value_;
-      /// normal vector of the surface in contact
-      fcl::Vec3f normal_;
-    };
-
-
-    /// Comparaison operator between Samples
-    /// Used to sort the contact candidates depending
-    /// on their heuristic value
-    struct sample_compare {
-      bool operator() (const OctreeReport& lhs, const OctreeReport& rhs) const{
-          return lhs.value_ > rhs.value_;
-      }
-    };
-
-    typedef std::multiset<OctreeReport, sample_compare> T_OctreeReport;
-
     HPP_PREDEF_CLASS(SampleDB);
 
     typedef std::vector<double> T_Double;
@@ -72,9 +51,22 @@ namespace hpp {
     //typedef double (*evaluate) (const SampleDB& sampleDB, const sampling::Sample& sample);
     typedef boost::function <double (const SampleDB& sampleDB, const sampling::Sample& sample) > evaluate;
     typedef std::map<std::string, evaluate> T_evaluate;
-    //first sample index, number of samples
-    typedef std::pair<std::size_t, std::size_t> VoxelSampleId;
-    typedef std::map<long int, VoxelSampleId> T_VoxelSampleId;
+    /// Defines an evaluation function for a block of consecutive samples of a database.
+    /// Blocks may be evaluated concurrently, so the function must be thread safe.
+    /// \param samples first sample of the block, in SampleDB::samples_
+    /// \param nbSamples number of samples in the block
+    /// \param values output, one value per sample
+    typedef boost::function <void (const SampleDB& sampleDB, const sampling::Sample* samples,
+                                   const std::size_t nbSamples, double* values) > batchEvaluate;
+    typedef std::map<std::string, batchEvaluate> T_BatchEvaluate;
+    /// Called as samples are evaluated, possibly from several threads, but never concurrently.
+    /// \param nbEvaluated number of samples already evaluated
+    /// \param nbSamples total number of samples to evaluate
+    /// \return false to cancel the evaluation
+    typedef boost::function <bool (const std::size_t nbEvaluated, const std::size_t nbSamples) > progress;
+    typedef VoxelIndex T_VoxelSampleId;
+    /// positions in SampleDB::samples_ of the samples of each voxel
+    typedef std::map<long int, std::vector<std::size_t> > T_VoxelSamples;
     typedef std::pair<double, double> ValueBound;
     typedef std::map<std::string, ValueBound> T_ValueBound;
 
@@ -85,8 +77,26 @@ namespace hpp {
     {
     public:
          SampleDB(std::ifstream& databaseStream, bool loadValues = true);
+         /// Loads a database from a binary limb file. The arenas are copied
+         /// from the mapping, which is not referenced by the database.
+         /// \param file mapping of the binary file
+         /// \param offset position of the database block in the file, in bytes
+         /// \param loadValues whether the value columns should be loaded
+         SampleDB(const binary::MappedFilePtr_t& file, const std::size_t offset, bool loadValues = true);
+         /// Loads a subset of the samples of a binary limb file.
+         /// The values keep the normalization of the whole database.
+         /// \param ids positions of the loaded samples in the file. Within a voxel,
+         /// the samples are stored in this order.
+         SampleDB(const binary::MappedFilePtr_t& file, const std::size_t offset, bool loadValues,
+                  const std::vector<std::size_t>& ids);
+         /// Generates a database for a limb
+         /// \param nbThreads number of threads used to generate the samples. 0 uses all available threads
+         /// \param storeJacobians if false, the jacobians of the samples are not stored,
+         /// but computed on demand and kept in a bounded cache (see JacobianCache)
+         /// \param encoding encoding of the sample configurations and effector positions
          SampleDB(const model::JointPtr_t limb, const std::string& effector, const std::size_t nbSamples,
-                  const fcl::Vec3f& offset= fcl::Vec3f(0,0,0), const double resolution = 0.1, const T_evaluate& data = T_evaluate(), const std::string& staticValue ="");
+                  const fcl::Vec3f& offset= fcl::Vec3f(0,0,0), const double resolution = 0.1, const T_evaluate& data = T_evaluate(), const std::string& staticValue ="",
+                  const std::size_t nbThreads = 0, const bool storeJacobians = true, const SampleEncoding encoding = DOUBLE_ENCODING);
         ~SampleDB();
 
     private:
@@ -95,8 +105,11 @@ namespace hpp {
 
     public:
         double resolution_;
+        /// contiguous data of all the samples
+        SampleStoragePtr_t storage_;
+        /// views on storage_, aligned with the octree voxels
         T_Sample samples_;
-        boost::shared_ptr<const octomap::OcTree> octomapTree_;
+        boost::shared_ptr<octomap::OcTree> octomapTree_;
         fcl::OcTree* octree_; // deleted with geometry_
         boost::shared_ptr<fcl::CollisionGeometry> geometry_;
         T_Values values_;
@@ -106,12 +119,153 @@ namespace hpp {
         fcl::CollisionObject treeObject_;
         /// Bounding boxes of areas of interest of the octree
         std::map<std::size_t, fcl::CollisionObject*> boxes_;
+        /// Bounding box of all the occupied voxels, in the octree frame
+        fcl::AABB aabb_;
+        /// Samples appended since the last commit, not yet contiguous in samples_
+        T_VoxelSamples pendingSamplesInVoxels_;
+        /// Evaluation functions registered with addValue, used to evaluate appended samples
+        T_evaluate evaluators_;
+        /// Name of the value used as static value of the samples, empty for the manipulability
+        std::string staticValueName_;
+        /// Set when the database is registered in the DatabaseRegistry. Functions
+        /// modifying the samples or values of a read only database throw.
+        bool readOnly_;
 
 
     }; // class SampleDB
 
-    HPP_RBPRM_DLLAPI SampleDB& addValue(SampleDB& database, const std::string& valueName, const evaluate eval, bool isStaticValue=true, bool sortSamples=true);
+    /// Evaluates a value for all the samples of a database, and normalizes it.
+    /// If samples are pending, sorting is delayed until the next call to commit.
+    /// \param nbThreads number of threads used for the evaluation. 0 uses all available threads.
+    /// eval must be thread safe if nbThreads is not 1.
+    /// \param callback optional progress report. If the evaluation is cancelled, the database is unchanged.
+    HPP_RBPRM_DLLAPI SampleDB& addValue(SampleDB& database, const std::string& valueName, const evaluate eval, bool isStaticValue=true, bool sortSamples=true,
+                                        const std::size_t nbThreads = 1, const progress& callback = progress());
+
+    /// Evaluates a value for all the samples of a database by blocks, and normalizes it.
+    /// Blocks are evaluated in parallel.
+    /// \param nbThreads number of threads used for the evaluation. 0 uses all available threads
+    /// \param callback optional progress report, called after each block
+    /// \return false if the evaluation was cancelled, in which case the database is unchanged
+    HPP_RBPRM_DLLAPI bool addBatchValue(SampleDB& database, const std::string& valueName, const batchEvaluate eval, bool isStaticValue=true, bool sortSamples=true,
+                                        const std::size_t nbThreads = 0, const progress& callback = progress());
+
+    /// Evaluates a block of samples by calling a sample evaluation function on each of them
+    HPP_RBPRM_DLLAPI batchEvaluate MakeBatchEvaluate(const evaluate eval);
+
+    /// Appends samples to a database. The octree and the voxel index are updated
+    /// incrementally, and the samples are evaluated with the values registered
+    /// through addValue. The new samples are immediately available to GetCandidates,
+    /// but are only sorted and stored contiguously with the others after a call to commit.
+    /// \param samples samples of the limb of the database
+    HPP_RBPRM_DLLAPI SampleDB& appendSamples(SampleDB& database, const SampleStorage& samples);
+
+    /// Generates and appends samples to a database, as done by appendSamples.
+    /// \param limb root of the limb of the database
+    /// \param effector name of the effector of the limb
+    /// \param nbSamples number of samples to generate
+    /// \param offset location of the contact point of the effector relatively to the effector joint origin
+    /// \param nbThreads number of threads used to generate the samples. 0 uses all available threads
+    HPP_RBPRM_DLLAPI SampleDB& appendSamples(SampleDB& database, const model::JointPtr_t limb, const std::string& effector,
+                                             const std::size_t nbSamples, const fcl::Vec3f& offset= fcl::Vec3f(0,0,0),
+                                             const std::size_t nbThreads = 0);
+
+    /// Sorts the samples of a database and aligns them with the octree,
+    /// including the samples appended since the last commit.
+    HPP_RBPRM_DLLAPI SampleDB& commit(SampleDB& database);
+
+    /// Converts the samples of a database to another encoding.
+    /// The octree is rebuilt from the encoded effector positions.
+    /// Pending samples must have been committed.
+    HPP_RBPRM_DLLAPI SampleDB& encode(SampleDB& database, const SampleEncoding encoding);
+
+    /// Criterion used to select the samples kept in a voxel by prune
+    enum PruningCriterion
+    {
+        /// keeps the samples with the highest value
+        PRUNE_BY_VALUE = 0,
+        /// keeps the sample with the highest value, then iteratively the sample
+        /// farthest in configuration space from the samples already kept
+        PRUNE_BY_DIVERSITY = 1
+    };
+
+    /// Size of a database before and after prune
+    struct PruningReport
+    {
+        std::size_t nbSamplesBefore_;
+        std::size_t nbSamplesAfter_;
+        /// memory used by the samples and values, in bytes
+        std::size_t memoryBefore_;
+        std::size_t memoryAfter_;
+        std::size_t nbVoxels_;
+        /// largest number of samples in a voxel, ie of candidates returned for a voxel by GetCandidates
+        std::size_t maxCandidatesBefore_;
+        std::size_t maxCandidatesAfter_;
+        /// mean number of samples per voxel
+        double meanCandidatesBefore_;
+        double meanCandidatesAfter_;
+    };
+
+    /// Removes samples from a database, keeping at most maxSamplesPerVoxel samples in each voxel.
+    /// Values keep their normalization, and the octree is unchanged since no voxel is emptied.
+    /// Pending samples must have been committed.
+    /// \param maxSamplesPerVoxel number of samples kept in a voxel, at least 1
+    /// \param criterion how the kept samples are chosen
+    /// \param valueName value used to rank the samples, the static value if empty
+    /// \return the sizes of the database before and after pruning
+    HPP_RBPRM_DLLAPI PruningReport prune(SampleDB& database, const std::size_t maxSamplesPerVoxel,
+                                         const PruningCriterion criterion = PRUNE_BY_VALUE, const std::string& valueName = "");
     HPP_RBPRM_DLLAPI bool saveLimbDatabase(const SampleDB& database, std::ofstream& dbFile);
+    /// Writes a database block in the binary format described in binary-database.hh.
+    /// dbFile must be opened in binary mode. Pending samples must have been committed.
+    HPP_RBPRM_DLLAPI bool saveLimbDatabaseBinary(const SampleDB& database, std::ofstream& dbFile);
+
+    /// Loads a binary limb database by decreasing static value, so that a database
+    /// containing the best samples is available before the whole file is read.
+    /// The following samples are appended to the same database, as done by appendSamples,
+    /// and are sorted with the others once the last ones are loaded.
+    /// The loader modifies the database, and must not be used while it is queried.
+    class HPP_RBPRM_DLLAPI SampleDBLoader
+    {
+    public:
+         /// \param file mapping of the binary file
+         /// \param offset position of the database block in the file, in bytes
+         /// \param loadValues whether the value columns should be loaded
+         /// \param limb root of the limb, used to compute the jacobians of the samples
+         /// if they are not stored in the file
+         /// \param effector name of the effector joint of the limb
+         SampleDBLoader(const binary::MappedFilePtr_t& file, const std::size_t offset, bool loadValues = true,
+                        const model::JointPtr_t& limb = model::JointPtr_t(), const std::string& effector = std::string());
+
+         /// Loads the next best samples of the file.
+         /// \param nbSamples number of samples to load
+         /// \return the database, containing all the samples loaded so far
+         SampleDBPtr_t load(const std::size_t nbSamples);
+
+         /// Loads the remaining samples of the file, and commits the database
+         /// \param chunkSize number of samples loaded between two progress reports
+         /// \param callback optional progress report. If cancelled, the samples loaded so far are committed
+         SampleDBPtr_t loadAll(const std::size_t chunkSize = 10000, const progress& callback = progress());
+
+         /// number of samples loaded
+         std::size_t nbLoaded() const {return next_;}
+         /// number of samples in the file
+         std::size_t size() const {return order_.size();}
+         bool finished() const {return next_ == order_.size();}
+
+    public:
+        const binary::MappedFilePtr_t file_;
+        const std::size_t offset_;
+        const bool loadValues_;
+        const model::JointPtr_t limb_;
+        const std::string effector_;
+        SampleDBPtr_t database_;
+
+    private:
+        /// sample positions in the file, by decreasing static value
+        std::vector<std::size_t> order_;
+        std::size_t next_;
+    }; // class SampleDBLoader
 
     /// Given the current position of a robot, returns a set
     /// of candidate sample configurations for contact generation.
@@ -144,6 +298,26 @@ namespace hpp {
                                             const hpp::model::CollisionObjectPtr_t& o2,
                                             const fcl::Vec3f& direction, T_OctreeReport& report, const heuristic evaluate = 0);
 
+    /// Given the current position of a robot, returns the candidates for contact
+    /// generation with a set of affordance objects, merged in a single set.
+    /// Only the objects intersecting the bounding box of the octree are considered.
+    ///
+    /// \param sc the SampleDB containing all the samples for a given limb
+    /// \param treeTrf the current transformation of the root of the robot
+    /// \param affordances broadphase structure on the affordance objects
+    /// \param direction the current direction of motion, used to evaluate the sample
+    /// heuristically
+    /// \param report set of OctreeReport updated as the samples are explored
+    /// \param evaluate heuristic used to sort candidates
+    /// \param nbThreads number of threads computing the collisions with the objects. 0 uses all available threads.
+    /// The candidates are evaluated by the calling thread, in the order of the objects.
+    /// \param cache if not null, collisions computed for a close root transform are reused, and the cache is updated
+    /// \return true if at least one candidate was found
+    HPP_RBPRM_DLLAPI bool GetCandidates(const SampleDB& sc, const fcl::Transform3f& treeTrf,
+                                        const AffordanceIndex& affordances,
+                                        const fcl::Vec3f& direction, T_OctreeReport& report, const heuristic evaluate = 0,
+                                        const std::size_t nbThreads = 1, CandidateCache* cache = 0);
+
   } // namespace sampling
 } // namespace rbprm
 } // namespace hpp
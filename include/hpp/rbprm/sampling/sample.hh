@@ -24,80 +24,248 @@
 #include <hpp/rbprm/config.hh>
 #include <hpp/model/device.hh>
 
+#include <boost/cstdint.hpp>
+
 #include <deque>
+#include <list>
+#include <map>
+#include <vector>
 namespace hpp {
 
   namespace rbprm {
   namespace sampling{
     HPP_PREDEF_CLASS(Sample);
+    HPP_PREDEF_CLASS(SampleStorage);
+    HPP_PREDEF_CLASS(JacobianCache);
 
     /// Sample configuration for a robot limb, stored
     /// in an octree and used for proximity requests for contact creation.
     /// assumes that joints are compact, ie they all are consecutive in configuration.
     class Sample;
     typedef boost::shared_ptr <Sample> SamplePtr_t;
+    typedef boost::shared_ptr <SampleStorage> SampleStoragePtr_t;
+    typedef boost::shared_ptr <JacobianCache> JacobianCachePtr_t;
 
-    class HPP_RBPRM_DLLAPI Sample
+    /// Computes on demand the jacobians of the samples of a SampleStorage
+    /// that does not store them. The most recently used results are kept
+    /// in a cache of bounded size. Computations are done on a copy of the robot,
+    /// and can be requested concurrently.
+    class HPP_RBPRM_DLLAPI JacobianCache
     {
     public:
-      /// \cond
-      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-      /// \endcond
-
-        /// Creates a sample configuration, given the current configuration of a limb.
-        /// the current Configuration_t of the limb will be used to compute the sample.
         /// \param limb root of the considered limb
-        /// \param effector joint to be considered as the effector of the limb
-        /// \param offset location of the contact point of the effector, relatively to the effector joint
-        /// \param id optional identifier for the sample
-        Sample(const model::JointPtr_t limb, const model::JointPtr_t effector, const fcl::Vec3f& offset = fcl::Vec3f(0,0,0),  const std::size_t id =0);
+        /// \param effector tag identifying the end effector of the limb
+        /// \param capacity maximum number of samples kept in the cache
+        static JacobianCachePtr_t create(const model::JointPtr_t limb, const std::string& effector,
+                                         const std::size_t capacity = 4096);
 
+        /// Computes, or retrieves from the cache, the jacobian of a sample and its product by its transpose
+        void get(const SampleStorage& storage, const std::size_t id,
+                 Eigen::MatrixXd& jacobian, Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct);
+        /// Same as above, only copying the product of the jacobian by its transpose
+        void get(const SampleStorage& storage, const std::size_t id,
+                 Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct);
 
-        Sample(const std::size_t id, const std::size_t length, const std::size_t startRank, const double staticValue,
-               const fcl::Vec3f& effectorPosition, const model::ConfigurationIn_t configuration, const Eigen::MatrixXd& jacobian,
-               const Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct);
+        std::size_t capacity() const {return capacity_;}
+        void capacity(const std::size_t capacity);
+        std::size_t size() const {return entries_.size();}
+        /// Empties the cache. Must be called whenever the ids of the samples change.
+        void clear();
 
-        /// Creates sample configuration for a limb, extracted from a complete robot configuration, passed as a parameter
-        /// \param limb root of the considered limb
-        /// \param the configuration from which the limb sample will be extracted
-        /// \param effector joint to be considered as the effector of the limb
-        /// \param offset location of the contact point of the effector, relatively to the effector joint
-        /// \param id optional identifier for the sample
-        Sample(const model::JointPtr_t limb, const model::JointPtr_t effector, model::ConfigurationIn_t configuration, const fcl::Vec3f& offset = fcl::Vec3f(0,0,0), const std::size_t id =0);
-        Sample(const Sample &clone);
-       ~Sample(){}
+    private:
+        JacobianCache(const model::JointPtr_t limb, const std::string& effector, const std::size_t capacity);
+
+        struct Entry
+        {
+            Eigen::MatrixXd jacobian_;
+            Eigen::Matrix <model::value_type, 6, 6, Eigen::DontAlign> jacobianProduct_;
+            std::list<std::size_t>::iterator lru_;
+        };
+        typedef std::map<std::size_t, Entry> T_Entry;
+
+    private:
+        model::DevicePtr_t device_;
+        model::JointPtr_t limb_;
+        model::JointPtr_t effector_;
+        model::Configuration_t config_;
+        std::size_t capacity_;
+        T_Entry entries_;
+        /// sample ids, most recently used first
+        std::list<std::size_t> lru_;
+    }; // class JacobianCache
+
+    /// Encoding of the configurations and effector positions in a SampleStorage.
+    /// Compact encodings trade precision for memory, and are decoded
+    /// when a sample is loaded.
+    enum SampleEncoding
+    {
+        DOUBLE_ENCODING  = 0, // full precision
+        FLOAT_ENCODING   = 1, // configurations and effector positions stored as float
+        FIXED16_ENCODING = 2  // configurations stored as 16 bits fixed-point values normalized to
+                              // the range of each dof, effector positions stored as float
+    };
+
+    /// Contiguous storage for the data of a set of samples of a same limb.
+    /// Each attribute is stored in its own column arena, the data of
+    /// sample i being found at index i * stride of each arena.
+    /// The jacobian arenas are optional: when they are not stored, the
+    /// jacobians are computed on demand by a JacobianCache.
+    /// Only the arenas corresponding to the current encoding are filled.
+    class HPP_RBPRM_DLLAPI SampleStorage
+    {
+    public:
+        /// \param length configuration size of a sample
+        /// \param startRank rank of the limb in the robot configuration
+        /// \param jacobianCols number of columns of the jacobian of a sample
+        /// \param storeJacobians if false, only the configurations and effector positions are stored,
+        /// and a jacobianCache_ must be provided to access the jacobians
+        SampleStorage(const std::size_t length, const std::size_t startRank, const std::size_t jacobianCols,
+                      const bool storeJacobians = true);
+
+        std::size_t size() const {return staticValues_.size();}
+        void reserve(const std::size_t nbSamples);
+        void resize(const std::size_t nbSamples);
+        /// \return the size of the sample data, in bytes
+        std::size_t memory() const;
+
+        /// Appends the data of a sample to the arenas
+        /// \return the id of the new sample
+        std::size_t add(const double staticValue, const fcl::Vec3f& effectorPosition, model::ConfigurationIn_t configuration,
+                        const Eigen::MatrixXd& jacobian, const Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct);
+
+        /// Writes the data of an existing sample. Samples with different ids
+        /// can be written concurrently. The jacobians are ignored if they are not stored.
+        void set(const std::size_t id, const double staticValue, const fcl::Vec3f& effectorPosition, model::ConfigurationIn_t configuration,
+                 const Eigen::MatrixXd& jacobian, const Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct);
+
+        /// Appends all the samples of another storage of the same limb
+        void append(const SampleStorage& other);
+
+        /// Reorders the arenas, such that the new sample i is the previous sample order[i]
+        void permute(const std::vector<std::size_t>& order);
+
+        /// Converts the stored samples to another encoding. When converting to FIXED16_ENCODING,
+        /// the range of each dof is computed from the stored values.
+        void encode(const SampleEncoding encoding);
+
+        /// Decodes the configuration of a sample
+        void configuration(const std::size_t id, model::ConfigurationOut_t configuration) const;
+
+        fcl::Vec3f effectorPosition(const std::size_t id) const
+        {
+            if(encoding_ == DOUBLE_ENCODING)
+            {
+                const double* position = &effectorPositions_[3 * id];
+                return fcl::Vec3f(position[0], position[1], position[2]);
+            }
+            const float* position = &compactEffectorPositions_[3 * id];
+            return fcl::Vec3f(position[0], position[1], position[2]);
+        }
+
+    public:
+        std::size_t length_;
+        std::size_t startRank_;
+        std::size_t jacobianCols_;
+        bool storeJacobians_;
+        SampleEncoding encoding_;
+        std::vector<double> staticValues_;
+        /// effector positions relative to robot root, 3 values per sample
+        std::vector<double> effectorPositions_;
+        /// effector positions for compact encodings
+        std::vector<float> compactEffectorPositions_;
+        /// length_ values per sample
+        std::vector<double> configurations_;
+        /// configurations for FLOAT_ENCODING
+        std::vector<float> floatConfigurations_;
+        /// configurations for FIXED16_ENCODING, 0 and 65535 corresponding to
+        /// the lower and upper bounds of each dof
+        std::vector<boost::uint16_t> fixedConfigurations_;
+        /// range of each dof for FIXED16_ENCODING, length_ values each
+        std::vector<double> lowerBounds_;
+        std::vector<double> upperBounds_;
+        /// 6 x jacobianCols_ values per sample, column major
+        std::vector<double> jacobians_;
+        /// Product of each jacobian by its transpose, 6 x 6 values per sample, column major
+        std::vector<double> jacobianProducts_;
+        /// Used when jacobians are not stored
+        JacobianCachePtr_t jacobianCache_;
+    }; // class SampleStorage
+
+    /// Lightweight view on a sample of a SampleStorage.
+    class HPP_RBPRM_DLLAPI Sample
+    {
+    public:
+        /// \param storage storage containing the sample data
+        /// \param id index of the sample in the storage
+        Sample(const SampleStoragePtr_t& storage, const std::size_t id);
 
     public:
-      std::size_t startRank_;
-      std::size_t length_;
-      model::Configuration_t configuration_;
-      /// Position relative to robot root (ie, robot base at 0 everywhere)
-      fcl::Vec3f effectorPosition_;
-      Eigen::MatrixXd jacobian_;
-      /// Product of the jacobian by its transpose
-      Eigen::Matrix <model::value_type, 6, 6> jacobianProduct_;
-      /// id in sample container
-      std::size_t id_;
-      double staticValue_;
-      //const fcl::Transform3f rotation_; TODO
+        std::size_t startRank() const {return storage_->startRank_;}
+        std::size_t length() const {return storage_->length_;}
+        double staticValue() const {return storage_->staticValues_[id_];}
+        /// Position relative to robot root (ie, robot base at 0 everywhere)
+        fcl::Vec3f effectorPosition() const {return storage_->effectorPosition(id_);}
+        /// Decoded limb configuration. Use Load to avoid the copy.
+        model::Configuration_t configuration() const;
+        /// Decodes the limb configuration without allocation
+        /// \param configuration vector of size length()
+        void configuration(model::ConfigurationOut_t configuration) const;
+        /// Read from the storage, or computed by its JacobianCache.
+        /// Throws if the jacobians are not stored and no JacobianCache is set
+        Eigen::MatrixXd jacobian() const;
+        /// Product of the jacobian by its transpose
+        Eigen::Matrix <model::value_type, 6, 6> jacobianProduct() const;
+        /// Copies the product of the jacobian by its transpose without allocation.
+        /// When jacobians are not stored, only the product is read from the JacobianCache.
+        void jacobianProduct(Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct) const;
+
+    public:
+        SampleStoragePtr_t storage_;
+        /// id in sample storage
+        std::size_t id_;
+        //const fcl::Transform3f rotation_; TODO
     }; // class Sample
 
     struct sample_greater {
         bool operator() (const Sample& lhs, const Sample& rhs) const{
-            return lhs.staticValue_ > rhs.staticValue_;
+            return lhs.staticValue() > rhs.staticValue();
         }
     };
 
-    typedef std::vector<Sample, Eigen::aligned_allocator<Sample> > SampleVector_t;
+    typedef std::vector<Sample> SampleVector_t;
+
+/// Creates a view for each sample of a storage, ordered by id
+SampleVector_t CreateSamples(const SampleStoragePtr_t& storage);
+
+/// Automatically generates the samples of a given limb of a robot, stored contiguously.
+/// Samples are computed in parallel, each thread working on its own copy of the robot.
+/// The random values of a sample only depend on the seed and on the sample index,
+/// so that the result does not depend on the number of threads.
+    /// \param limb root of the considered limb
+    /// \param effector tag identifying the end effector of the limb
+    /// \param nbSamples number of samples to be generated
+    /// \param offset location of the contact point of the effector relatively to the effector joint origin
+    /// \param nbThreads number of threads used for the generation. 0 uses all available threads
+    /// \param seed seed of the random generator
+    /// \param storeJacobians if false, jacobians are not stored and are computed on demand by a JacobianCache
+    /// \param encoding encoding of the stored configurations and effector positions
+    /// \return a storage of sample configurations respecting joint limits.
+SampleStoragePtr_t GenerateSampleStorage(const model::JointPtr_t limb,  const std::string& effector,  const std::size_t nbSamples,const fcl::Vec3f& offset = fcl::Vec3f(0,0,0),
+                                         const std::size_t nbThreads = 0, const std::size_t seed = 0, const bool storeJacobians = true,
+                                         const SampleEncoding encoding = DOUBLE_ENCODING);
+
 /// Automatically generates a deque of sample configuration for a given limb of a robot
     /// \param limb root of the considered limb
     /// \param effector tag identifying the end effector of the limb
     /// \param nbSamples number of samples to be generated
     /// \param offset location of the contact point of the effector relatively to the effector joint origin
+    /// \param nbThreads number of threads used for the generation. 0 uses all available threads
     /// \return a deque of sample configurations respecting joint limits.
-SampleVector_t GenerateSamples(const model::JointPtr_t limb,  const std::string& effector,  const std::size_t nbSamples,const fcl::Vec3f& offset = fcl::Vec3f(0,0,0));
+SampleVector_t GenerateSamples(const model::JointPtr_t limb,  const std::string& effector,  const std::size_t nbSamples,const fcl::Vec3f& offset = fcl::Vec3f(0,0,0),
+                               const std::size_t nbThreads = 0);
 
-/// Assigns the limb configuration associated with a sample to a robot configuration
+/// Assigns the limb configuration associated with a sample to a robot configuration,
+/// decoding it to full precision.
 /// \param sample The limb configuration to load
 /// \param robot the configuration to be modified
 void Load(const Sample& sample, model::ConfigurationOut_t robot);
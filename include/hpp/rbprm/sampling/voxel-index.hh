@@ -0,0 +1,94 @@
+//
+// Copyright (c) 2014 CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-core  If not, see
+// <http://www.gnu.org/licenses/>.
+
+#ifndef HPP_RBPRM_VOXEL_INDEX_HH
+# define HPP_RBPRM_VOXEL_INDEX_HH
+
+#include <hpp/rbprm/config.hh>
+
+#include <boost/cstdint.hpp>
+
+#include <vector>
+#include <limits>
+
+namespace hpp {
+
+  namespace rbprm {
+  namespace sampling{
+
+    //first sample index, number of samples
+    typedef std::pair<std::size_t, std::size_t> VoxelSampleId;
+
+    /// Index associating an octree leaf, identified by the id returned by fcl
+    /// in collision contacts, to the range of samples it contains.
+    /// Voxels are stored densely, in insertion order, and retrieved
+    /// with an open addressing hash table.
+    class HPP_RBPRM_DLLAPI VoxelIndex
+    {
+    public:
+        static const std::size_t NOT_FOUND;
+
+    public:
+        VoxelIndex();
+
+        /// number of voxels in the index
+        std::size_t size() const {return voxels_.size();}
+        bool empty() const {return voxels_.empty();}
+        void clear();
+        void reserve(const std::size_t nbVoxels);
+
+        /// Adds a voxel to the index.
+        /// \return false if the voxel was already present, in which case the index is unchanged
+        bool insert(const long int voxel, const VoxelSampleId& samples);
+
+        /// \return the dense position of a voxel in the index, or NOT_FOUND
+        std::size_t find(const long int voxel) const
+        {
+            if(table_.empty())
+                return NOT_FOUND;
+            for(std::size_t bucket = hash(voxel);; bucket = (bucket + 1) & mask_)
+            {
+                const std::size_t slot = table_[bucket];
+                if(slot == NOT_FOUND || voxels_[slot] == voxel)
+                    return slot;
+            }
+        }
+
+        long int voxel(const std::size_t slot) const {return voxels_[slot];}
+        const VoxelSampleId& samples(const std::size_t slot) const {return samples_[slot];}
+        void update(const std::size_t slot, const VoxelSampleId& samples) {samples_[slot] = samples;}
+
+    private:
+        std::size_t hash(const long int voxel) const
+        {
+            return (std::size_t)(((boost::uint64_t)voxel * 0x9E3779B97F4A7C15ULL) >> 32) & mask_;
+        }
+        void rehash(const std::size_t capacity);
+
+    private:
+        std::vector<long int> voxels_;
+        std::vector<VoxelSampleId> samples_;
+        /// buckets, containing a position in voxels_, or NOT_FOUND
+        std::vector<std::size_t> table_;
+        std::size_t mask_;
+    }; // class VoxelIndex
+
+  } // namespace sampling
+} // namespace rbprm
+} // namespace hpp
+#endif // HPP_RBPRM_VOXEL_INDEX_HH
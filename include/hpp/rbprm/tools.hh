@@ -47,7 +47,9 @@ namespace hpp {
   /// \param spared Name of the root of the unlocked kinematic chain
   /// \param joint Root of the considered kinematic chain to block
   /// \param projector Projector on which to block the joints
-  void LockJointRec(const std::string& spared, const model::JointPtr_t joint, core::ConfigProjectorPtr_t& projector);
+  /// \param constant if false, joint lock constraints can be updated with rightHandSide method
+  void LockJointRec(const std::string& spared, const model::JointPtr_t joint, core::ConfigProjectorPtr_t& projector,
+                    const bool constant=true);
 
   ///Lock all joints in a kinematic chain, except for a list of subchains
   /// \param spared names of the root of the unlocked kinematic chains
@@ -0,0 +1,100 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/affordance-table.hh>
+#include <hpp/util/debug.hh>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace hpp {
+  namespace rbprm {
+
+    AffordanceTable::AffordanceTable()
+        : compilations_(0)
+    {
+        // NOTHING
+    }
+
+    bool AffordanceTable::matches(const affMap_t& affordances, const T_AffordanceFilters& affFilters) const
+    {
+        // only compares object pointers and filter names
+        return !empty() && affordances_ == affordances && affFilters_ == affFilters;
+    }
+
+    void AffordanceTable::compile(const T_Limb& limbs, const affMap_t& affordances, const T_AffordanceFilters& affFilters)
+    {
+        clear();
+        affordances_ = affordances;
+        affFilters_ = affFilters;
+        limbs_.reserve(limbs.size());
+        objects_.resize(limbs.size());
+        std::size_t limbIndex = 0;
+        for(T_Limb::const_iterator lit = limbs.begin(); lit != limbs.end(); ++lit, ++limbIndex)
+        {
+            const std::string& limb = lit->first;
+            limbs_.push_back(limb);
+            model::ObjectVector_t& affs = objects_[limbIndex];
+            T_AffordanceFilters::const_iterator fIt = affFilters.begin();
+            for(; fIt != affFilters.end() && fIt->first.find(limb) == std::string::npos; ++fIt);
+            if(fIt == affFilters.end())
+            {
+                hppDout (warning, "No affordance filter setting found for limb " << limb
+                         << ". Has such filter been set?");
+                // Use all AFF OBJECTS as default if no filter setting exists
+                for(affMap_t::const_iterator affIt = affordances.begin(); affIt != affordances.end(); ++affIt)
+                    affs.insert(affs.end(), affIt->second.begin(), affIt->second.end());
+            }
+            else
+            {
+                for(std::vector<std::string>::const_iterator affTypeIt = fIt->second.begin();
+                    affTypeIt != fIt->second.end(); ++affTypeIt)
+                {
+                    affMap_t::const_iterator affIt = affordances.find(*affTypeIt);
+                    if(affIt != affordances.end())
+                        affs.insert(affs.end(), affIt->second.begin(), affIt->second.end());
+                }
+            }
+        }
+        ++compilations_;
+    }
+
+    void AffordanceTable::clear()
+    {
+        affordances_.clear();
+        affFilters_.clear();
+        limbs_.clear();
+        objects_.clear();
+    }
+
+    std::size_t AffordanceTable::index(const std::string& limb) const
+    {
+        // limbs_ is sorted, as the T_Limb it was compiled from
+        std::vector<std::string>::const_iterator it = std::lower_bound(limbs_.begin(), limbs_.end(), limb);
+        if(it == limbs_.end() || *it != limb)
+            throw std::runtime_error ("No aff objects found for limb " + limb);
+        return it - limbs_.begin();
+    }
+
+    const model::ObjectVector_t& AffordanceTable::objects(const std::size_t limbIndex) const
+    {
+        const model::ObjectVector_t& res = objects_.at(limbIndex);
+        if(res.empty())
+            throw std::runtime_error ("No aff objects found for limb " + limbs_[limbIndex]);
+        return res;
+    }
+  } // namespace rbprm
+} // namespace hpp
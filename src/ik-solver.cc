@@ -1,114 +1,138 @@
-
-#include "hpp/rbprm/ik-solver.hh"
-#include "hpp/model/joint.hh"
-
-#include <vector>
-#include <iostream>
-#include <Eigen/Dense>
-
-using namespace Eigen;
-using namespace std;
-using namespace hpp;
-using namespace hpp::model;
-using namespace hpp::rbprm;
-
-namespace
-{
-    typedef Eigen::Matrix<double, 6, 1> error_vec_t;
-    typedef Eigen::Ref<error_vec_t>         error_vec_ref_t;
-    typedef Eigen::Ref<const error_vec_t>   error_vec_cref_t;
-    const fcl::Transform3f I4;
-
-    matrix_t ComputeJacobian(RbPrmLimb& limb, const ConfigurationIn_t config)
-    {
-        limb.limb_->robot()->currentConfiguration (config);
-        limb.limb_->computeJacobian();
-        return limb.effector_->jacobian().block(0,limb.limb_->rankInVelocity()-1,6, limb.effector_->rankInVelocity() - limb.limb_->rankInVelocity()+1);
-    }
-
-    void ComputeJacobian(RbPrmLimb& limb, const ConfigurationIn_t config, matrixOut_t jac)
-    {
-        limb.limb_->robot()->currentConfiguration (config);
-        limb.limb_->computeJacobian();
-        jac = limb.effector_->jacobian().block(0,limb.limb_->rankInVelocity()-1,6, limb.effector_->rankInVelocity() - limb.limb_->rankInVelocity()+1);
-    }
-
-    void UpdateTransforms(RbPrmLimb& limb)
-    {
-        limb.limb_->recursiveComputePosition(limb.limb_->robot()->currentConfiguration (), I4);
-    }
-
-    void error(RbPrmLimb& limb, const fcl::Vec3f& target, const fcl::Matrix3f& rotationTarget, fcl::Matrix3f& Rerror_, double& tr,
-               double& theta, error_vec_ref_t error)
-    {
-        const Transform3f& M = limb.effector_->currentTransformation ();
-
-        // translation error
-        const fcl::Vec3f& p = M.getTranslation();
-        for(std::size_t i =0; i <3; ++i)
-            error(i) = target[i] - p[i];
-
-        //orientation error
-        Rerror_ = M.getRotation(); Rerror_.transpose();
-        Rerror_ = Rerror_ * rotationTarget;
-        tr = Rerror_ (0, 0) + Rerror_ (1, 1) + Rerror_ (2, 2);
-        if (tr > 3) tr = 3;
-        if (tr < -1) tr = -1;
-        theta = acos ((tr - 1)/2);
-        if (theta > 1e-6)
-        {
-            theta /= (2*sin(theta));
-            error[3] = theta*(Rerror_ (2, 1) - Rerror_ (1, 2));
-            error[4] = theta*(Rerror_ (0, 2) - Rerror_ (2, 0));
-            error[5] = theta*(Rerror_ (1, 0) - Rerror_ (0, 1));
-        }
-        else
-        {
-            error[3] = (Rerror_ (2, 1) - Rerror_ (1, 2))/2;
-            error[4] = (Rerror_ (0, 2) - Rerror_ (2, 0))/2;
-            error[5] = (Rerror_ (1, 0) - Rerror_ (0, 1))/2;
-        }
-    }
-
-    void error(RbPrmLimb& limb, const fcl::Vec3f& target, ik::Vector3dRef error)
-    {
-        const Transform3f& M = limb.effector_->currentTransformation ();
-        // translation error
-        const fcl::Vec3f& p = M.getTranslation();
-        for(std::size_t i =0; i <3; ++i)
-            error(i) = target[i] - p[i];
-    }
-}
-
-
-bool ik::apply(RbPrmLimb& limb, const fcl::Vec3f& target, const fcl::Matrix3f& targetRotation, model::ConfigurationOut_t configuration)
-{
-    std::size_t start = limb.limb_->rankInConfiguration();
-    std::size_t end = limb.effector_->rankInConfiguration()+ limb.effector_->neutralConfiguration().rows();
-    std::size_t length = end - start;
-    Configuration_t config = limb.limb_->robot()->currentConfiguration().segment(start, length);
-    matrix_t jacobian = ComputeJacobian(limb,configuration);
-    matrix_t jacobianProd = jacobian.transpose() * jacobian;
-    UpdateTransforms(limb);
-    //const matrix_t id = Eigen::MatrixXd::Identity(jacobianProd.cols(),jacobianProd.cols());
-    fcl::Matrix3f errormatrix;
-    double tr, theta;
-    const double lambda = 0.01;
-    error_vec_t err;
-    for(int i = 0; i< 10; ++i)
-    {
-
-        error(limb, target, targetRotation,errormatrix,tr,theta,err);
-        std::cout << "config " << std::endl << config << std::endl;
-        std::cout << "jacobianProd " << std::endl << jacobianProd << std::endl;
-        std::cout << "err " << std::endl << err << std::endl;
-        std::cout << "solving " << std::endl << jacobianProd.llt().solve(jacobian.transpose()) << std::endl;
-        std::cout << "solving " << std::endl << jacobianProd.llt().solve(jacobian.transpose()) << std::endl;
-        config += lambda * jacobianProd.llt().solve(jacobian.transpose()) * err;
-        configuration.segment(start, length) = config;
-        ComputeJacobian(limb, configuration, jacobian);
-        jacobianProd = jacobian.transpose() * jacobian;
-        UpdateTransforms(limb);
-    }
-    return err.norm() <= 1e-6;
-}
+#include "hpp/rbprm/ik-solver.hh"
+#include "hpp/model/joint.hh"
+#include "hpp/model/device.hh"
+#include "hpp/model/configuration.hh"
+
+#include <vector>
+#include <limits>
+#include <Eigen/Dense>
+
+using namespace Eigen;
+using namespace std;
+using namespace hpp;
+using namespace hpp::model;
+using namespace hpp::rbprm;
+
+namespace
+{
+    typedef Eigen::Matrix<double, 6, 1> error_vec_t;
+    typedef Eigen::Ref<error_vec_t>         error_vec_ref_t;
+    const double damping = 1e-2;
+
+    // position error, and orientation error in the world frame
+    void error(const JointPtr_t& effector, const fcl::Vec3f& target, const fcl::Matrix3f& rotationTarget,
+               const bool orientation, error_vec_ref_t error)
+    {
+        const Transform3f& M = effector->currentTransformation ();
+
+        // translation error
+        const fcl::Vec3f& p = M.getTranslation();
+        for(std::size_t i =0; i <3; ++i)
+            error(i) = target[i] - p[i];
+        if(!orientation)
+        {
+            error.tail<3>().setZero();
+            return;
+        }
+
+        //orientation error, in the effector frame
+        fcl::Matrix3f Rerror_ = M.getRotation(); Rerror_.transpose();
+        Rerror_ = Rerror_ * rotationTarget;
+        double tr = Rerror_ (0, 0) + Rerror_ (1, 1) + Rerror_ (2, 2);
+        if (tr > 3) tr = 3;
+        if (tr < -1) tr = -1;
+        double theta = acos ((tr - 1)/2);
+        fcl::Vec3f local;
+        if (theta > 1e-6)
+        {
+            theta /= (2*sin(theta));
+            local[0] = theta*(Rerror_ (2, 1) - Rerror_ (1, 2));
+            local[1] = theta*(Rerror_ (0, 2) - Rerror_ (2, 0));
+            local[2] = theta*(Rerror_ (1, 0) - Rerror_ (0, 1));
+        }
+        else
+        {
+            local[0] = (Rerror_ (2, 1) - Rerror_ (1, 2))/2;
+            local[1] = (Rerror_ (0, 2) - Rerror_ (2, 0))/2;
+            local[2] = (Rerror_ (1, 0) - Rerror_ (0, 1))/2;
+        }
+        const fcl::Vec3f world = M.getRotation() * local;
+        for(std::size_t i =0; i <3; ++i)
+            error(3+i) = world[i];
+    }
+
+    template<int Dof>
+    ik::IKReport solve(const DevicePtr_t& device, const JointPtr_t& effector, const size_type firstDof, const size_type nbDof,
+                       ConfigurationOut_t configuration, const fcl::Vec3f& positionTarget, const fcl::Matrix3f& rotationTarget,
+                       const bool orientation, const error_vec_t& mask, const double tolerance, const std::size_t maxIterations)
+    {
+        typedef Eigen::Matrix<double, 6, Dof> jacobian_t;
+        typedef Eigen::Matrix<double, Dof, 1> step_t;
+        jacobian_t jacobian; jacobian.resize(6, nbDof);
+        step_t step; step.resize(nbDof);
+        Eigen::Matrix<double, 6, 6> jjt;
+        error_vec_t err;
+        vector_t velocity = vector_t::Zero(device->numberDof());
+        Configuration_t next(configuration.rows());
+        ik::IKReport report;
+        report.success_ = false;
+        report.nbIterations_ = 0;
+        report.error_ = std::numeric_limits<double>::max();
+        for(;;)
+        {
+            device->currentConfiguration(configuration);
+            device->computeForwardKinematics();
+            error(effector, positionTarget, rotationTarget, orientation, err);
+            err = err.cwiseProduct(mask);
+            report.error_ = err.norm();
+            if(report.error_ <= tolerance)
+            {
+                report.success_ = true;
+                return report;
+            }
+            if(report.nbIterations_ >= maxIterations)
+                return report;
+            // unconstrained rows are zeroed, the damping keeps jjt invertible
+            jacobian = mask.asDiagonal() * effector->jacobian().block(0, firstDof, 6, nbDof);
+            jjt = jacobian * jacobian.transpose();
+            jjt.diagonal().array() += damping * damping;
+            step = jacobian.transpose() * jjt.ldlt().solve(err);
+            velocity.segment(firstDof, nbDof) = step;
+            integrate(device, configuration, velocity, next);
+            configuration = next;
+            ++report.nbIterations_;
+        }
+    }
+}
+
+ik::IKReport ik::apply(const DevicePtr_t& device, const RbPrmLimb& limb, ConfigurationOut_t configuration,
+                       const fcl::Vec3f& positionTarget, const fcl::Matrix3f& rotationTarget,
+                       const std::vector<bool>& rotationFilter, const double tolerance, const std::size_t maxIterations)
+{
+    const JointPtr_t limbRoot = device->getJointByName(limb.limb_->name());
+    const JointPtr_t effector = device->getJointByName(limb.effector_->name());
+    // the dofs of a limb are contiguous, from its root to its effector
+    const size_type firstDof = limbRoot->rankInVelocity();
+    const size_type nbDof = effector->rankInVelocity() + effector->numberDof() - firstDof;
+    const bool orientation = limb.contactType_ == _6_DOF;
+    error_vec_t mask = error_vec_t::Ones();
+    for(std::size_t i = 0; i < 3; ++i)
+        mask(3+i) = orientation && rotationFilter[i] ? 1. : 0.;
+    // the jacobians are needed
+    const Device::Computation_t flag = device->computationFlag ();
+    device->controlComputation (static_cast <Device::Computation_t> (flag | Device::JACOBIAN));
+    ik::IKReport report;
+    switch(nbDof)
+    {
+        case 1: report = solve<1>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        case 2: report = solve<2>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        case 3: report = solve<3>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        case 4: report = solve<4>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        case 5: report = solve<5>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        case 6: report = solve<6>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        case 7: report = solve<7>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations); break;
+        default: report = solve<Eigen::Dynamic>(device, effector, firstDof, nbDof, configuration, positionTarget, rotationTarget, orientation, mask, tolerance, maxIterations);
+    }
+    device->controlComputation (flag);
+    return report;
+}
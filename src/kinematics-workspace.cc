@@ -0,0 +1,114 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/kinematics-workspace.hh>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace hpp {
+  namespace rbprm {
+
+    KinematicsLockPtr_t KinematicsLock::create()
+    {
+        return KinematicsLockPtr_t(new KinematicsLock());
+    }
+
+    KinematicsLock::KinematicsLock()
+        : lock_(0)
+    {
+#ifdef _OPENMP
+        omp_nest_lock_t* lock = new omp_nest_lock_t;
+        omp_init_nest_lock(lock);
+        lock_ = lock;
+#endif
+    }
+
+    KinematicsLock::~KinematicsLock()
+    {
+#ifdef _OPENMP
+        omp_nest_lock_t* lock = static_cast<omp_nest_lock_t*>(lock_);
+        omp_destroy_nest_lock(lock);
+        delete lock;
+#endif
+    }
+
+    void KinematicsLock::lock()
+    {
+#ifdef _OPENMP
+        omp_set_nest_lock(static_cast<omp_nest_lock_t*>(lock_));
+#endif
+    }
+
+    void KinematicsLock::unlock()
+    {
+#ifdef _OPENMP
+        omp_unset_nest_lock(static_cast<omp_nest_lock_t*>(lock_));
+#endif
+    }
+
+    namespace
+    {
+        // locks before the device state is saved
+        const model::DevicePtr_t& lockDevice(const model::DevicePtr_t& device, const KinematicsLockPtr_t& lock)
+        {
+            lock->lock();
+            return device;
+        }
+    }
+
+    KinematicsWorkspace::KinematicsWorkspace(const model::DevicePtr_t& device, const KinematicsLockPtr_t& lock)
+        : device_(lockDevice(device, lock))
+        , lock_(lock)
+        , saved_(device->currentConfiguration())
+        , flag_(device->computationFlag())
+        , modified_(false)
+    {
+        // NOTHING
+    }
+
+    KinematicsWorkspace::KinematicsWorkspace(const model::DevicePtr_t& device, const KinematicsLockPtr_t& lock,
+                                             const model::Device::Computation_t flag)
+        : device_(lockDevice(device, lock))
+        , lock_(lock)
+        , saved_(device->currentConfiguration())
+        , flag_(device->computationFlag())
+        , modified_(false)
+    {
+        device_->controlComputation(flag);
+    }
+
+    KinematicsWorkspace::~KinematicsWorkspace()
+    {
+        device_->controlComputation(flag_);
+        // the configuration can also have been changed without the workspace
+        if(modified_ || device_->currentConfiguration() != saved_)
+        {
+            device_->currentConfiguration(saved_);
+            device_->computeForwardKinematics();
+        }
+        lock_->unlock();
+    }
+
+    void KinematicsWorkspace::configuration(model::ConfigurationIn_t configuration)
+    {
+        device_->currentConfiguration(configuration);
+        device_->computeForwardKinematics();
+        modified_ = true;
+    }
+  } // rbprm
+} //hpp
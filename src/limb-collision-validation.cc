@@ -0,0 +1,182 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/limb-collision-validation.hh>
+#include <hpp/model/device.hh>
+#include <hpp/model/joint.hh>
+#include <hpp/model/body.hh>
+#include <hpp/model/collision-object.hh>
+#include <hpp/core/collision-validation-report.hh>
+#include <hpp/fcl/collision.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace hpp {
+  using namespace core;
+  namespace rbprm {
+
+    namespace
+    {
+        void GetJointsRec(const model::JointPtr_t& joint, model::JointVector_t& joints, std::size_t& endRank)
+        {
+            joints.push_back(joint);
+            endRank = std::max(endRank, (std::size_t)(joint->rankInConfiguration() + joint->configSize()));
+            for(std::size_t i = 0; i < joint->numberChildJoints(); ++i)
+                GetJointsRec(joint->childJoint(i), joints, endRank);
+        }
+    }
+
+    LimbCollisionValidationPtr_t LimbCollisionValidation::create
+    (const model::DevicePtr_t& robot, const model::JointPtr_t& limb)
+    {
+      LimbCollisionValidation* ptr = new LimbCollisionValidation (robot, limb);
+      return LimbCollisionValidationPtr_t (ptr);
+    }
+
+    LimbCollisionValidation::LimbCollisionValidation (const model::DevicePtr_t& robot,
+                                                      const model::JointPtr_t& limb)
+        : hpp::core::CollisionValidation(robot)
+        , limb_(limb)
+        , robot_(robot)
+        , startRank_(limb->rankInConfiguration())
+        , endRank_(startRank_)
+        , collisionRequest_(1, false, 1, false)
+        , unusedReport_(new CollisionValidationReport)
+    {
+        if(!limb->parentJoint())
+            throw std::runtime_error ("Impossible to create limb collision validation; "
+                                      "the limb can not be the root of the robot");
+        GetJointsRec(limb, joints_, endRank_);
+        jointSet_.insert(joints_.begin(), joints_.end());
+        // auto collision pairs involving the limb
+        const model::CollisionPairs_t& pairs = robot->collisionPairs(model::COLLISION);
+        for(model::CollisionPairs_t::const_iterator cit = pairs.begin(); cit != pairs.end(); ++cit)
+        {
+            if(jointSet_.find(cit->first->joint()) != jointSet_.end())
+                addCollisionPair(cit->first->joint(), cit->first, cit->second);
+            else if(jointSet_.find(cit->second->joint()) != jointSet_.end())
+                addCollisionPair(cit->second->joint(), cit->second, cit->first);
+        }
+    }
+
+    void LimbCollisionValidation::addCollisionPair(const model::JointPtr_t& joint, const model::CollisionObjectPtr_t& object1,
+                                                   const model::CollisionObjectPtr_t& object2)
+    {
+        CollisionPair pair;
+        pair.joint_ = joint;
+        pair.object1_ = object1;
+        pair.object2_ = object2;
+        collisionPairs_.push_back(pair);
+    }
+
+    void LimbCollisionValidation::addObstacle (const model::CollisionObjectPtr_t& object)
+    {
+        hpp::core::CollisionValidation::addObstacle(object);
+        obstacles_.push_back(object);
+        for(model::JointVector_t::const_iterator jit = joints_.begin(); jit != joints_.end(); ++jit)
+        {
+            model::BodyPtr_t body = (*jit)->linkedBody();
+            if(!body) continue;
+            const model::ObjectVector_t& objects = body->innerObjects(model::COLLISION);
+            for(model::ObjectVector_t::const_iterator oit = objects.begin(); oit != objects.end(); ++oit)
+                addCollisionPair(*jit, *oit, object);
+        }
+    }
+
+    void LimbCollisionValidation::removeObstacleFromJoint (const model::JointPtr_t& joint,
+                                                           const model::CollisionObjectPtr_t& obstacle)
+    {
+        hpp::core::CollisionValidation::removeObstacleFromJoint(joint, obstacle);
+        for(T_CollisionPair::iterator it = collisionPairs_.begin(); it != collisionPairs_.end();)
+        {
+            if(it->joint_ == joint && it->object2_ == obstacle)
+                it = collisionPairs_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    void LimbCollisionValidation::filterCollisionPairs (const RelativeMotion::matrix_type& relMotion)
+    {
+        hpp::core::CollisionValidation::filterCollisionPairs(relMotion);
+        for(T_CollisionPair::iterator it = collisionPairs_.begin(); it != collisionPairs_.end();)
+        {
+            const size_type i1 = RelativeMotion::idx(it->object1_->joint());
+            const size_type i2 = RelativeMotion::idx(it->object2_->joint());
+            if(relMotion(i1, i2) == RelativeMotion::Constrained)
+                it = collisionPairs_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    bool LimbCollisionValidation::hasCollisionPair (const model::JointPtr_t& joint,
+                                                    const model::CollisionObjectPtr_t& obstacle) const
+    {
+        for(T_CollisionPair::const_iterator cit = collisionPairs_.begin(); cit != collisionPairs_.end(); ++cit)
+            if(cit->joint_ == joint && cit->object2_ == obstacle)
+                return true;
+        return false;
+    }
+
+    bool LimbCollisionValidation::limbOnly (const Configuration_t& config) const
+    {
+        const model::Configuration_t& current = robot_->currentConfiguration();
+        const std::size_t size = (std::size_t)config.rows();
+        return current.head(startRank_) == config.head(startRank_)
+            && current.tail(size - endRank_) == config.tail(size - endRank_);
+    }
+
+    bool LimbCollisionValidation::validate (const Configuration_t& config)
+    {
+        return validate(config, unusedReport_);
+    }
+
+    bool LimbCollisionValidation::validate (const Configuration_t& config,
+                    ValidationReportPtr_t& validationReport)
+    {
+        if(!limbOnly(config))
+            return hpp::core::CollisionValidation::validate(config, validationReport);
+        // the rest of the robot is already placed, only the limb joints are moved
+        robot_->currentConfiguration(config);
+        limb_->recursiveComputePosition(config, limb_->parentJoint()->currentTransformation());
+        for(model::JointVector_t::const_iterator jit = joints_.begin(); jit != joints_.end(); ++jit)
+        {
+            model::BodyPtr_t body = (*jit)->linkedBody();
+            if(!body) continue;
+            const model::ObjectVector_t& objects = body->innerObjects(model::COLLISION);
+            for(model::ObjectVector_t::const_iterator oit = objects.begin(); oit != objects.end(); ++oit)
+                (*oit)->fcl()->setTransform((*jit)->currentTransformation() * (*oit)->positionInJointFrame());
+        }
+        for(T_CollisionPair::const_iterator cit = collisionPairs_.begin(); cit != collisionPairs_.end(); ++cit)
+        {
+            fcl::CollisionResult collisionResult;
+            if(fcl::collide(cit->object1_->fcl().get(), cit->object2_->fcl().get(),
+                            collisionRequest_, collisionResult) != 0)
+            {
+                CollisionValidationReportPtr_t report(new CollisionValidationReport);
+                report->object1 = cit->object1_;
+                report->object2 = cit->object2_;
+                report->result = collisionResult;
+                validationReport = report;
+                return false;
+            }
+        }
+        return true;
+    }
+  }// namespace rbprm
+}// namespace hpp
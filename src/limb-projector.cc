@@ -0,0 +1,84 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/limb-projector.hh>
+#include <hpp/rbprm/tools.hh>
+#include <hpp/model/joint.hh>
+#include <hpp/core/config-projector.hh>
+#include <hpp/core/locked-joint.hh>
+#include <hpp/core/numerical-constraint.hh>
+#include <hpp/constraints/generic-transformation.hh>
+
+namespace hpp {
+  namespace rbprm {
+
+    LimbProjectorPtr_t LimbProjector::create(const model::DevicePtr_t& device, const RbPrmLimb& limb,
+                                             const std::vector<bool>& rotationFilter)
+    {
+        return LimbProjectorPtr_t(new LimbProjector(device, limb, rotationFilter));
+    }
+
+    LimbProjector::LimbProjector(const model::DevicePtr_t& device, const RbPrmLimb& limb, const std::vector<bool>& rotationFilter)
+        : device_(device)
+        , rotationFilter_(rotationFilter)
+        , proj_(core::ConfigProjector::create(device,"proj", 1e-4, 20))
+    {
+        const model::JointPtr_t effector = device->getJointByName(limb.effector_->name());
+        // values of the locked joints are read from the device at each projection
+        tools::LockJointRec(limb.limb_->name(), device->rootJoint(), proj_, false);
+        std::vector<bool> translationFilter(3, true);
+        fcl::Transform3f localFrame, globalFrame;
+        position_ = constraints::Position::create("", device, effector, localFrame, globalFrame, translationFilter);
+        proj_->add(core::NumericalConstraint::create (position_));
+        if(limb.contactType_ == hpp::rbprm::_6_DOF)
+        {
+            orientation_ = constraints::Orientation::create("", device, effector, fcl::Transform3f(), rotationFilter);
+            proj_->add(core::NumericalConstraint::create (orientation_));
+        }
+    }
+
+    bool LimbProjector::apply(model::ConfigurationOut_t configuration, const fcl::Matrix3f& rotationTarget, const fcl::Vec3f& positionTarget)
+    {
+        proj_->rightHandSideFromConfig(device_->currentConfiguration());
+        fcl::Transform3f globalFrame;
+        globalFrame.setTranslation(positionTarget);
+        position_->frame2InJoint2(globalFrame);
+        if(orientation_)
+            orientation_->frame2InJoint2(fcl::Transform3f(rotationTarget));
+        return proj_->apply(configuration);
+    }
+
+    LimbProjectorPtr_t GetLimbProjector(RbPrmLimb& limb, const model::DevicePtr_t& device, const std::vector<bool>& rotationFilter)
+    {
+        LimbProjectorPtr_t res;
+        #pragma omp critical (rbprm_limb_projector)
+        {
+            for(std::vector<LimbProjectorPtr_t>::const_iterator cit = limb.projectors_.begin();
+                !res && cit != limb.projectors_.end(); ++cit)
+            {
+                if((*cit)->device_ == device && (*cit)->rotationFilter_ == rotationFilter)
+                    res = *cit;
+            }
+            if(!res)
+            {
+                res = LimbProjector::create(device, limb, rotationFilter);
+                limb.projectors_.push_back(res);
+            }
+        }
+        return res;
+    }
+  } // rbprm
+} //hpp
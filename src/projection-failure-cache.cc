@@ -0,0 +1,157 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/projection-failure-cache.hh>
+#include <hpp/rbprm/sampling/sample-db.hh>
+
+#include <boost/functional/hash.hpp>
+
+#include <cmath>
+
+namespace hpp {
+  namespace rbprm {
+
+    bool ProjectionFailureCache::Key::operator<(const Key& other) const
+    {
+        if(context_ != other.context_) return context_ < other.context_;
+        if(sample_ != other.sample_) return sample_ < other.sample_;
+        if(triangle_ != other.triangle_) return triangle_ < other.triangle_;
+        if(geometry_ != other.geometry_) return geometry_ < other.geometry_;
+        return storage_ < other.storage_;
+    }
+
+    ProjectionFailureCache::ProjectionFailureCache(const std::size_t capacity, const double resolution)
+        : capacity_(capacity)
+        , resolution_(resolution)
+        , octree_(0)
+        , nbSamples_(0)
+        , hits_(0)
+        , misses_(0)
+    {
+        // NOTHING
+    }
+
+    std::size_t ProjectionFailureCache::context(model::ConfigurationIn_t configuration, const std::pair<std::size_t, std::size_t>& limbDofs,
+                                                const std::map<std::string, bool>& contacts, const void* validation) const
+    {
+        // stability depends on the contacts, collisions on the validation
+        std::size_t seed = 0;
+        boost::hash_combine(seed, validation);
+        for(std::map<std::string, bool>::const_iterator cit = contacts.begin(); cit != contacts.end(); ++cit)
+            if(cit->second)
+                boost::hash_combine(seed, cit->first);
+        for(std::size_t i = 0; i < (std::size_t)configuration.rows(); ++i)
+        {
+            if(i >= limbDofs.first && i < limbDofs.second)
+                continue;
+            boost::hash_combine(seed, (long int)std::floor(configuration[i] / resolution_));
+        }
+        return seed;
+    }
+
+    ProjectionFailureCache::Key ProjectionFailureCache::key(const sampling::OctreeReport& report, const std::size_t context) const
+    {
+        Key res;
+        res.storage_ = report.sample_->storage_.get();
+        res.sample_ = report.sample_->id_;
+        res.geometry_ = report.contact_.o2;
+        res.triangle_ = report.contact_.b2;
+        res.context_ = context;
+        return res;
+    }
+
+    void ProjectionFailureCache::update(const sampling::SampleDB& database)
+    {
+        #pragma omp critical (rbprm_projection_failures)
+        {
+            // sample ids change when samples are added, pruned or sorted
+            if(octree_ != database.geometry_.get() || nbSamples_ != database.samples_.size())
+            {
+                records_.clear();
+                order_.clear();
+                octree_ = database.geometry_.get();
+                nbSamples_ = database.samples_.size();
+            }
+        }
+    }
+
+    bool ProjectionFailureCache::find(const Key& key, Record& record)
+    {
+        bool found = false;
+        #pragma omp critical (rbprm_projection_failures)
+        {
+            T_Records::const_iterator cit = records_.find(key);
+            found = cit != records_.end();
+            if(found)
+            {
+                record = cit->second.first;
+                ++hits_;
+            }
+            else
+                ++misses_;
+        }
+        return found;
+    }
+
+    void ProjectionFailureCache::insert(const Key& key, const Failure failure, const double robustness)
+    {
+        if(capacity_ == 0)
+            return;
+        Record record;
+        record.failure_ = failure;
+        record.robustness_ = robustness;
+        #pragma omp critical (rbprm_projection_failures)
+        {
+            T_Records::iterator it = records_.find(key);
+            if(it != records_.end())
+            {
+                order_.erase(it->second.second);
+                records_.erase(it);
+            }
+            while(records_.size() >= capacity_)
+            {
+                records_.erase(order_.front());
+                order_.pop_front();
+            }
+            records_.insert(std::make_pair(key, std::make_pair(record, order_.insert(order_.end(), key))));
+        }
+    }
+
+    void ProjectionFailureCache::clear()
+    {
+        #pragma omp critical (rbprm_projection_failures)
+        {
+            records_.clear();
+            order_.clear();
+        }
+    }
+
+    double ProjectionFailureCache::hitRate() const
+    {
+        const std::size_t lookups = hits_ + misses_;
+        return lookups > 0 ? (double)hits_ / (double)lookups : 0.;
+    }
+
+    void ProjectionFailureCache::resetCounters()
+    {
+        #pragma omp critical (rbprm_projection_failures)
+        {
+            hits_ = 0;
+            misses_ = 0;
+        }
+    }
+  } // rbprm
+} //hpp
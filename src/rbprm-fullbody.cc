@@ -17,8 +17,12 @@
 #include <hpp/rbprm/rbprm-fullbody.hh>
 #include <hpp/model/joint.hh>
 #include <hpp/rbprm/tools.hh>
+#include <hpp/rbprm/sampling/database-registry.hh>
 #include <hpp/rbprm/stability/stability.hh>
 #include <hpp/rbprm/ik-solver.hh>
+#include <hpp/rbprm/limb-projector.hh>
+#include <hpp/rbprm/projection-failure-cache.hh>
+#include <hpp/rbprm/limb-collision-validation.hh>
 
 #include <hpp/core/constraint-set.hh>
 #include <hpp/core/config-projector.hh>
@@ -27,8 +31,14 @@
 #include <hpp/constraints/generic-transformation.hh>
 
 #include <hpp/fcl/BVH/BVH_model.h>
+#include <hpp/fcl/collision.h>
 
 #include <stack>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef PROFILE
     #include "hpp/rbprm/rbprm-profiler.hh"
@@ -61,7 +71,7 @@ namespace hpp {
     void RbPrmFullBody::AddLimbPrivate(rbprm::RbPrmLimbPtr_t limb, const std::string& id, const std::string& name,
                         const model::ObjectVector_t &collisionObjects, const bool disableEffectorCollision)
     {
-        core::CollisionValidationPtr_t limbcollisionValidation_ = core::CollisionValidation::create(this->device_);
+        LimbCollisionValidationPtr_t limbcollisionValidation_ = LimbCollisionValidation::create(this->device_, limb->limb_);
         // adding collision validation
         for(model::ObjectVector_t::const_iterator cit = collisionObjects.begin();
             cit != collisionObjects.end(); ++cit)
@@ -75,15 +85,17 @@ namespace hpp {
             if(disableEffectorCollision)
             {
                 hpp::tools::RemoveEffectorCollision<core::CollisionValidation>((*collisionValidation_.get()), limb->effector_, *cit);
-                hpp::tools::RemoveEffectorCollision<core::CollisionValidation>((*limbcollisionValidation_.get()), limb->effector_, *cit);
+                hpp::tools::RemoveEffectorCollision<LimbCollisionValidation>((*limbcollisionValidation_.get()), limb->effector_, *cit);
             }
         }
         limbs_.insert(std::make_pair(id, limb));
-        tools::RemoveNonLimbCollisionRec<core::CollisionValidation>(device_->rootJoint(),name,collisionObjects,*limbcollisionValidation_.get());
+        tools::RemoveNonLimbCollisionRec<LimbCollisionValidation>(device_->rootJoint(),name,collisionObjects,*limbcollisionValidation_.get());
         hpp::core::RelativeMotion::matrix_type m = hpp::core::RelativeMotion::matrix(device_);
         limbcollisionValidation_->filterCollisionPairs(m);
         collisionValidation_->filterCollisionPairs(m);
         limbcollisionValidations_.insert(std::make_pair(id, limbcollisionValidation_));
+        // limb indices have changed
+        affordanceTable_.clear();
         // insert limb to root group
         T_LimbGroup::iterator cit = limbGroups_.find(name);
         if(cit != limbGroups_.end())
@@ -115,25 +127,56 @@ namespace hpp {
                                 const fcl::Vec3f &offset,const fcl::Vec3f &normal, const double x,
                                 const double y,
                                 const model::ObjectVector_t &collisionObjects, const std::size_t nbSamples, const std::string &heuristicName, const double resolution,
-                                ContactType contactType, const bool disableEffectorCollision)
+                                ContactType contactType, const bool disableEffectorCollision, const std::size_t nbThreads,
+                                const bool storeJacobians, const sampling::SampleEncoding encoding)
     {
         std::map<std::string, const sampling::heuristic>::const_iterator hit = checkLimbData(id, limbs_,factory_,heuristicName);
         model::JointPtr_t joint = device_->getJointByName(name);
-        rbprm::RbPrmLimbPtr_t limb = rbprm::RbPrmLimb::create(joint, effectorName, offset,normal,x,y, nbSamples, hit->second, resolution,contactType, disableEffectorCollision);
+        rbprm::RbPrmLimbPtr_t limb = rbprm::RbPrmLimb::create(joint, effectorName, offset,normal,x,y, nbSamples, hit->second, resolution,contactType, disableEffectorCollision, nbThreads, storeJacobians, encoding);
         AddLimbPrivate(limb, id, name,collisionObjects, disableEffectorCollision);
     }
 
+    // limb read from a text or binary limb file, using the shared database if given
+    rbprm::RbPrmLimbPtr_t createLimb(const model::DevicePtr_t& device, const std::string& database,
+                                     const sampling::binary::MappedFilePtr_t& file, const bool loadValues,
+                                     const sampling::heuristic evaluate, const bool disableEffectorCollision,
+                                     const sampling::SampleDBPtr_t& shared)
+    {
+        if(file)
+            return rbprm::RbPrmLimb::create(device, file, loadValues, evaluate, disableEffectorCollision, shared);
+        std::ifstream myfile (database.c_str());
+        if (!myfile.good())
+            throw std::runtime_error ("Impossible to open database");
+        return rbprm::RbPrmLimb::create(device, myfile, loadValues, evaluate, disableEffectorCollision, shared);
+    }
+
     void RbPrmFullBody::AddLimb(const std::string& database, const std::string& id,
                                 const model::ObjectVector_t &collisionObjects,
                                 const std::string& heuristicName,
-                                const bool loadValues, const bool disableEffectorCollision)
+                                const bool loadValues, const bool disableEffectorCollision,
+                                const bool shareDatabase)
     {
         std::map<std::string, const sampling::heuristic>::const_iterator hit = checkLimbData(id, limbs_,factory_,heuristicName);;
-        std::ifstream myfile (database.c_str());
-        if (!myfile.good())
-            throw std::runtime_error ("Impossible to open database");
-        rbprm::RbPrmLimbPtr_t limb = rbprm::RbPrmLimb::create(device_, myfile, loadValues, hit->second, disableEffectorCollision);
-        myfile.close();
+        sampling::DatabaseRegistry& registry = sampling::DatabaseRegistry::Instance();
+        const bool binary = sampling::binary::IsBinaryDatabase(database);
+        sampling::binary::MappedFilePtr_t file;
+        if(binary)
+            file = sampling::binary::MappedFile::create(database);
+        sampling::SampleDBPtr_t shared;
+        boost::uint64_t hash = 0;
+        if(shareDatabase)
+        {
+            hash = binary ? sampling::ContentHash(file->data(), file->size()) : sampling::ContentHash(database);
+            shared = registry.find(database, hash, loadValues);
+        }
+        rbprm::RbPrmLimbPtr_t limb = createLimb(device_, database, file, loadValues, hit->second, disableEffectorCollision, shared);
+        if(shareDatabase && !shared)
+        {
+            // the database may have been registered by another thread in the meantime
+            shared = registry.insert(database, hash, loadValues, limb->sampleDatabase_);
+            if(shared != limb->sampleDatabase_)
+                limb = createLimb(device_, database, file, loadValues, hit->second, disableEffectorCollision, shared);
+        }
         AddLimbPrivate(limb, id, limb->limb_->name(),collisionObjects, disableEffectorCollision);
     }
 
@@ -145,11 +188,37 @@ namespace hpp {
     RbPrmFullBody::RbPrmFullBody (const model::DevicePtr_t& device)
         : device_(device)
         , collisionValidation_(core::CollisionValidation::create(device))
+        , dampedLeastSquaresProjection_(false)
+        , kinematicsLock_(KinematicsLock::create())
         , weakPtr_()
     {
         // NOTHING
     }
 
+    void RbPrmFullBody::SetContactSearchThreads(const std::size_t nbThreads)
+    {
+#ifdef _OPENMP
+        const std::size_t nbWorkers = nbThreads > 0 ? nbThreads : (std::size_t)omp_get_max_threads();
+#else
+        const std::size_t nbWorkers = 1;
+#endif
+        contactSearchDevices_.clear();
+        // the projectors of the previous copies are released with them
+        for(T_Limb::const_iterator lit = limbs_.begin(); lit != limbs_.end(); ++lit)
+            lit->second->projectors_.clear();
+        if(nbWorkers < 2)
+            return;
+        for(std::size_t i = 0; i < nbWorkers; ++i)
+            contactSearchDevices_.push_back(device_->clone());
+    }
+
+    const AffordanceTable& RbPrmFullBody::GetAffordanceTable(const affMap_t& affordances, const T_AffordanceFilters& affFilters)
+    {
+        if(!affordanceTable_.matches(affordances, affFilters))
+            affordanceTable_.compile(limbs_, affordances, affFilters);
+        return affordanceTable_;
+    }
+
     // assumes unit direction
     std::vector<bool> setMaintainRotationConstraints()//const fcl::Vec3f&) // direction)
     {
@@ -183,17 +252,87 @@ namespace hpp {
         return res;
     }
 
+    // samples of the voxels of the limb octree in collision with the obstacles of the validation
+    // tested against the effector, sorted by position in the database.
+    // Cached in the limb for the current octree transform
+    const std::vector<sampling::VoxelSampleId>& GetBlockedSamples(const hpp::rbprm::RbPrmLimbPtr_t& limb,
+                                                                  const core::CollisionValidationPtr_t& validation)
+    {
+        BlockedSamples& blocked = limb->blockedSamples_;
+        model::ObjectVector_t obstacles;
+        LimbCollisionValidationPtr_t limbValidation = boost::dynamic_pointer_cast<LimbCollisionValidation>(validation);
+        if(limbValidation)
+        {
+            const model::ObjectVector_t& all = limbValidation->obstacles();
+            for(model::ObjectVector_t::const_iterator oit = all.begin(); oit != all.end(); ++oit)
+                if(limbValidation->hasCollisionPair(limb->effector_, *oit))
+                    obstacles.push_back(*oit);
+        }
+        const sampling::SampleDB& sc = limb->sampleContainer_;
+        const fcl::Transform3f treeTrf = limb->octreeRoot();
+        if(blocked.octree_ == sc.geometry_.get() && blocked.nbSamples_ == sc.samples_.size()
+                && blocked.obstacles_ == obstacles && blocked.root_.getTranslation() == treeTrf.getTranslation()
+                && blocked.root_.getQuatRotation() == treeTrf.getQuatRotation())
+            return blocked.samples_;
+        blocked.octree_ = sc.geometry_.get();
+        blocked.nbSamples_ = sc.samples_.size();
+        blocked.obstacles_ = obstacles;
+        blocked.root_ = treeTrf;
+        blocked.samples_.clear();
+        for(model::ObjectVector_t::const_iterator oit = obstacles.begin(); oit != obstacles.end(); ++oit)
+        {
+            fcl::CollisionRequest req(1000, true);
+            fcl::CollisionResult cResult;
+            fcl::CollisionObjectPtr_t obj = (*oit)->fcl();
+            fcl::collide(sc.geometry_.get(), treeTrf, obj->collisionGeometry().get(), obj->getTransform(), req, cResult);
+            for(std::size_t index = 0; index < cResult.numContacts(); ++index)
+            {
+                const std::size_t slot = sc.samplesInVoxels_.find(cResult.getContact(index).b1);
+                if(slot != sampling::VoxelIndex::NOT_FOUND)
+                    blocked.samples_.push_back(sc.samplesInVoxels_.samples(slot));
+            }
+        }
+        std::sort(blocked.samples_.begin(), blocked.samples_.end());
+        return blocked.samples_;
+    }
+
+    bool IsBlocked(const std::vector<sampling::VoxelSampleId>& blocked, const std::size_t sample)
+    {
+        // voxels do not share samples
+        std::vector<sampling::VoxelSampleId>::const_iterator it = std::upper_bound(blocked.begin(), blocked.end(),
+                    sampling::VoxelSampleId(sample, std::numeric_limits<std::size_t>::max()));
+        return it != blocked.begin() && sample < (it-1)->first + (it-1)->second;
+    }
+
     bool ComputeCollisionFreeConfiguration(const hpp::rbprm::RbPrmFullBodyPtr_t& body,
                               State& current,
                               core::CollisionValidationPtr_t validation,
                               const hpp::rbprm::RbPrmLimbPtr_t& limb, model::ConfigurationOut_t configuration,
                               const double robustnessTreshold, bool stability = true)
     {
-        for(sampling::SampleVector_t::const_iterator cit = limb->sampleContainer_.samples_.begin();
-            cit != limb->sampleContainer_.samples_.end(); ++cit)
+        const sampling::T_Sample& samples = limb->sampleContainer_.samples_;
+        hpp::core::ValidationReportPtr_t valRep (new hpp::core::CollisionValidationReport);
+        // folded samples are tried first, except those with an effector close to an obstacle,
+        // then every sample of the database
+        const std::vector<std::size_t>& fallbackSamples = GetFallbackSamples(*limb);
+        std::vector<std::size_t> tried;
+        if(!fallbackSamples.empty())
         {
-            sampling::Load(*cit, configuration);
-            hpp::core::ValidationReportPtr_t valRep (new hpp::core::CollisionValidationReport);
+            const std::vector<sampling::VoxelSampleId>& blocked = GetBlockedSamples(limb, validation);
+            for(std::vector<std::size_t>::const_iterator cit = fallbackSamples.begin(); cit != fallbackSamples.end(); ++cit)
+                if(*cit < samples.size() && !IsBlocked(blocked, *cit))
+                    tried.push_back(*cit);
+        }
+        const std::size_t nbFallback = tried.size();
+        for(std::size_t i = 0; i < nbFallback + samples.size(); ++i)
+        {
+            const bool fallback = i < nbFallback;
+            const std::size_t sample = fallback ? tried[i] : i - nbFallback;
+            if(i == nbFallback)
+                std::sort(tried.begin(), tried.end());
+            if(!fallback && std::binary_search(tried.begin(), tried.end(), sample))
+                continue;
+            sampling::Load(samples[sample], configuration);
             if(validation->validate(configuration, valRep) && (!stability || stability::IsStable(body,current) >=robustnessTreshold))
             {
                 current.configuration_ = configuration;
@@ -214,7 +353,8 @@ namespace hpp {
         State current;
         current.configuration_ = configuration;
         model::Configuration_t config = configuration;
-        core::ConfigurationIn_t save = body->device_->currentConfiguration();
+        // the previous configuration is reloaded when leaving
+        KinematicsWorkspace workspace(body->device_, body->GetKinematicsLock());
         // iterate over contact filo list
         std::queue<std::string> previousStack = previous.contactOrder_;
         while(!previousStack.empty())
@@ -245,8 +385,6 @@ namespace hpp {
                 brokenContacts.push_back(name);
             }
         }
-        // reload previous configuration
-        body->device_->currentConfiguration(save);
         if(brokenContacts.size() > 1)
         {
             contactMaintained = false;
@@ -279,13 +417,109 @@ namespace hpp {
     }
 
 
+    namespace
+    {
+    // solves the inverse kinematics of a limb, the other joints being locked to
+    // their value in the current configuration of device. Each copy of the robot
+    // has its own projector, so that limbs can be projected concurrently.
+    // The damped least squares solver keeps the other joints to their value in configuration.
+    bool ProjectLimb(const model::DevicePtr_t& device, const hpp::rbprm::RbPrmLimbPtr_t& limb, model::ConfigurationOut_t configuration,
+                     const fcl::Matrix3f& rotationTarget, const std::vector<bool> &rotationFilter, const fcl::Vec3f& positionTarget,
+                     const bool dampedLeastSquares)
+    {
+        if(dampedLeastSquares)
+            return ik::apply(device, *limb, configuration, positionTarget, rotationTarget, rotationFilter).success_;
+        return GetLimbProjector(*limb, device, rotationFilter)->apply(configuration, rotationTarget, positionTarget);
+    }
+
+    // loads a sample in configuration, and projects the limb on the contact surface of the sample
+    bool ProjectSampleLimb(const model::DevicePtr_t& device, const model::JointPtr_t& effector, const hpp::rbprm::RbPrmLimbPtr_t& limb,
+                           const sampling::OctreeReport& report, model::ConfigurationOut_t configuration, const bool dampedLeastSquares)
+    {
+        sampling::Load(*report.sample_, configuration);
+        device->currentConfiguration(configuration);
+        device->computeForwardKinematics();
+        const fcl::Vec3f& normal = report.normal_;
+        const fcl::Vec3f& position = report.contact_.pos;
+        // the normal is given by the normal of the contacted object
+        const fcl::Vec3f z = effector->currentTransformation().getRotation() * limb->normal_;
+        const fcl::Matrix3f alignRotation = tools::GetRotationMatrix(z,normal);
+        const fcl::Matrix3f rotation = alignRotation * effector->currentTransformation().getRotation();
+        fcl::Vec3f posOffset = position - rotation * limb->offset_;
+        posOffset = posOffset + normal * epsilon;
+        return ProjectLimb(device, limb, configuration, rotation, setRotationConstraints(), posOffset, dampedLeastSquares);
+    }
+
+    // checks the collisions of a projected configuration, and computes the resulting state
+    hpp::rbprm::State ValidateProjection(const hpp::rbprm::RbPrmFullBodyPtr_t& body, const std::string& limbId, const hpp::rbprm::RbPrmLimbPtr_t& limb,
+                                         core::CollisionValidationPtr_t validation, model::ConfigurationOut_t configuration,
+                                         const fcl::Vec3f& normal, const hpp::rbprm::State& current, bool& success)
+    {
+#ifdef PROFILE
+        RbPrmProfiler& watch = getRbPrmProfiler();
+        watch.start("collision");
+#endif
+        hpp::core::ValidationReportPtr_t valRep (new hpp::core::CollisionValidationReport);
+        if(validation->validate(configuration, valRep))
+        {
+#ifdef PROFILE
+            watch.stop("collision");
+#endif
+            // test stability of new configuration
+            body->device_->currentConfiguration(configuration);
+            body->device_->computeForwardKinematics();
+            State tmp (current);
+            tmp.contacts_[limbId] = true;
+            tmp.contactPositions_[limbId] = limb->effector_->currentTransformation().getTranslation();
+            tmp.contactRotation_[limbId] = limb->effector_->currentTransformation().getRotation();
+            tmp.contactNormals_[limbId] = normal;
+            tmp.configuration_ = configuration;
+            ++tmp.nbContacts;
+            success = true;
+            return tmp;
+        }
+#ifdef PROFILE
+        watch.stop("collision");
+#endif
+        success = false;
+        return current;
+    }
+    }
+
+    // whether a recorded failure of a candidate would happen again
+    bool KnownFailure(ProjectionFailureCache& failures, const ProjectionFailureCache::Key& key, const bool anyRobustness,
+                      const double robustnessTreshold, const bool contactIfFails, const double maxRob)
+    {
+        ProjectionFailureCache::Record record;
+        if(!failures.find(key, record))
+            return false;
+        if(record.failure_ != ProjectionFailureCache::STABILITY_FAILURE)
+            return true;
+        // the contact may still be accepted, or kept as the most robust one
+        return !anyRobustness && record.robustness_ < robustnessTreshold
+                && (!contactIfFails || record.robustness_ <= maxRob);
+    }
+
+    // the index is kept by the limb, and built again when its affordance objects change
+    sampling::AffordanceIndexPtr_t getAffordanceIndex(const hpp::rbprm::RbPrmLimbPtr_t& limb, const model::ObjectVector_t& affordances)
+    {
+        sampling::AffordanceIndexPtr_t index;
+        #pragma omp critical (rbprm_affordance_index)
+        {
+            if(!limb->affordanceIndex_ || limb->affordanceIndex_->objects_ != affordances)
+                limb->affordanceIndex_ = sampling::AffordanceIndex::create(affordances);
+            index = limb->affordanceIndex_;
+        }
+        return index;
+    }
+
     ContactComputationStatus ComputeStableContact(const hpp::rbprm::RbPrmFullBodyPtr_t& body,
                               State& current,
                               core::CollisionValidationPtr_t validation,
                               const std::string& limbId,
                               const hpp::rbprm::RbPrmLimbPtr_t& limb,
                               model::ConfigurationIn_t rbconfiguration,
-                              model::ConfigurationOut_t configuration, const model::ObjectVector_t affordances,
+                              model::ConfigurationOut_t configuration, const model::ObjectVector_t& affordances,
                               const fcl::Vec3f& direction,
                               fcl::Vec3f& position, fcl::Vec3f& normal, const double robustnessTreshold,
                               bool contactIfFails = true, bool stableForOneContact = true,
@@ -304,42 +538,107 @@ namespace hpp {
       fcl::Transform3f transform = limb->octreeRoot(); // get root transform from configuration
 
 
-      //#pragma omp parallel for
       // request samples which collide with each of the collision objects
       sampling::heuristic eval = evaluate; if(!eval) eval =  limb->evaluate_;
-      std::size_t i (0);
 		  if (affordances.empty ()) {
 		  	throw std::runtime_error ("No aff objects found!!!");
 		  }
-		  std::vector<sampling::T_OctreeReport> reports(affordances.size());
-      for(model::ObjectVector_t::const_iterator oit = affordances.begin();
-          oit != affordances.end(); ++oit, ++i)
-      {
-          if(eval)
-            sampling::GetCandidates(limb->sampleContainer_, transform, *oit, direction, reports[i], eval);
-          else
-            sampling::GetCandidates(limb->sampleContainer_, transform, *oit, direction, reports[i]);
-      }
-      // order samples according to EFORT
-      for(std::vector<sampling::T_OctreeReport>::const_iterator cit = reports.begin();
-          cit != reports.end(); ++cit)
-      {
-          finalSet.insert(cit->begin(), cit->end());
-      }
+      const std::vector<model::DevicePtr_t>& devices = body->GetContactSearchDevices();
+      // only the affordance objects in reach of the octree are tested,
+      // candidates are ordered according to EFORT
+      sampling::GetCandidates(limb->sampleContainer_, transform, *getAffordanceIndex(limb, affordances), direction, finalSet, eval,
+                              std::max(devices.size(), (std::size_t)1), &limb->candidateCache_);
       // pick first sample which is collision free
       bool found_sample(false);
       bool unstableContact(false); //set to true in case no stable contact is found
       core::Configuration_t moreRobust;
       double maxRob = -std::numeric_limits<double>::max();
-      sampling::T_OctreeReport::const_iterator it = finalSet.begin();
-      for(;!found_sample && it!=finalSet.end(); ++it)
+      // In parallel mode the limbs of a window of best candidates are projected
+      // speculatively, one candidate per thread. The projections are then checked
+      // in the order of the candidates, as done by the serial search.
+      const std::size_t window = std::max(devices.size(), (std::size_t)1);
+      std::vector<core::Configuration_t> projections;
+      std::vector<char> projected;
+      // candidates which recently failed for this configuration are skipped
+      ProjectionFailureCache& failures = limb->projectionFailures_;
+      const bool memoize = failures.enabled();
+      const bool anyRobustness = current.nbContacts == 0 && !stableForOneContact;
+      std::size_t context = 0;
+      if(memoize)
       {
-          const sampling::OctreeReport& bestReport = *it;
+          failures.update(limb->sampleContainer_);
+          context = failures.context(configuration, std::make_pair(limb->limb_->rankInConfiguration(),
+                                     limb->effector_->rankInConfiguration() + limb->effector_->configSize()),
+                                     current.contacts_, validation.get());
+      }
+      std::vector<char> skipped;
+      for(std::size_t first = 0; !found_sample && first < finalSet.size(); first += window)
+      {
+        const std::size_t last = std::min(first + window, finalSet.size());
+        skipped.assign(last - first, 0);
+        if(memoize)
+        {
+          for(std::size_t k = first; k < last; ++k)
+              skipped[k - first] = KnownFailure(failures, failures.key(finalSet.at(k), context), anyRobustness,
+                                                robustnessTreshold, contactIfFails, maxRob);
+        }
+        if(!devices.empty())
+        {
+          // the candidates are ordered before the parallel region, CandidateSet is not thread safe
+          std::vector<const sampling::OctreeReport*> candidates;
+          for(std::size_t k = first; k < last; ++k)
+              candidates.push_back(&finalSet.at(k));
+          projections.assign(last - first, core::Configuration_t(configuration));
+          projected.assign(last - first, 0);
+          #pragma omp parallel for schedule(static, 1) num_threads((int)devices.size())
+          for(long int k = 0; k < (long int)candidates.size(); ++k)
+          {
+              if(skipped[k])
+                  continue;
+#ifdef _OPENMP
+              const model::DevicePtr_t& device = devices[omp_get_thread_num()];
+#else
+              const model::DevicePtr_t& device = devices.front();
+#endif
+              projected[k] = ProjectSampleLimb(device, device->getJointByName(limb->effector_->name()), limb,
+                                               *candidates[k], projections[k], body->GetDampedLeastSquaresProjection());
+          }
+        }
+        for(std::size_t k = first; !found_sample && k < last; ++k)
+        {
+          if(skipped[k - first])
+              continue;
+          const sampling::OctreeReport& bestReport = finalSet.at(k);
           bool success (false);
-          hpp::rbprm::State tmp = ProjectSampleToObstacle(body, limbId, limb, bestReport, validation, configuration, current, success);
+          bool projectedSample (false);
+          hpp::rbprm::State tmp;
+          if(devices.empty())
+          {
+#ifdef PROFILE
+              RbPrmProfiler& watch = getRbPrmProfiler();
+              watch.start("ik");
+#endif
+              projectedSample = ProjectSampleLimb(body->device_, limb->effector_, limb, bestReport, configuration,
+                                                  body->GetDampedLeastSquaresProjection());
+#ifdef PROFILE
+              watch.stop("ik");
+#endif
+          }
+          else
+          {
+              configuration = projections[k - first];
+              projectedSample = projected[k - first];
+          }
+          tmp = projectedSample ? ValidateProjection(body, limbId, limb, validation, configuration, bestReport.normal_, current, success)
+                                : current;
+          if(memoize && !success)
+              failures.insert(failures.key(bestReport, context), projectedSample ? ProjectionFailureCache::COLLISION_FAILURE
+                                                                                 : ProjectionFailureCache::PROJECTION_FAILURE);
           if(success)
           {
               double robustness = stability::IsStable(body,tmp);
+              if(memoize && !(anyRobustness || robustness>=robustnessTreshold))
+                  failures.insert(failures.key(bestReport, context), ProjectionFailureCache::STABILITY_FAILURE, robustness);
               if((tmp.nbContacts == 1 && !stableForOneContact) || robustness>=robustnessTreshold)
               {
                   maxRob = std::max(robustness, maxRob);
@@ -360,6 +659,7 @@ namespace hpp {
                   unstableContact = true;
               }
           }
+        }
       }
 
       ContactComputationStatus status(NO_CONTACT);
@@ -404,48 +704,9 @@ namespace hpp {
       return status;
     }
 
-		hpp::model::ObjectVector_t getAffObjectsForLimb(const std::string& limb,
-			const affMap_t& affordances, const std::map<std::string, std::vector<std::string> >& affFilters)
-		{
-			model::ObjectVector_t affs;
-			std::vector<std::string> affTypes;
-			bool settingFound = false;
-			for (std::map<std::string, std::vector<std::string> >::const_iterator fIt =
-				affFilters.begin (); fIt != affFilters.end (); ++fIt) {
-				std::size_t found = fIt->first.find(limb);
- 			  if (found != std::string::npos) {
-				affTypes = fIt->second;
-				settingFound = true;
-				break;
-				}
-			}
-			if (!settingFound) {
-        // TODO: Keep warning or delete it?
-				std::cout << "No affordance filter setting found for limb " << limb
-					<< ". Has such filter been set?" << std::endl;
-				// Use all AFF OBJECTS as default if no filter setting exists
-				for (affMap_t::const_iterator affordanceIt = affordances.begin ();
-					affordanceIt != affordances.end (); ++affordanceIt) {
-					std::copy (affordanceIt->second.begin (), affordanceIt->second.end (),
-						std::back_inserter (affs));
-				}
-            } else {
-				for (std::vector<std::string>::const_iterator affTypeIt = affTypes.begin ();
-					affTypeIt != affTypes.end (); ++affTypeIt) {
-					affMap_t::const_iterator affIt = affordances.find(*affTypeIt);
-					std::copy (affIt->second.begin (), affIt->second.end (), std::back_inserter (affs));
-				}
-			}
-			if (affs.empty()) {
-			throw std::runtime_error ("No aff objects found for limb " + limb);
-			}
-			return affs;
-		}
-
     bool RepositionContacts(State& result, const hpp::rbprm::RbPrmFullBodyPtr_t& body,
 			core::CollisionValidationPtr_t validation,
-      model::ConfigurationOut_t config, const affMap_t& affordances,
-      const std::map<std::string, std::vector<std::string> >& affFilters, const fcl::Vec3f& direction,
+      model::ConfigurationOut_t config, const AffordanceTable& affordanceTable, const fcl::Vec3f& direction,
 			const double robustnessTreshold)
     {
         // replace existing contacts
@@ -463,16 +724,13 @@ namespace hpp {
             const std::vector<std::string>& group = body->GetGroups().at(groupName);
             oldOrder.pop();
             fcl::Vec3f normal, position;
-            core::ConfigurationIn_t save = body->device_->currentConfiguration();
+            const core::Configuration_t save = body->device_->currentConfiguration();
             bool notFound(true);
             for(std::vector<std::string>::const_iterator cit = group.begin();
                 notFound && cit != group.end(); ++cit)
             {
-								hpp::model::ObjectVector_t affs = getAffObjectsForLimb (*cit,
-									affordances, affFilters);
-
                 if(ComputeStableContact(body, result, validation, *cit, body->GetLimbs().at(*cit),save, config,
-                	affs, direction, position, normal, robustnessTreshold, false)
+                	affordanceTable.objects(*cit), direction, position, normal, robustnessTreshold, false)
                   == STABLE_CONTACT)
                 {
                     nContactName = *cit;
@@ -510,37 +768,62 @@ namespace hpp {
         return result.stable;
     }
 
-    hpp::rbprm::State ComputeContacts(const hpp::rbprm::RbPrmFullBodyPtr_t& body,
-			model::ConfigurationIn_t configuration, const affMap_t& affordances,
-      const std::map<std::string, std::vector<std::string> >& affFilters, const fcl::Vec3f& direction,
-			const double robustnessTreshold)
+    namespace
+    {
+    hpp::rbprm::State ComputeLimbContacts(const hpp::rbprm::RbPrmFullBodyPtr_t& body, KinematicsWorkspace& workspace,
+                                          const std::map<std::string, core::CollisionValidationPtr_t>& validations,
+                                          model::ConfigurationIn_t configuration, const AffordanceTable& affordanceTable,
+                                          const fcl::Vec3f& direction, const double robustnessTreshold)
     {
         const T_Limb& limbs = body->GetLimbs();
         State result;
-        // save old configuration
-        core::ConfigurationIn_t save = body->device_->currentConfiguration();
         result.configuration_ = configuration;
-        body->device_->currentConfiguration(configuration);
-        body->device_->computeForwardKinematics();
-        for(T_Limb::const_iterator lit = limbs.begin(); lit != limbs.end(); ++lit)
+        workspace.configuration(configuration);
+        std::size_t limbIndex = 0;
+        for(T_Limb::const_iterator lit = limbs.begin(); lit != limbs.end(); ++lit, ++limbIndex)
         {
-            if(!ContactExistsWithinGroup(lit->second, body->limbGroups_ ,result))
+            if(!ContactExistsWithinGroup(lit->second, body->GetGroups() ,result))
             {
-								hpp::model::ObjectVector_t affs = getAffObjectsForLimb (lit->first,
-									affordances, affFilters);
-
                 fcl::Vec3f normal, position;
                 ComputeStableContact(body,result, 
-									body->limbcollisionValidations_.at(lit->first), lit->first,
-									lit->second, configuration, result.configuration_, affs,
+									validations.at(lit->first), lit->first,
+									lit->second, configuration, result.configuration_, affordanceTable.objects(limbIndex),
 									direction, position, normal, robustnessTreshold, true, false);
             }
             result.nbContacts = result.contactNormals_.size();
         }
-        // reload previous configuration
-        body->device_->currentConfiguration(save);
         return result;
     }
+    }
+
+    hpp::rbprm::State ComputeContacts(const hpp::rbprm::RbPrmFullBodyPtr_t& body,
+			model::ConfigurationIn_t configuration, const affMap_t& affordances,
+      const std::map<std::string, std::vector<std::string> >& affFilters, const fcl::Vec3f& direction,
+			const double robustnessTreshold)
+    {
+        // the old configuration is reloaded when leaving
+        KinematicsWorkspace workspace(body->device_, body->GetKinematicsLock());
+        return ComputeLimbContacts(body, workspace, body->limbcollisionValidations_, configuration,
+                                   body->GetAffordanceTable(affordances, affFilters), direction, robustnessTreshold);
+    }
+
+    std::vector<hpp::rbprm::State> ComputeContacts(const hpp::rbprm::RbPrmFullBodyPtr_t& body,
+            const std::vector<model::Configuration_t>& configurations, const affMap_t& affordances,
+            const std::map<std::string, std::vector<std::string> >& affFilters, const std::vector<fcl::Vec3f>& directions,
+            const double robustnessTreshold)
+    {
+        if(directions.size() != 1 && directions.size() != configurations.size())
+            throw std::runtime_error ("Impossible to compute contacts; expected one direction, or one per configuration");
+        std::vector<State> res;
+        res.reserve(configurations.size());
+        // the device is locked once for the whole batch
+        KinematicsWorkspace workspace(body->device_, body->GetKinematicsLock());
+        const AffordanceTable& affordanceTable = body->GetAffordanceTable(affordances, affFilters);
+        for(std::size_t i = 0; i < configurations.size(); ++i)
+            res.push_back(ComputeLimbContacts(body, workspace, body->limbcollisionValidations_, configurations[i], affordanceTable,
+                                              directions.size() == 1 ? directions.front() : directions[i], robustnessTreshold));
+        return res;
+    }
 
     hpp::rbprm::State ComputeContacts(const hpp::rbprm::State& previous,
 			const hpp::rbprm::RbPrmFullBodyPtr_t& body,
@@ -552,14 +835,12 @@ namespace hpp {
     {
 //static int id = 0;
     const T_Limb& limbs = body->GetLimbs();
-    // save old configuration
-    core::ConfigurationIn_t save = body->device_->currentConfiguration();
-    model::Device::Computation_t flag = body->device_->computationFlag ();
-    model::Device::Computation_t newflag = static_cast <model::Device::Computation_t> (model::Device::JOINT_POSITION);
+    // the old configuration and computation flag are reloaded when leaving
+    KinematicsWorkspace workspace(body->device_, body->GetKinematicsLock(),
+                                  static_cast <model::Device::Computation_t> (model::Device::JOINT_POSITION));
+    const AffordanceTable& affordanceTable = body->GetAffordanceTable(affordances, affFilters);
     // load new root position
-    body->device_->controlComputation (newflag);
-    body->device_->currentConfiguration(configuration);
-    body->device_->computeForwardKinematics ();
+    workspace.configuration(configuration);
     // try to maintain previous contacts
     State result = MaintainPreviousContacts(previous,body, body->limbcollisionValidations_, configuration, contactMaintained, multipleBreaks, robustnessTreshold);
     // If more than one are broken, go back to previous state
@@ -571,16 +852,13 @@ namespace hpp {
         result.stable = false;
         std::string replaceContact =  result.RemoveFirstContact();
         model::Configuration_t config = previous.configuration_;
-        body->device_->currentConfiguration(config);
-        body->device_->computeForwardKinematics();
-				hpp::model::ObjectVector_t affs = getAffObjectsForLimb (replaceContact,
-					affordances, affFilters);
+        workspace.configuration(config);
         // if no stable replacement contact found
         // modify contact order to try to replace another contact at the next step
         if(ComputeStableContact(body,result,
 					body->limbcollisionValidations_.at(replaceContact),
 					replaceContact,body->limbs_.at(replaceContact),
-          configuration, config,affs,direction,
+          configuration, config,affordanceTable.objects(replaceContact),direction,
 					position, normal, robustnessTreshold, true, false,
 					body->factory_.heuristics_["random"]) != STABLE_CONTACT)
         {
@@ -588,8 +866,6 @@ namespace hpp {
             result.contactOrder_.pop();
             result.contactOrder_.push(replaceContact);
         }
-        body->device_->currentConfiguration(save);
-        body->device_->controlComputation (flag);
 //++id;
         // in any case, returns state and raises failure flag
         return result;
@@ -599,20 +875,18 @@ namespace hpp {
     core::Configuration_t config = result.configuration_;
     bool contactCreated(false);
     // iterate over each const free limb to try to generate contacts
-    for(T_Limb::const_iterator lit = limbs.begin(); lit != limbs.end(); ++lit)
+    std::size_t limbIndex = 0;
+    for(T_Limb::const_iterator lit = limbs.begin(); lit != limbs.end(); ++lit, ++limbIndex)
     {
         fcl::Vec3f normal, position;
         if(result.contacts_.find(lit->first) == result.contacts_.end()
                 && !ContactExistsWithinGroup(lit->second, body->limbGroups_ ,result))
         {
-						hpp::model::ObjectVector_t affs = getAffObjectsForLimb (lit->first,
-							affordances, affFilters);
-
             // if the contactMaintained flag remains true,
             // the contacts have not changed, and the state can be merged with the previous one eventually
             contactCreated = ComputeStableContact(body, result,
 							body->limbcollisionValidations_.at(lit->first), lit->first,
-							lit->second, configuration, config, affs, direction, position, normal,
+							lit->second, configuration, config, affordanceTable.objects(limbIndex), direction, position, normal,
 							robustnessTreshold) != NO_CONTACT || contactCreated;
         }
     }
@@ -628,11 +902,9 @@ namespace hpp {
             contactMaintained = false;
             // could not reposition any contact. Planner has failed
             if (!RepositionContacts(result, body, body->collisionValidation_,
-							config, affordances, affFilters, direction, robustnessTreshold))
+							config, affordanceTable, direction, robustnessTreshold))
             {
                 std::cout << "planner is stuck; failure " <<  std::endl;
-                body->device_->currentConfiguration(save);
-                body->device_->controlComputation (flag);
                 result.nbContacts = 0;
                 return result;
             }
@@ -648,17 +920,13 @@ namespace hpp {
             if(!replaceContact.empty())
             {
                 model::Configuration_t config = previous.configuration_;
-                body->device_->currentConfiguration(config);
-                body->device_->computeForwardKinematics();
-								hpp::model::ObjectVector_t affs = getAffObjectsForLimb (replaceContact,
-									affordances, affFilters);
-
+                workspace.configuration(config);
                 // if a contact has already been created this iteration, or new contact is not stable
                 // raise failure and switch contact order.
                 if(contactCreated || ComputeStableContact(body,result,
 									body->limbcollisionValidations_.at(replaceContact),replaceContact,
                   body->limbs_.at(replaceContact), configuration, 
-								        config, affs, direction,position,
+								        config, affordanceTable.objects(replaceContact), direction,position,
 									normal,robustnessTreshold) != STABLE_CONTACT)
                 {
                     multipleBreaks = true;
@@ -667,14 +935,10 @@ namespace hpp {
                     result.contactOrder_.push(replaceContact);
                 }
             }
-            body->device_->currentConfiguration(save);
-            body->device_->controlComputation (flag);
 //            ++id;
             return result;
         }
     }
-    body->device_->currentConfiguration(save);    
-    body->device_->controlComputation (flag);
     result.nbContacts = result.contactNormals_.size();
     return result;
     }
@@ -684,69 +948,18 @@ namespace hpp {
                               const fcl::Matrix3f& rotationTarget, const std::vector<bool> &rotationFilter, const fcl::Vec3f& positionTarget, const fcl::Vec3f& normal,
                               const hpp::rbprm::State& current, bool& success)
     {
-        // Add constraints to resolve Ik
         success = false;
-        // Add constraints to resolve Ik
-        core::ConfigProjectorPtr_t proj = core::ConfigProjector::create(body->device_,"proj", 1e-4, 20);
-        // get current normal orientation
-        hpp::tools::LockJointRec(limb->limb_->name(), body->device_->rootJoint(), proj);
-        fcl::Transform3f localFrame, globalFrame;
-        globalFrame.setTranslation(positionTarget);
-        proj->add(core::NumericalConstraint::create (constraints::Position::create("",body->device_,
-                                                                                   limb->effector_,
-                                                                                   localFrame,
-                                                                                   globalFrame,
-                                                                                   setTranslationConstraints())));
-
-        if(limb->contactType_ == hpp::rbprm::_6_DOF)
-        {
-            proj->add(core::NumericalConstraint::create (constraints::Orientation::create("",body->device_,
-                                                                                          limb->effector_,
-                                                                                          fcl::Transform3f(rotationTarget),
-                                                                                          rotationFilter)));
-        }
 #ifdef PROFILE
         RbPrmProfiler& watch = getRbPrmProfiler();
         watch.start("ik");
 #endif
-        if(proj->apply(configuration))
-        {
-#ifdef PROFILE
-            watch.stop("ik");
-#endif
-#ifdef PROFILE
-            RbPrmProfiler& watch = getRbPrmProfiler();
-            watch.start("collision");
-#endif
-            hpp::core::ValidationReportPtr_t valRep (new hpp::core::CollisionValidationReport);
-            if(validation->validate(configuration, valRep))
-        {
+        const bool projected = ProjectLimb(body->device_, limb, configuration, rotationTarget, rotationFilter, positionTarget,
+                                           body->GetDampedLeastSquaresProjection());
 #ifdef PROFILE
-            watch.stop("collision");
+        watch.stop("ik");
 #endif
-            // test stability of new configuration
-            body->device_->currentConfiguration(configuration);
-            body->device_->computeForwardKinematics();
-            State tmp (current);
-            tmp.contacts_[limbId] = true;
-            tmp.contactPositions_[limbId] = limb->effector_->currentTransformation().getTranslation();
-            tmp.contactRotation_[limbId] = limb->effector_->currentTransformation().getRotation();
-            tmp.contactNormals_[limbId] = normal;
-            tmp.configuration_ = configuration;
-            ++tmp.nbContacts;
-            success = true;
-            return tmp;
-        }
-#ifdef PROFILE
-        else
-            watch.stop("collision");
-#endif
-        }
-#ifdef PROFILE
-        else
-            watch.stop("ik");
-#endif
-        success = false;
+        if(projected)
+            return ValidateProjection(body, limbId, limb, validation, configuration, normal, current, success);
         return current;
     }
 
@@ -754,18 +967,19 @@ namespace hpp {
                        const sampling::OctreeReport& report, core::CollisionValidationPtr_t validation,
                        model::ConfigurationOut_t configuration, const hpp::rbprm::State& current, bool& success)
     {
-        sampling::Load(*report.sample_, configuration);
-        body->device_->currentConfiguration(configuration);
-        body->device_->computeForwardKinematics();
-        const fcl::Vec3f& normal = report.normal_;
-        const fcl::Vec3f& position = report.contact_.pos;
-        // the normal is given by the normal of the contacted object
-        const fcl::Vec3f z = limb->effector_->currentTransformation().getRotation() * limb->normal_;
-        const fcl::Matrix3f alignRotation = tools::GetRotationMatrix(z,normal);
-        const fcl::Matrix3f rotation = alignRotation * limb->effector_->currentTransformation().getRotation();
-        fcl::Vec3f posOffset = position - rotation * limb->offset_;
-        posOffset = posOffset + normal * epsilon;
-        return Project(body, limbId, limb, validation, configuration, rotation, setRotationConstraints(),posOffset, normal, current, success);
+        success = false;
+#ifdef PROFILE
+        RbPrmProfiler& watch = getRbPrmProfiler();
+        watch.start("ik");
+#endif
+        const bool projected = ProjectSampleLimb(body->device_, limb->effector_, limb, report, configuration,
+                                                 body->GetDampedLeastSquaresProjection());
+#ifdef PROFILE
+        watch.stop("ik");
+#endif
+        if(projected)
+            return ValidateProjection(body, limbId, limb, validation, configuration, report.normal_, current, success);
+        return current;
     }
   } // rbprm
 } //hpp
@@ -18,6 +18,14 @@
 #include <hpp/rbprm/sampling/sample-db.hh>
 #include <hpp/model/joint.hh>
 #include <hpp/rbprm/tools.hh>
+#include <hpp/rbprm/limb-collision-validation.hh>
+#include <hpp/core/collision-validation.hh>
+#include <hpp/core/collision-validation-report.hh>
+#include <hpp/core/relative-motion.hh>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
 
 namespace hpp {
   namespace rbprm {
@@ -25,19 +33,32 @@ namespace hpp {
     RbPrmLimbPtr_t RbPrmLimb::create (const model::JointPtr_t limb, const std::string& effectorName, const fcl::Vec3f &offset,
                                       const fcl::Vec3f &normal,const double x, const double y,
                                       const std::size_t nbSamples, const hpp::rbprm::sampling::heuristic evaluate, const double resolution,
-                                      hpp::rbprm::ContactType contactType, const bool disableEffectorCollision)
+                                      hpp::rbprm::ContactType contactType, const bool disableEffectorCollision,
+                                      const std::size_t nbThreads, const bool storeJacobians,
+                                      const sampling::SampleEncoding encoding)
     {
         RbPrmLimb* rbprmDevice = new RbPrmLimb(limb, effectorName, offset, normal, x, y, nbSamples,evaluate,
-                                               resolution, contactType, disableEffectorCollision);
+                                               resolution, contactType, disableEffectorCollision, nbThreads, storeJacobians, encoding);
         RbPrmLimbPtr_t res (rbprmDevice);
         res->init (res);
         return res;
     }
 
     RbPrmLimbPtr_t RbPrmLimb::create (const model::DevicePtr_t device, std::ifstream& fileStream, const bool loadValues,
-                                      const hpp::rbprm::sampling::heuristic evaluate, const bool disableEffectorCollision)
+                                      const hpp::rbprm::sampling::heuristic evaluate, const bool disableEffectorCollision,
+                                      const sampling::SampleDBPtr_t& sharedDatabase)
+    {
+        RbPrmLimb* rbprmDevice = new RbPrmLimb(device, fileStream, loadValues, evaluate, disableEffectorCollision, sharedDatabase);
+        RbPrmLimbPtr_t res (rbprmDevice);
+        res->init (res);
+        return res;
+    }
+
+    RbPrmLimbPtr_t RbPrmLimb::create (const model::DevicePtr_t device, const sampling::binary::MappedFilePtr_t& file,
+                                      const bool loadValues, const hpp::rbprm::sampling::heuristic evaluate,
+                                      const bool disableEffectorCollision, const sampling::SampleDBPtr_t& sharedDatabase)
     {
-        RbPrmLimb* rbprmDevice = new RbPrmLimb(device, fileStream, loadValues, evaluate, disableEffectorCollision);
+        RbPrmLimb* rbprmDevice = new RbPrmLimb(device, file, loadValues, evaluate, disableEffectorCollision, sharedDatabase);
         RbPrmLimbPtr_t res (rbprmDevice);
         res->init (res);
         return res;
@@ -79,7 +100,8 @@ namespace hpp {
     RbPrmLimb::RbPrmLimb (const model::JointPtr_t& limb, const std::string& effectorName,
                           const fcl::Vec3f &offset, const fcl::Vec3f &normal, const double x, const double y, const std::size_t nbSamples,
                           const hpp::rbprm::sampling::heuristic evaluate, const double resolution, ContactType contactType,
-                          bool disableEndEffectorCollision)
+                          bool disableEndEffectorCollision, const std::size_t nbThreads, const bool storeJacobians,
+                          const sampling::SampleEncoding encoding)
         : limb_(limb)
         , effector_(GetEffector(limb, effectorName))
         , effectorDefaultRotation_(GetEffectorTransform(limb))
@@ -89,8 +111,12 @@ namespace hpp {
         , y_(y)
         , contactType_(contactType)
         , evaluate_(evaluate)
-        , sampleContainer_(limb, effector_->name(), nbSamples, offset, resolution)
+        , sampleDatabase_(new sampling::SampleDB(limb, effector_->name(), nbSamples, offset, resolution, sampling::T_evaluate(), "",
+                                                 nbThreads, storeJacobians, encoding))
+        , sampleContainer_(*sampleDatabase_)
         , disableEndEffectorCollision_(disableEndEffectorCollision)
+        , fallbackOctree_(0)
+        , fallbackNbSamples_(0)
     {
         // NOTHING
     }
@@ -100,6 +126,47 @@ namespace hpp {
         return limb_->parentJoint()->currentTransformation();
     }
 
+    void ComputeFallbackSamples(RbPrmLimb& limb, const core::CollisionValidationPtr_t& validation,
+                                const std::size_t maxSamples)
+    {
+        const sampling::T_Sample& samples = limb.sampleContainer_.samples_;
+        // effector positions are expressed in the frame of the limb parent, as the octree
+        const fcl::Vec3f origin = (fcl::inverse(limb.limb_->parentJoint()->currentTransformation())
+                                   * limb.limb_->currentTransformation()).getTranslation();
+        std::vector<std::pair<double, std::size_t> > distances;
+        distances.reserve(samples.size());
+        for(std::size_t i = 0; i < samples.size(); ++i)
+            distances.push_back(std::make_pair((samples[i].effectorPosition() - origin).norm(), i));
+        std::sort(distances.begin(), distances.end());
+        model::Configuration_t configuration = limb.limb_->robot()->currentConfiguration();
+        core::ValidationReportPtr_t valRep (new core::CollisionValidationReport);
+        limb.fallbackSamples_.clear();
+        for(std::vector<std::pair<double, std::size_t> >::const_iterator cit = distances.begin();
+            cit != distances.end() && limb.fallbackSamples_.size() < maxSamples; ++cit)
+        {
+            sampling::Load(samples[cit->second], configuration);
+            if(validation->validate(configuration, valRep))
+                limb.fallbackSamples_.push_back(cit->second);
+        }
+        limb.fallbackOctree_ = limb.sampleContainer_.geometry_.get();
+        limb.fallbackNbSamples_ = samples.size();
+    }
+
+    const std::vector<std::size_t>& GetFallbackSamples(RbPrmLimb& limb, const std::size_t maxSamples)
+    {
+        const sampling::SampleDB& database = limb.sampleContainer_;
+        // sample positions change when samples are added, pruned or sorted
+        if(limb.fallbackOctree_ != database.geometry_.get() || limb.fallbackNbSamples_ != database.samples_.size()
+                || !database.pendingSamplesInVoxels_.empty())
+        {
+            const model::DevicePtr_t device = limb.limb_->robot();
+            LimbCollisionValidationPtr_t validation = LimbCollisionValidation::create(device, limb.limb_);
+            validation->filterCollisionPairs(core::RelativeMotion::matrix(device));
+            ComputeFallbackSamples(limb, validation, maxSamples);
+        }
+        return limb.fallbackSamples_;
+    }
+
     bool saveLimbInfoAndDatabase(const hpp::rbprm::RbPrmLimbPtr_t limb, std::ofstream& fp)
     {
         fp << limb->limb_->name() << std::endl;
@@ -112,6 +179,120 @@ namespace hpp {
         fp << (int)limb->contactType_ << std::endl;
         return sampling::saveLimbDatabase(limb->sampleContainer_,fp);
     }
+
+    namespace
+    {
+        template<typename T>
+        void writeBinary(std::ostream& output, const T& data)
+        {
+            output.write(reinterpret_cast<const char*>(&data), sizeof(T));
+        }
+
+        sampling::binary::LimbHeader makeLimbHeader(const std::string& limbName, const std::string& effectorName,
+                                                    const fcl::Matrix3f& effectorDefaultRotation, const fcl::Vec3f& offset,
+                                                    const fcl::Vec3f& normal, const double x, const double y,
+                                                    const int contactType)
+        {
+            using namespace sampling::binary;
+            LimbHeader header;
+            WriteName(limbName, header.limb_, NAME_SIZE);
+            WriteName(effectorName, header.effector_, NAME_SIZE);
+            for(std::size_t i = 0; i < 3; ++i)
+            {
+                for(std::size_t j = 0; j < 3; ++j)
+                    header.effectorDefaultRotation_[3*i+j] = effectorDefaultRotation(i,j);
+                header.offset_[i] = offset[i];
+                header.normal_[i] = normal[i];
+            }
+            header.x_ = x;
+            header.y_ = y;
+            header.contactType_ = contactType;
+            return header;
+        }
+
+        void writeLimbHeader(const std::string& limbName, const std::string& effectorName,
+                             const fcl::Matrix3f& effectorDefaultRotation, const fcl::Vec3f& offset,
+                             const fcl::Vec3f& normal, const double x, const double y,
+                             const int contactType, std::ofstream& fp)
+        {
+            writeBinary(fp, sampling::binary::MakeFileHeader());
+            writeBinary(fp, makeLimbHeader(limbName, effectorName, effectorDefaultRotation, offset, normal, x, y, contactType));
+        }
+    }
+
+    bool saveLimbInfoAndDatabaseBinary(const hpp::rbprm::RbPrmLimbPtr_t limb, std::ofstream& fp)
+    {
+        writeLimbHeader(limb->limb_->name(), limb->effector_->name(), limb->effectorDefaultRotation_,
+                        limb->offset_, limb->normal_, limb->x_, limb->y_, (int)limb->contactType_, fp);
+        return sampling::saveLimbDatabaseBinary(limb->sampleContainer_,fp);
+    }
+
+    bool convertLimbDatabase(const std::string& textFile, const std::string& binaryFile)
+    {
+        std::ifstream myfile (textFile.c_str());
+        if (!myfile.good())
+            throw std::runtime_error ("Impossible to open database " + textFile);
+        std::string limbName, effectorName;
+        getline(myfile, limbName);
+        getline(myfile, effectorName);
+        const fcl::Matrix3f rotation = tools::io::readRotMatrixFCL(myfile);
+        const fcl::Vec3f offset = tools::io::readVecFCL(myfile);
+        const fcl::Vec3f normal = tools::io::readVecFCL(myfile);
+        const double x = tools::io::StrToD(myfile);
+        const double y = tools::io::StrToD(myfile);
+        const int contactType = tools::io::StrToI(myfile);
+        const sampling::SampleDB database(myfile, true);
+        myfile.close();
+        std::ofstream fp (binaryFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fp.good())
+            throw std::runtime_error ("Impossible to write database " + binaryFile);
+        writeLimbHeader(limbName, effectorName, rotation, offset, normal, x, y, contactType, fp);
+        bool res = sampling::saveLimbDatabaseBinary(database, fp);
+        fp.close();
+        return res;
+    }
+
+    sampling::PruningReport pruneLimbDatabase(const std::string& inputFile, const std::string& binaryFile,
+                                              const std::size_t maxSamplesPerVoxel,
+                                              const sampling::PruningCriterion criterion, const std::string& valueName)
+    {
+        sampling::binary::LimbHeader limbHeader;
+        sampling::SampleDBPtr_t database;
+        if(sampling::binary::IsBinaryDatabase(inputFile))
+        {
+            sampling::binary::MappedFilePtr_t file = sampling::binary::MappedFile::create(inputFile);
+            limbHeader = file->limbHeader();
+            database = sampling::SampleDBPtr_t(new sampling::SampleDB(file, file->databaseOffset(), true));
+        }
+        else
+        {
+            std::ifstream myfile (inputFile.c_str());
+            if (!myfile.good())
+                throw std::runtime_error ("Impossible to open database " + inputFile);
+            std::string limbName, effectorName;
+            getline(myfile, limbName);
+            getline(myfile, effectorName);
+            const fcl::Matrix3f rotation = tools::io::readRotMatrixFCL(myfile);
+            const fcl::Vec3f offset = tools::io::readVecFCL(myfile);
+            const fcl::Vec3f normal = tools::io::readVecFCL(myfile);
+            const double x = tools::io::StrToD(myfile);
+            const double y = tools::io::StrToD(myfile);
+            const int contactType = tools::io::StrToI(myfile);
+            database = sampling::SampleDBPtr_t(new sampling::SampleDB(myfile, true));
+            myfile.close();
+            limbHeader = makeLimbHeader(limbName, effectorName, rotation, offset, normal, x, y, contactType);
+        }
+        const sampling::PruningReport report = sampling::prune(*database, maxSamplesPerVoxel, criterion, valueName);
+        std::ofstream fp (binaryFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fp.good())
+            throw std::runtime_error ("Impossible to write database " + binaryFile);
+        writeBinary(fp, sampling::binary::MakeFileHeader());
+        writeBinary(fp, limbHeader);
+        if(!sampling::saveLimbDatabaseBinary(*database, fp))
+            throw std::runtime_error ("Impossible to write database " + binaryFile);
+        fp.close();
+        return report;
+    }
   } // rbprm
 
 
@@ -126,6 +307,24 @@ namespace hpp {
             return device->getJointByName(name);
         }
 
+        fcl::Matrix3f readRotMatrix(const double* data)
+        {
+            fcl::Matrix3f res;
+            for(int i =0; i< 3; ++i)
+            {
+                for(int j =0; j< 3; ++j)
+                {
+                    res(i,j) = data[3*i+j];
+                }
+            }
+            return res;
+        }
+
+        fcl::Vec3f readVec(const double* data)
+        {
+            return fcl::Vec3f(data[0], data[1], data[2]);
+        }
+
         std::ostream& operator << (std::ostream& out, hpp::rbprm::ContactType ctype)
         {
             unsigned u = ctype;
@@ -138,7 +337,7 @@ namespace hpp {
 
     hpp::rbprm::RbPrmLimb::RbPrmLimb (const model::DevicePtr_t device, std::ifstream& fileStream,
                         const bool loadValues, const hpp::rbprm::sampling::heuristic evaluate,
-                        bool disableEndEffectorCollision)
+                        bool disableEndEffectorCollision, const sampling::SampleDBPtr_t& sharedDatabase)
       : limb_(extractJoint(device,fileStream))
       , effector_(extractJoint(device,fileStream))
       , effectorDefaultRotation_(tools::io::readRotMatrixFCL(fileStream))
@@ -148,11 +347,40 @@ namespace hpp {
       , y_(StrToD(fileStream))
       , contactType_(static_cast<hpp::rbprm::ContactType>(StrToI(fileStream)))
       , evaluate_(evaluate)
-      , sampleContainer_(fileStream, loadValues)
+      , sampleDatabase_(sharedDatabase ? sharedDatabase : sampling::SampleDBPtr_t(new sampling::SampleDB(fileStream, loadValues)))
+      , sampleContainer_(*sampleDatabase_)
       , disableEndEffectorCollision_(disableEndEffectorCollision)
+      , fallbackOctree_(0)
+      , fallbackNbSamples_(0)
     {
       // NOTHING
     }
+
+    using hpp::rbprm::sampling::binary::ReadName;
+    using hpp::rbprm::sampling::binary::NAME_SIZE;
+
+    hpp::rbprm::RbPrmLimb::RbPrmLimb (const model::DevicePtr_t device, const sampling::binary::MappedFilePtr_t& file,
+                        const bool loadValues, const hpp::rbprm::sampling::heuristic evaluate,
+                        bool disableEndEffectorCollision, const sampling::SampleDBPtr_t& sharedDatabase)
+      : limb_(device->getJointByName(ReadName(file->limbHeader().limb_, NAME_SIZE)))
+      , effector_(device->getJointByName(ReadName(file->limbHeader().effector_, NAME_SIZE)))
+      , effectorDefaultRotation_(readRotMatrix(file->limbHeader().effectorDefaultRotation_))
+      , offset_(readVec(file->limbHeader().offset_))
+      , normal_(readVec(file->limbHeader().normal_))
+      , x_(file->limbHeader().x_)
+      , y_(file->limbHeader().y_)
+      , contactType_(static_cast<hpp::rbprm::ContactType>(file->limbHeader().contactType_))
+      , evaluate_(evaluate)
+      , sampleDatabase_(sharedDatabase ? sharedDatabase
+                                       : sampling::SampleDBPtr_t(new sampling::SampleDB(file, file->databaseOffset(), loadValues)))
+      , sampleContainer_(*sampleDatabase_)
+      , disableEndEffectorCollision_(disableEndEffectorCollision)
+      , fallbackOctree_(0)
+      , fallbackNbSamples_(0)
+    {
+      if(!sampleContainer_.storage_->storeJacobians_ && !sampleContainer_.storage_->jacobianCache_)
+          sampleContainer_.storage_->jacobianCache_ = sampling::JacobianCache::create(limb_, effector_->name());
+    }
 } //hpp
 
 
@@ -15,6 +15,7 @@
 // hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
 
 #include <hpp/rbprm/rbprm-shooter.hh>
+#include <hpp/rbprm/sampling/affordance-geometry.hh>
 #include <hpp/model/collision-object.hh>
 #include <hpp/model/joint.hh>
 #include <hpp/fcl/collision_object.h>
@@ -39,16 +40,6 @@ namespace
         return model;
     }
 
-    double TriangleArea(rbprm::TrianglePoints& tri)
-    {
-        double a, b, c;
-        a = (tri.p1 - tri.p2).norm();
-        b = (tri.p2 - tri.p3).norm();
-        c = (tri.p3 - tri.p1).norm();
-        double s = 0.5 * (a + b + c);
-        return sqrt(s * (s-a) * (s-b) * (s-c));
-    }
-
     std::vector<double> getTranslationBounds(const model::RbPrmDevicePtr_t robot)
     {
         const JointPtr_t root = robot->Device::rootJoint();
@@ -230,6 +221,8 @@ namespace
         {
             const  fcl::CollisionObjectPtr_t& colObj = (*objit)->fcl();
             BVHModelOBConst_Ptr_t model =  GetModel(colObj); // TODO NOT TRIANGLES
+            // normals and areas are shared with the contact candidate queries
+            const rbprm::sampling::AffordanceGeometryConstPtr_t geometry = rbprm::sampling::AffordanceGeometry::Get(model);
             for(int i =0; i < model->num_tris; ++i)
             {
                 TrianglePoints tri;
@@ -237,12 +230,10 @@ namespace
                 tri.p1 = colObj->getRotation() * model->vertices[fcltri[0]] + colObj->getTranslation();
                 tri.p2 = colObj->getRotation() * model->vertices[fcltri[1]] + colObj->getTranslation();
                 tri.p3 = colObj->getRotation() * model->vertices[fcltri[2]] + colObj->getTranslation();;
-                double weight = TriangleArea(tri);
+                double weight = geometry->areas_[i];
                 sum += weight;
                 weights_.push_back(weight);
-                fcl::Vec3f normal = (tri.p2 - tri.p1).cross(tri.p3 - tri.p1);
-                normal.normalize();
-                triangles_.push_back(std::make_pair(normal,tri));
+                triangles_.push_back(std::make_pair(colObj->getRotation() * geometry->normals_[i],tri));
             }
             double previousWeight = 0;
             for(std::vector<double>::iterator wit = weights_.begin();
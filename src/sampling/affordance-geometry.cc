@@ -0,0 +1,98 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/affordance-geometry.hh>
+#include <hpp/fcl/BVH/BVH_model.h>
+
+#include <boost/weak_ptr.hpp>
+
+#include <map>
+#include <stdexcept>
+
+using namespace hpp::rbprm::sampling;
+
+namespace
+{
+    typedef std::pair<boost::weak_ptr<const fcl::CollisionGeometry>, AffordanceGeometryConstPtr_t> T_Entry;
+    typedef std::map<const fcl::CollisionGeometry*, T_Entry> T_Geometries;
+
+    // geometries are identified by the address of their mesh. The mesh is
+    // referenced weakly, so that an entry is not reused for another mesh
+    // allocated at the same address.
+    T_Geometries& geometries()
+    {
+        static T_Geometries instance;
+        return instance;
+    }
+
+    void purge(T_Geometries& entries)
+    {
+        for(T_Geometries::iterator it = entries.begin(); it != entries.end();)
+        {
+            if(it->second.first.expired())
+                entries.erase(it++);
+            else
+                ++it;
+        }
+    }
+}
+
+AffordanceGeometryConstPtr_t AffordanceGeometry::Get(const boost::shared_ptr<const fcl::CollisionGeometry>& mesh)
+{
+    AffordanceGeometryConstPtr_t res;
+    #pragma omp critical (rbprm_affordance_geometry)
+    {
+        T_Geometries& entries = geometries();
+        T_Geometries::const_iterator cit = entries.find(mesh.get());
+        if(cit != entries.end() && !cit->second.first.expired())
+            res = cit->second.second;
+    }
+    if(res)
+        return res;
+    // computed outside of the critical section, another thread may compute the same mesh
+    res = AffordanceGeometryConstPtr_t(new AffordanceGeometry(*mesh));
+    #pragma omp critical (rbprm_affordance_geometry)
+    {
+        T_Geometries& entries = geometries();
+        purge(entries);
+        T_Entry& entry = entries[mesh.get()];
+        if(entry.first.expired())
+            entry = std::make_pair(boost::weak_ptr<const fcl::CollisionGeometry>(mesh), res);
+        else
+            res = entry.second;
+    }
+    return res;
+}
+
+AffordanceGeometry::AffordanceGeometry(const fcl::CollisionGeometry& mesh)
+{
+    if(mesh.getObjectType() != fcl::OT_BVH || mesh.getNodeType() != fcl::BV_OBBRSS)
+        throw std::runtime_error ("Affordance objects must be BVHModel<OBBRSS> meshes");
+    const fcl::BVHModel<fcl::OBBRSS>& model = static_cast<const fcl::BVHModel<fcl::OBBRSS>&>(mesh);
+    normals_.reserve(model.num_tris);
+    areas_.reserve(model.num_tris);
+    for(int i = 0; i < model.num_tris; ++i)
+    {
+        const fcl::Triangle& tr = model.tri_indices[i];
+        const fcl::Vec3f& v1 = model.vertices[tr[0]];
+        const fcl::Vec3f& v2 = model.vertices[tr[1]];
+        const fcl::Vec3f& v3 = model.vertices[tr[2]];
+        fcl::Vec3f normal = (v2 - v1).cross(v3 - v1);
+        areas_.push_back(0.5 * normal.norm());
+        normal.normalize();
+        normals_.push_back(normal);
+    }
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/affordance-index.hh>
+
+#include <algorithm>
+
+using namespace hpp::rbprm::sampling;
+
+namespace
+{
+    const std::size_t MAX_LEAF_SIZE = 4;
+
+    struct center_compare
+    {
+        center_compare(const std::vector<fcl::AABB>& boxes, const int axis) : boxes_(boxes), axis_(axis) {}
+        bool operator() (const std::size_t lhs, const std::size_t rhs) const
+        {
+            return boxes_[lhs].center()[axis_] < boxes_[rhs].center()[axis_];
+        }
+        const std::vector<fcl::AABB>& boxes_;
+        const int axis_;
+    };
+}
+
+AffordanceIndexPtr_t AffordanceIndex::create(const model::ObjectVector_t& objects)
+{
+    return AffordanceIndexPtr_t(new AffordanceIndex(objects));
+}
+
+AffordanceIndex::AffordanceIndex(const model::ObjectVector_t& objects)
+    : objects_(objects)
+{
+    for(model::ObjectVector_t::const_iterator oit = objects.begin(); oit != objects.end(); ++oit)
+    {
+        boxes_.push_back((*oit)->fcl()->getAABB());
+        order_.push_back(order_.size());
+    }
+    if(!objects.empty())
+    {
+        nodes_.reserve(2 * objects.size() / MAX_LEAF_SIZE + 1);
+        build(0, objects.size());
+    }
+}
+
+std::size_t AffordanceIndex::build(const std::size_t first, const std::size_t last)
+{
+    const std::size_t id = nodes_.size();
+    nodes_.push_back(Node());
+    fcl::AABB box = boxes_[order_[first]];
+    for(std::size_t i = first + 1; i < last; ++i)
+        box += boxes_[order_[i]];
+    nodes_[id].box_ = box;
+    nodes_[id].first_ = first;
+    nodes_[id].last_ = last;
+    nodes_[id].right_ = 0;
+    if(last - first > MAX_LEAF_SIZE)
+    {
+        // median split along the largest dimension of the box
+        int axis = 0;
+        if(box.height() > box.width()) axis = 1;
+        if(box.depth() > std::max(box.width(), box.height())) axis = 2;
+        const std::size_t middle = first + (last - first) / 2;
+        std::nth_element(order_.begin() + first, order_.begin() + middle, order_.begin() + last,
+                         center_compare(boxes_, axis));
+        build(first, middle);
+        const std::size_t right = build(middle, last);
+        nodes_[id].right_ = right;
+    }
+    return id;
+}
+
+void AffordanceIndex::query(const fcl::AABB& box, std::vector<std::size_t>& result) const
+{
+    result.clear();
+    if(nodes_.empty())
+        return;
+    std::vector<std::size_t> stack(1, 0);
+    while(!stack.empty())
+    {
+        const Node& node = nodes_[stack.back()];
+        const std::size_t id = stack.back();
+        stack.pop_back();
+        if(!node.box_.overlap(box))
+            continue;
+        if(node.right_ == 0)
+        {
+            for(std::size_t i = node.first_; i < node.last_; ++i)
+                if(boxes_[order_[i]].overlap(box))
+                    result.push_back(order_[i]);
+        }
+        else
+        {
+            stack.push_back(node.right_);
+            stack.push_back(id + 1);
+        }
+    }
+    std::sort(result.begin(), result.end());
+}
@@ -39,13 +39,14 @@ namespace
 
     Eigen::JacobiSVD<Eigen::MatrixXd> svd(const sampling::Sample& sample, const JacobianMode mode)
     {
+        const Eigen::MatrixXd jacobian = sample.jacobian();
         switch (mode) {
         case ALL:
-            return Eigen::JacobiSVD<Eigen::MatrixXd>(sample.jacobian_);
+            return Eigen::JacobiSVD<Eigen::MatrixXd>(jacobian);
         case TRANSLATION:
-            return Eigen::JacobiSVD<Eigen::MatrixXd>(sample.jacobian_.block(0,0,3,sample.jacobian_.cols()));
+            return Eigen::JacobiSVD<Eigen::MatrixXd>(jacobian.block(0,0,3,jacobian.cols()));
         case ROTATION:
-            return Eigen::JacobiSVD<Eigen::MatrixXd>(sample.jacobian_.block(3,0,3,sample.jacobian_.cols()));
+            return Eigen::JacobiSVD<Eigen::MatrixXd>(jacobian.block(3,0,3,jacobian.cols()));
         default:
             throw std::runtime_error ("Can not perform SVD on subjacobian, unknown JacobianMode");
             break;
@@ -58,14 +59,14 @@ namespace
         Eigen::MatrixXd sub;
         switch (mode) {
         case ALL:
-            det = sample.jacobianProduct_.determinant();
+            det = sample.jacobianProduct().determinant();
             break;
         case TRANSLATION:
-            sub = sample.jacobian_.block(0,0,3,sample.jacobian_.cols());
+            sub = sample.jacobian().topRows(3);
             det = (sub*sub.transpose()).determinant();
             break;
         case ROTATION:
-            sub = sample.jacobian_.block(3,0,3,sample.jacobian_.cols());
+            sub = sample.jacobian().bottomRows(3);
             det = (sub*sub.transpose()).determinant();
             break;
         default:
@@ -116,6 +117,69 @@ namespace
         return  max;
     }
 
+    enum AnalysisMode
+    {
+      MANIPULABILITY  = 0,
+      ISOTROPY        = 1,
+      MIN_SINGULAR    = 2,
+      MAX_SINGULAR    = 3
+    };
+
+    // Same values as the functions above, the singular values of the jacobian being obtained
+    // from the eigen values of the fixed size product of the jacobian by its transpose.
+    // A Rows x rank jacobian only has min(Rows, rank) singular values, the other eigen values are 0.
+    template<int Rows>
+    double analyse(const AnalysisMode analysis, const Eigen::Matrix<double, Rows, Rows>& product, const int rank)
+    {
+        if(analysis == MANIPULABILITY)
+        {
+            const double det = product.determinant();
+            return det > 0 ? sqrt(det) : 0;
+        }
+        const Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, Rows, Rows> > solver(product, Eigen::EigenvaluesOnly);
+        const Eigen::Matrix<double, Rows, 1>& eigenValues = solver.eigenvalues(); // increasing order
+        const double min = sqrt(std::max(eigenValues[Rows - std::min(Rows, rank)], 0.));
+        const double max = sqrt(std::max(eigenValues[Rows - 1], 0.));
+        switch (analysis) {
+        case ISOTROPY:
+            return  (max > 0) ? 1 - sqrt(1 - min*min / max* max) : 0;
+        case MIN_SINGULAR:
+            return min;
+        default:
+            return max;
+        }
+    }
+
+    void analyseBlock(const JacobianMode mode, const AnalysisMode analysis, const SampleDB& /*sampleDB*/,
+                      const sampling::Sample* samples, const std::size_t nbSamples, double* values)
+    {
+        Eigen::MatrixXd jacobian;
+        Eigen::Matrix3d product;
+        for(std::size_t i = 0; i < nbSamples; ++i)
+        {
+            const sampling::Sample& sample = samples[i];
+            const int rank = (int)sample.storage_->jacobianCols_;
+            switch (mode) {
+            case ALL:
+                values[i] = analyse<6>(analysis, sample.jacobianProduct(), rank);
+                break;
+            case TRANSLATION:
+                jacobian = sample.jacobian();
+                product.noalias() = jacobian.topRows<3>() * jacobian.topRows<3>().transpose();
+                values[i] = analyse<3>(analysis, product, rank);
+                break;
+            case ROTATION:
+                jacobian = sample.jacobian();
+                product.noalias() = jacobian.bottomRows<3>() * jacobian.bottomRows<3>().transpose();
+                values[i] = analyse<3>(analysis, product, rank);
+                break;
+            default:
+                throw std::runtime_error ("Can not compute subjacobian, unknown JacobianMode");
+                break;
+            }
+        }
+    }
+
 
     struct FullBodyDB
     {
@@ -157,13 +221,9 @@ namespace
 
     FullBodyDB* FullBodyDB::instance_ = new FullBodyDB;
 
-    // computing probability of auto collision given a large number of full body samples
-    double selfCollisionProbability(rbprm::RbPrmFullBodyPtr_t fullBody , const SampleDB& /*sampleDB*/, const sampling::Sample& sample)
+    double collisionFreeRatio(model::DevicePtr_t device, core::CollisionValidationPtr_t colVal,
+                              const FullBodyDB& fullBodyDB, const sampling::Sample& sample)
     {
-        model::DevicePtr_t device = fullBody->device_;
-        model::Configuration_t save(device->currentConfiguration());
-        FullBodyDB& fullBodyDB = FullBodyDB::Instance(device);
-        core::CollisionValidationPtr_t colVal = core::CollisionValidation::create(device);
         std::size_t totalSamples = fullBodyDB.fullBodyConfigs_.size(), totalNoCollisions =  0;
         for(std::vector<model::Configuration_t>::const_iterator cit = fullBodyDB.fullBodyConfigs_.begin();
             cit != fullBodyDB.fullBodyConfigs_.end(); ++cit)
@@ -176,9 +236,36 @@ namespace
             if (colVal->validate(conf,colRep))
                 ++totalNoCollisions;
         }
+        return (double)(totalNoCollisions) / (double)(totalSamples);
+    }
+
+    // computing probability of auto collision given a large number of full body samples
+    double selfCollisionProbability(rbprm::RbPrmFullBodyPtr_t fullBody , const SampleDB& /*sampleDB*/, const sampling::Sample& sample)
+    {
+        model::DevicePtr_t device = fullBody->device_;
+        model::Configuration_t save(device->currentConfiguration());
+        FullBodyDB& fullBodyDB = FullBodyDB::Instance(device);
+        core::CollisionValidationPtr_t colVal = core::CollisionValidation::create(device);
+        const double res = collisionFreeRatio(device, colVal, fullBodyDB, sample);
         device->currentConfiguration(save);
         device->computeForwardKinematics();
-        return (double)(totalNoCollisions) / (double)(totalSamples);
+        return res;
+    }
+
+    // thread safe version, each block working on its own copy of the robot
+    void selfCollisionProbabilityBlock(rbprm::RbPrmFullBodyPtr_t fullBody , const SampleDB& /*sampleDB*/,
+                                       const sampling::Sample* samples, const std::size_t nbSamples, double* values)
+    {
+        model::DevicePtr_t device;
+        FullBodyDB* fullBodyDB;
+        #pragma omp critical (rbprm_self_collision_probability)
+        {
+            fullBodyDB = &FullBodyDB::Instance(fullBody->device_);
+            device = fullBody->device_->clone();
+        }
+        core::CollisionValidationPtr_t colVal = core::CollisionValidation::create(device);
+        for(std::size_t i = 0; i < nbSamples; ++i)
+            values[i] = collisionFreeRatio(device, colVal, *fullBodyDB, samples[i]);
     }
 
     void distanceRec(const ConfigurationIn_t conf, const std::string& lastJoint, model::JointPtr_t currentJoint, double& currentDistance)
@@ -202,7 +289,7 @@ namespace
         rbprm::T_Limb::const_iterator cit = fullBody->GetLimbs().begin();
         for(; cit != fullBody->GetLimbs().end(); ++cit)
         {
-            if(cit->second->limb_->rankInConfiguration() == sample.startRank_)
+            if(cit->second->limb_->rankInConfiguration() == sample.startRank())
                 break;
         }
         if(cit == fullBody->GetLimbs().end())
@@ -240,6 +327,17 @@ AnalysisFactory::AnalysisFactory(hpp::rbprm::RbPrmFullBodyPtr_t device)
 
     evaluate_.insert(std::make_pair("selfCollisionProbability", boost::bind(&selfCollisionProbability, boost::ref(device_), _1, _2)));
     evaluate_.insert(std::make_pair("jointLimitsDistance", boost::bind(&distanceToLimits, boost::ref(device_), _1, _2)));
+
+    const std::string suffixes[3] = {"", "Rot", "Tr"};
+    for(int mode = 0; mode < 3; ++mode)
+    {
+        batchEvaluate_.insert(std::make_pair("manipulability" + suffixes[mode], boost::bind(&analyseBlock, JacobianMode(mode), MANIPULABILITY, _1, _2, _3, _4)));
+        batchEvaluate_.insert(std::make_pair("isotropy" + suffixes[mode], boost::bind(&analyseBlock, JacobianMode(mode), ISOTROPY, _1, _2, _3, _4)));
+        batchEvaluate_.insert(std::make_pair("minimumSingularValue" + suffixes[mode], boost::bind(&analyseBlock, JacobianMode(mode), MIN_SINGULAR, _1, _2, _3, _4)));
+        batchEvaluate_.insert(std::make_pair("maximumSingularValue" + suffixes[mode], boost::bind(&analyseBlock, JacobianMode(mode), MAX_SINGULAR, _1, _2, _3, _4)));
+    }
+    batchEvaluate_.insert(std::make_pair("selfCollisionProbability", boost::bind(&selfCollisionProbabilityBlock, boost::ref(device_), _1, _2, _3, _4)));
+    batchEvaluate_.insert(std::make_pair("jointLimitsDistance", MakeBatchEvaluate(evaluate_["jointLimitsDistance"])));
 }
 
 AnalysisFactory::~AnalysisFactory(){}
@@ -249,5 +347,6 @@ bool AnalysisFactory::AddAnalysis(const std::string& name, const evaluate func)
     if(evaluate_.find(name) != evaluate_.end())
         return false;
     evaluate_.insert(std::make_pair(name,func));
+    batchEvaluate_.insert(std::make_pair(name,MakeBatchEvaluate(func)));
     return true;
 }
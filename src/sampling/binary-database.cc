@@ -0,0 +1,99 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/binary-database.hh>
+
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+
+using namespace hpp::rbprm::sampling::binary;
+
+namespace
+{
+    const char MAGIC[8] = {'R','B','P','R','M','D','B','\0'};
+}
+
+MappedFilePtr_t MappedFile::create(const std::string& filename)
+{
+    return MappedFilePtr_t(new MappedFile(filename));
+}
+
+MappedFile::MappedFile(const std::string& filename)
+{
+    try
+    {
+        file_ = boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only);
+        region_ = boost::interprocess::mapped_region(file_, boost::interprocess::read_only);
+    }
+    catch(const boost::interprocess::interprocess_exception& e)
+    {
+        throw std::runtime_error ("Impossible to map database " + filename + ": " + e.what());
+    }
+    if(size() < sizeof(FileHeader) + sizeof(LimbHeader))
+        throw std::runtime_error ("Impossible to open database " + filename + "; file is too small");
+    const FileHeader& header = fileHeader();
+    if(std::memcmp(header.magic_, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error ("Impossible to open database " + filename + "; not a binary database");
+    if(header.version_ != FORMAT_VERSION)
+        throw std::runtime_error ("Impossible to open database " + filename + "; unsupported format version");
+}
+
+const FileHeader& MappedFile::fileHeader() const
+{
+    return *reinterpret_cast<const FileHeader*>(data());
+}
+
+const LimbHeader& MappedFile::limbHeader() const
+{
+    return *reinterpret_cast<const LimbHeader*>(data() + sizeof(FileHeader));
+}
+
+std::size_t MappedFile::databaseOffset() const
+{
+    return sizeof(FileHeader) + sizeof(LimbHeader);
+}
+
+bool hpp::rbprm::sampling::binary::IsBinaryDatabase(const std::string& filename)
+{
+    std::ifstream myfile (filename.c_str(), std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    if(!myfile.read(magic, sizeof(MAGIC)))
+        return false;
+    return std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+FileHeader hpp::rbprm::sampling::binary::MakeFileHeader()
+{
+    FileHeader header;
+    std::memcpy(header.magic_, MAGIC, sizeof(MAGIC));
+    header.version_ = FORMAT_VERSION;
+    header.flags_ = 0;
+    return header;
+}
+
+void hpp::rbprm::sampling::binary::WriteName(const std::string& name, char* field, const std::size_t fieldSize)
+{
+    if(name.size() >= fieldSize)
+        throw std::runtime_error ("Impossible to save database; name too long: " + name);
+    std::memset(field, 0, fieldSize);
+    std::memcpy(field, name.c_str(), name.size());
+}
+
+std::string hpp::rbprm::sampling::binary::ReadName(const char* field, const std::size_t fieldSize)
+{
+    return std::string(field, strnlen(field, fieldSize));
+}
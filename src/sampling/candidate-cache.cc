@@ -0,0 +1,112 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/candidate-cache.hh>
+#include <hpp/rbprm/sampling/sample-db.hh>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace hpp::rbprm::sampling;
+
+namespace
+{
+    // angle of the rotation between two orientations
+    double angle(const fcl::Matrix3f& a, const fcl::Matrix3f& b)
+    {
+        double trace = 0;
+        for(int i = 0; i < 3; ++i)
+            for(int j = 0; j < 3; ++j)
+                trace += a(i,j) * b(i,j);
+        return std::acos(std::max(-1., std::min(1., 0.5 * (trace - 1.))));
+    }
+
+    bool identical(const fcl::Transform3f& a, const fcl::Transform3f& b)
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            if(a.getTranslation()[i] != b.getTranslation()[i])
+                return false;
+            for(int j = 0; j < 3; ++j)
+                if(a.getRotation()(i,j) != b.getRotation()(i,j))
+                    return false;
+        }
+        return true;
+    }
+
+    bool close(const fcl::Transform3f& a, const fcl::Transform3f& b, const double translationThreshold, const double rotationThreshold)
+    {
+        return identical(a, b)
+            || ((a.getTranslation() - b.getTranslation()).norm() <= translationThreshold
+                && angle(a.getRotation(), b.getRotation()) <= rotationThreshold);
+    }
+}
+
+CandidateCache::CandidateCache(const double translationThreshold, const double rotationThreshold)
+    : translationThreshold_(translationThreshold)
+    , rotationThreshold_(rotationThreshold)
+    , hits_(0)
+    , misses_(0)
+{
+    // NOTHING
+}
+
+CandidateCache::EntryConstPtr_t CandidateCache::find(const SampleDB& sc, const fcl::Transform3f& treeTrf, const AffordanceIndex& affordances)
+{
+    EntryConstPtr_t entry;
+    #pragma omp critical (rbprm_candidate_cache)
+    {
+        entry = entry_;
+    }
+    // the octree voxel ids are only valid for the database state the collisions were computed with
+    const bool valid = entry
+            && entry->database_ == &sc && entry->octree_ == sc.geometry_.get() && entry->nbSamples_ == sc.samples_.size()
+            && entry->affordances_ == affordances.objects_
+            && close(entry->treeTrf_, treeTrf, translationThreshold_, rotationThreshold_);
+    #pragma omp critical (rbprm_candidate_cache)
+    {
+        if(valid)
+            ++hits_;
+        else
+            ++misses_;
+    }
+    return valid ? entry : EntryConstPtr_t();
+}
+
+void CandidateCache::store(const EntryConstPtr_t& entry)
+{
+    #pragma omp critical (rbprm_candidate_cache)
+    {
+        entry_ = entry;
+    }
+}
+
+void CandidateCache::clear()
+{
+    #pragma omp critical (rbprm_candidate_cache)
+    {
+        entry_.reset();
+    }
+}
+
+void CandidateCache::resetCounters()
+{
+    #pragma omp critical (rbprm_candidate_cache)
+    {
+        hits_ = 0;
+        misses_ = 0;
+    }
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/candidate-set.hh>
+
+using namespace hpp::rbprm::sampling;
+
+namespace
+{
+    // size of the first ordered chunk
+    const std::size_t MIN_ORDERED_CHUNK = 16;
+}
+
+OctreeReport::OctreeReport(const Sample* s, const fcl::Contact c, const double v, const fcl::Vec3f& normal)
+   : sample_(s)
+   , contact_(c)
+   , value_(v)
+   , normal_(normal)
+{
+   // NOTHING
+}
+
+CandidateSet::CandidateSet(const std::size_t maxSize)
+    : ordered_(0)
+    , maxSize_(maxSize)
+    , nextRank_(0)
+{
+    // NOTHING
+}
+
+void CandidateSet::clear()
+{
+    entries_.clear();
+    ordered_ = 0;
+    nextRank_ = 0;
+}
+
+void CandidateSet::insert(const OctreeReport& report)
+{
+    // the ordered prefix remains valid if the new candidate comes after it
+    if(ordered_ > 0 && report.value_ > entries_[ordered_ - 1].report_.value_)
+        ordered_ = 0;
+    entries_.push_back(Entry(report, nextRank_++));
+    truncate();
+}
+
+void CandidateSet::insert(const CandidateSet& other)
+{
+    entries_.reserve(entries_.size() + other.entries_.size());
+    for(std::vector<Entry>::const_iterator cit = other.entries_.begin(); cit != other.entries_.end(); ++cit)
+    {
+        if(ordered_ > 0 && cit->report_.value_ > entries_[ordered_ - 1].report_.value_)
+            ordered_ = 0;
+        entries_.push_back(Entry(cit->report_, nextRank_ + cit->rank_));
+    }
+    nextRank_ += other.nextRank_;
+    truncate();
+}
+
+void CandidateSet::order(const std::size_t pos) const
+{
+    // chunks grow geometrically, so that iterating over n candidates costs O(N log n)
+    const std::size_t chunk = std::max(pos + 1 - ordered_, std::max(ordered_, MIN_ORDERED_CHUNK));
+    const std::size_t last = std::min(entries_.size(), ordered_ + chunk);
+    std::partial_sort(entries_.begin() + ordered_, entries_.begin() + last, entries_.end(), entry_compare());
+    ordered_ = last;
+}
+
+void CandidateSet::truncate()
+{
+    // candidates are discarded by batches, once twice as many as required are stored
+    if(maxSize_ == std::numeric_limits<std::size_t>::max() || entries_.size() < 2 * maxSize_)
+        return;
+    std::nth_element(entries_.begin(), entries_.begin() + maxSize_, entries_.end(), entry_compare());
+    entries_.erase(entries_.begin() + maxSize_, entries_.end());
+    ordered_ = 0;
+}
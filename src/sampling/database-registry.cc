@@ -0,0 +1,127 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/database-registry.hh>
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace hpp::rbprm::sampling;
+
+namespace
+{
+    const boost::uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+    const boost::uint64_t FNV_PRIME  = 0x100000001b3ULL;
+
+    boost::uint64_t hashBuffer(boost::uint64_t hash, const char* data, const std::size_t size)
+    {
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+}
+
+DatabaseRegistry& DatabaseRegistry::Instance()
+{
+    static DatabaseRegistry instance;
+    return instance;
+}
+
+bool DatabaseRegistry::Key::operator<(const Key& other) const
+{
+    if(hash_ != other.hash_)
+        return hash_ < other.hash_;
+    if(loadValues_ != other.loadValues_)
+        return loadValues_ < other.loadValues_;
+    return filename_ < other.filename_;
+}
+
+SampleDBPtr_t DatabaseRegistry::find(const std::string& filename, const boost::uint64_t hash, const bool loadValues)
+{
+    const Key key = {filename, hash, loadValues};
+    SampleDBPtr_t res;
+    #pragma omp critical (rbprm_database_registry)
+    {
+        T_Database::const_iterator cit = databases_.find(key);
+        if(cit != databases_.end())
+            res = cit->second.lock();
+    }
+    return res;
+}
+
+SampleDBPtr_t DatabaseRegistry::insert(const std::string& filename, const boost::uint64_t hash, const bool loadValues,
+                                       const SampleDBPtr_t& database)
+{
+    const Key key = {filename, hash, loadValues};
+    SampleDBPtr_t res;
+    #pragma omp critical (rbprm_database_registry)
+    {
+        purge();
+        boost::weak_ptr<SampleDB>& entry = databases_[key];
+        res = entry.lock();
+        if(!res)
+        {
+            entry = database;
+            res = database;
+            // shared by the limbs using the registry
+            res->readOnly_ = true;
+        }
+    }
+    return res;
+}
+
+std::size_t DatabaseRegistry::size()
+{
+    std::size_t res;
+    #pragma omp critical (rbprm_database_registry)
+    {
+        purge();
+        res = databases_.size();
+    }
+    return res;
+}
+
+void DatabaseRegistry::purge()
+{
+    for(T_Database::iterator it = databases_.begin(); it != databases_.end();)
+    {
+        if(it->second.expired())
+            databases_.erase(it++);
+        else
+            ++it;
+    }
+}
+
+boost::uint64_t hpp::rbprm::sampling::ContentHash(const char* data, const std::size_t size)
+{
+    return hashBuffer(FNV_OFFSET, data, size);
+}
+
+boost::uint64_t hpp::rbprm::sampling::ContentHash(const std::string& filename)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if(!file.good())
+        throw std::runtime_error ("Impossible to open database " + filename);
+    std::vector<char> buffer(1 << 16);
+    boost::uint64_t hash = FNV_OFFSET;
+    while(file.read(&buffer[0], buffer.size()) || file.gcount() > 0)
+        hash = hashBuffer(hash, &buffer[0], (std::size_t)file.gcount());
+    return hash;
+}
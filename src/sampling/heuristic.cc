@@ -26,25 +26,34 @@ using namespace hpp::rbprm::sampling;
 
 namespace
 {
+// heuristics are evaluated for every candidate sample, so sample data is read without allocation
+typedef Eigen::Matrix <model::value_type, 6, 6> JacobianProduct_t;
+typedef Eigen::Matrix <model::value_type, Eigen::Dynamic, 1, Eigen::ColMajor, 64, 1> LimbConfiguration_t;
+
+double EFORT(const sampling::Sample& sample, const Eigen::Vector3d& direction)
+{
+    JacobianProduct_t jacobianProduct;
+    sample.jacobianProduct(jacobianProduct);
+    return -direction.transpose() * jacobianProduct.block<3,3>(0,0) * (-direction);
+}
+
 double EFORTHeuristic(const sampling::Sample& sample,
                       const Eigen::Vector3d& direction, const Eigen::Vector3d& normal)
 {
-    double EFORT = -direction.transpose() * sample.jacobianProduct_.block<3,3>(0,0) * (-direction);
-    return EFORT * Eigen::Vector3d::UnitZ().dot(normal);
+    return EFORT(sample, direction) * Eigen::Vector3d::UnitZ().dot(normal);
 }
 
 double EFORTNormalHeuristic(const sampling::Sample& sample,
                       const Eigen::Vector3d& direction, const Eigen::Vector3d& normal)
 {
-    double EFORT = -direction.transpose() * sample.jacobianProduct_.block<3,3>(0,0) * (-direction);
-    return EFORT * direction.dot(normal);
+    return EFORT(sample, direction) * direction.dot(normal);
 }
 
 double ManipulabilityHeuristic(const sampling::Sample& sample,
                                const Eigen::Vector3d& /*direction*/, const Eigen::Vector3d& normal)
 {
     if(Eigen::Vector3d::UnitZ().dot(normal) < 0.7) return -1;
-    return sample.staticValue_ * 10000 * Eigen::Vector3d::UnitZ().dot(normal) * 100000  +  ((double)rand()) / ((double)(RAND_MAX));
+    return sample.staticValue() * 10000 * Eigen::Vector3d::UnitZ().dot(normal) * 100000  +  ((double)rand()) / ((double)(RAND_MAX));
 }
 
 double RandomHeuristic(const sampling::Sample& /*sample*/,
@@ -57,7 +66,7 @@ double RandomHeuristic(const sampling::Sample& /*sample*/,
 double ForwardHeuristic(const sampling::Sample& sample,
                       const Eigen::Vector3d& direction, const Eigen::Vector3d& normal)
 {
-    return sample.staticValue_ * 10000 * Eigen::Vector3d::UnitZ().dot(normal) * 100  + sample.effectorPosition_.dot(fcl::Vec3f(direction(0),direction(1),direction(2))) + ((double)rand()) / ((double)(RAND_MAX));
+    return sample.staticValue() * 10000 * Eigen::Vector3d::UnitZ().dot(normal) * 100  + sample.effectorPosition().dot(fcl::Vec3f(direction(0),direction(1),direction(2))) + ((double)rand()) / ((double)(RAND_MAX));
 }
 
 
@@ -65,20 +74,24 @@ double ForwardHeuristic(const sampling::Sample& sample,
 double BackwardHeuristic(const sampling::Sample& sample,
                       const Eigen::Vector3d& direction, const Eigen::Vector3d& normal)
 {
-    return sample.staticValue_ * 10000 * Eigen::Vector3d::UnitZ().dot(normal) * 100  - sample.effectorPosition_.dot(fcl::Vec3f(direction(0),direction(1),direction(2))) + ((double)rand()) / ((double)(RAND_MAX));
+    return sample.staticValue() * 10000 * Eigen::Vector3d::UnitZ().dot(normal) * 100  - sample.effectorPosition().dot(fcl::Vec3f(direction(0),direction(1),direction(2))) + ((double)rand()) / ((double)(RAND_MAX));
 }
 
 double StaticHeuristic(const sampling::Sample& sample,
                       const Eigen::Vector3d& /*direction*/, const Eigen::Vector3d& /*normal*/)
 {
-    return sample.staticValue_;
+    return sample.staticValue();
 }
 
 
 double DistanceToLimitHeuristic(const sampling::Sample& sample,
                       const Eigen::Vector3d& /*direction*/, const Eigen::Vector3d& /*normal*/)
 {
-    return sample.configuration_.norm();
+    if(sample.length() > (std::size_t)LimbConfiguration_t::MaxRowsAtCompileTime)
+        return sample.configuration().norm();
+    LimbConfiguration_t configuration(sample.length());
+    sample.configuration(configuration);
+    return configuration.norm();
 }
 }
 
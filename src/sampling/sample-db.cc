@@ -8,8 +8,22 @@
 
 #include <hpp/rbprm/tools.hh>
 
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#include <boost/interprocess/streams/bufferstream.hpp>
+#include <boost/bind.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <fstream>
+#include <set>
+#include <stdexcept>
+#include <sstream>
 #include <string>
 
 using namespace hpp;
@@ -26,7 +40,7 @@ namespace
        for(SampleVector_t::const_iterator cit = samples.begin();
            cit != samples.end(); ++cit)
        {
-           const fcl::Vec3f& position = cit->effectorPosition_;
+           const fcl::Vec3f position = cit->effectorPosition();
            octomap::point3d endpoint((float)position[0],(float)position[1],(float)position[2]);
            octTree->updateNode(endpoint, true);
        }
@@ -41,7 +55,7 @@ namespace
        std::size_t sid = 0;
        for(SampleVector_t::const_iterator cit=samples.begin(); cit!=samples.end();++cit, ++sid)
        {
-           const fcl::Vec3f& position = cit->effectorPosition_;
+           const fcl::Vec3f position = cit->effectorPosition();
            long int id = octTree->search(position[0],position[1],position[2]) - octTree->getRoot();
            T_VoxelSample::iterator it = res.find(id);
            if(it!=res.end())
@@ -58,10 +72,9 @@ namespace
 
     void alignSampleOrderWithOctree(SampleDB& db)
     {
-        std::vector<std::size_t> realignOrderIds; // indicate how to realign each value in value vector
+        std::vector<std::size_t> storageOrder; // indicate how to realign the sample storage and values
         // assumes samples are sorted, so they are already sorted by interest
         // within octree
-        T_Sample reorderedSamples; reorderedSamples.reserve(db.samples_.size());
         T_VoxelSample samplesPerVoxel = getSamplesPerVoxel(db.octomapTree_,db.samples_);
 
         //now sort all voxels by id for continuity
@@ -75,6 +88,7 @@ namespace
         std::sort(voxelIds.begin(),voxelIds.end());
 
         T_VoxelSampleId reorderedSamplesPerVoxel;
+        reorderedSamplesPerVoxel.reserve(voxelIds.size());
         std::size_t currentNewIndex = 0;
         for(std::vector<long int>::const_iterator vit = voxelIds.begin();
             vit != voxelIds.end(); ++vit)
@@ -85,20 +99,18 @@ namespace
             for(std::vector<std::size_t>::const_iterator sit = sampleIds.begin();
                 sit != sampleIds.end(); ++sit   )
             {
-                reorderedSamples.push_back(db.samples_[*sit]);
-                reorderedSamples.back().id_ = currentNewIndex;
-                realignOrderIds.push_back(*sit);
+                storageOrder.push_back(db.samples_[*sit].id_);
                 ++currentNewIndex;
             }
-            reorderedSamplesPerVoxel.insert(std::make_pair(voxelId, std::make_pair(startSampleId,currentNewIndex-startSampleId)));
+            reorderedSamplesPerVoxel.insert(voxelId, std::make_pair(startSampleId,currentNewIndex-startSampleId));
         }
-        //Now reorder all values
+        //Now reorder all values, which are indexed by sample id
         T_Values reorderedValues;
         for(T_Values::const_iterator cit = db.values_.begin(); cit != db.values_.end(); ++cit)
         {
-            T_Double vals; vals.reserve(realignOrderIds.size());
-            for(std::vector<std::size_t>::const_iterator rit = realignOrderIds.begin();
-                rit!=realignOrderIds.end(); ++rit)
+            T_Double vals; vals.reserve(storageOrder.size());
+            for(std::vector<std::size_t>::const_iterator rit = storageOrder.begin();
+                rit!=storageOrder.end(); ++rit)
             {
                 vals.push_back(cit->second[*rit]);
             }
@@ -106,7 +118,9 @@ namespace
         }
         db.samplesInVoxels_ = reorderedSamplesPerVoxel;
         db.values_ = reorderedValues;
-        db.samples_ = reorderedSamples;
+        db.storage_->permute(storageOrder);
+        db.samples_ = CreateSamples(db.storage_);
+        db.pendingSamplesInVoxels_.clear();
     }
 
     void sortDB(SampleDB& database)
@@ -116,41 +130,82 @@ namespace
         alignSampleOrderWithOctree(database);
     }
 
+    // box of an occupied leaf of the octree
+    template<typename LeafIterator>
+    fcl::CollisionObject* generateBox(const octomap::OcTree& octTree, const LeafIterator& it)
+    {
+        FCL_REAL size = it.getSize();
+        Box* box = new Box(size, size, size);
+        box->cost_density = it->getOccupancy();
+        box->threshold_occupied = octTree.getOccupancyThres();
+        return new fcl::CollisionObject(boost::shared_ptr<fcl::CollisionGeometry>(box),
+                                        Transform3f(Vec3f(it.getX(), it.getY(), it.getZ())));
+    }
+
+    // same boxes as fcl::OcTree::toBoxes, identified by the id of their leaf
     std::map<std::size_t, fcl::CollisionObject*> generateBoxesFromOctomap(const boost::shared_ptr<const octomap::OcTree>& octTree,
                                                                 const fcl::OcTree* tree)
     {
         std::map<std::size_t, fcl::CollisionObject*> boxes;
-        std::vector<boost::array<FCL_REAL, 6> > boxes_ = tree->toBoxes();
-        //boxes.reserve(boxes_.size());
-        for(std::size_t i = 0; i < boxes_.size(); ++i)
-        {
-            FCL_REAL x = boxes_[i][0];
-            FCL_REAL y = boxes_[i][1];
-            FCL_REAL z = boxes_[i][2];
-            FCL_REAL size = boxes_[i][3];
-            FCL_REAL cost = boxes_[i][4];
-            FCL_REAL threshold = boxes_[i][5];
-            std::size_t id = octTree->search(x,y,z) - octTree->getRoot();
-
-            Box* box = new Box(size, size, size);
-            box->cost_density = cost;
-            box->threshold_occupied = threshold;
-            fcl::CollisionObject* obj = new fcl::CollisionObject(boost::shared_ptr<fcl::CollisionGeometry>(box), Transform3f(Vec3f(x, y, z)));
-            boxes.insert(std::make_pair(id,obj));
+        const octomap::OcTreeNode* root = octTree->getRoot();
+        for(octomap::OcTree::leaf_iterator it = octTree->begin_leafs(), end = octTree->end_leafs();
+            it != end; ++it)
+        {
+            if(!tree->isNodeOccupied(&(*it)))
+                continue;
+            std::size_t id = &(*it) - root;
+            boxes.insert(std::make_pair(id,generateBox(*octTree, it)));
         }
         return boxes;
     }
+
+    fcl::AABB computeBoundingBox(const std::map<std::size_t, fcl::CollisionObject*>& boxes)
+    {
+        fcl::AABB res;
+        for(std::map<std::size_t, fcl::CollisionObject*>::const_iterator cit = boxes.begin(); cit != boxes.end(); ++cit)
+            res += cit->second->getAABB();
+        return res;
+    }
+
+    void updateBoxes(SampleDB& db)
+    {
+        for (std::map<std::size_t, fcl::CollisionObject*>::const_iterator it = db.boxes_.begin();
+             it != db.boxes_.end(); ++it)
+        {
+            delete it->second;
+        }
+        db.boxes_ = generateBoxesFromOctomap(db.octomapTree_, db.octree_);
+        db.aabb_ = computeBoundingBox(db.boxes_);
+    }
+
+    void setOctree(SampleDB& db, octomap::OcTree* octTree)
+    {
+        db.octomapTree_ = boost::shared_ptr<octomap::OcTree>(octTree);
+        db.octree_ = new fcl::OcTree(db.octomapTree_);
+        db.geometry_ = boost::shared_ptr<fcl::CollisionGeometry>(db.octree_);
+        db.treeObject_ = fcl::CollisionObject(db.geometry_);
+        updateBoxes(db);
+    }
+
+    void buildOctree(SampleDB& db)
+    {
+        setOctree(db, generateOctree(db.samples_, db.resolution_));
+    }
 }
 
 SampleDB::SampleDB(const model::JointPtr_t limb, const std::string& effector,
-                   const std::size_t nbSamples, const fcl::Vec3f& offset, const double resolution, const T_evaluate& data,  const std::string& staticValue)
+                   const std::size_t nbSamples, const fcl::Vec3f& offset, const double resolution, const T_evaluate& data,  const std::string& staticValue,
+                   const std::size_t nbThreads, const bool storeJacobians, const SampleEncoding encoding)
     : resolution_(resolution)
-    , samples_(GenerateSamples(limb, effector, nbSamples, offset))
+    , storage_(GenerateSampleStorage(limb, effector, nbSamples, offset, nbThreads, 0, storeJacobians, encoding))
+    , samples_(CreateSamples(storage_))
     , octomapTree_(generateOctree(samples_, resolution))
     , octree_(new fcl::OcTree(octomapTree_))
     , geometry_(boost::shared_ptr<fcl::CollisionGeometry>(octree_))
     , treeObject_(geometry_)
     , boxes_(generateBoxesFromOctomap(octomapTree_, octree_))
+    , aabb_(computeBoundingBox(boxes_))
+    , readOnly_(false)
 {
     for(T_evaluate::const_iterator cit = data.begin(); cit != data.end(); ++cit)
     {
@@ -169,37 +224,100 @@ SampleDB::~SampleDB()
    }
 }
 
-
-OctreeReport::OctreeReport(const Sample* s, const fcl::Contact c, const double v, const fcl::Vec3f& normal)
-   : sample_(s)
-   , contact_(c)
-   , value_(v)
-   , normal_(normal)
+namespace
 {
-   // NOTHING
-}
+    const std::size_t EVALUATION_BLOCK_SIZE = 256;
 
-SampleDB& hpp::rbprm::sampling::addValue(SampleDB& database, const std::string& valueName, const evaluate eval, bool isStaticValue, bool sortSamples)
-{
-    T_Values::const_iterator cit = database.values_.find(valueName);
-    if(cit != database.values_.end())
+    void evaluateBlock(const evaluate& eval, const SampleDB& database, const Sample* samples, const std::size_t nbSamples, double* values)
     {
-        hppDout (warning, "value already existing for database " << valueName);
-        return database;
+        for(std::size_t i = 0; i < nbSamples; ++i)
+            values[i] = eval(database, samples[i]);
     }
-    else
+
+    double evaluateSample(const batchEvaluate& eval, const SampleDB& database, const Sample& sample)
+    {
+        double value;
+        eval(database, &sample, 1, &value);
+        return value;
+    }
+
+    // evaluates all the samples of the database in parallel, by blocks.
+    // returns false if the evaluation was cancelled.
+    bool evaluateSamples(const SampleDB& database, const batchEvaluate& eval, const std::size_t nbThreads,
+                         const progress& callback, T_Double& values)
     {
+        const std::size_t nbSamples = database.samples_.size();
+        const long int nbBlocks = (long int)((nbSamples + EVALUATION_BLOCK_SIZE - 1) / EVALUATION_BLOCK_SIZE);
+        values.resize(nbSamples);
+#ifdef _OPENMP
+        const int nbWorkers = nbThreads > 0 ? (int)nbThreads : omp_get_max_threads();
+#else
+        const int nbWorkers = 1;
+#endif
+        std::size_t nbEvaluated = 0;
+        bool cancelled = false;
+        std::string error;
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(nbWorkers)
+        for(long int block = 0; block < nbBlocks; ++block)
+        {
+            bool stop;
+            #pragma omp critical (rbprm_evaluate_samples)
+            stop = cancelled;
+            if(stop)
+                continue;
+            const std::size_t first = (std::size_t)block * EVALUATION_BLOCK_SIZE;
+            const std::size_t size = std::min(EVALUATION_BLOCK_SIZE, nbSamples - first);
+            try
+            {
+                eval(database, &database.samples_[first], size, &values[first]);
+            }
+            catch(const std::exception& e)
+            {
+                // exceptions can not leave the parallel region
+                #pragma omp critical (rbprm_evaluate_samples)
+                {
+                    if(!cancelled)
+                        error = e.what();
+                    cancelled = true;
+                }
+                continue;
+            }
+            #pragma omp critical (rbprm_evaluate_samples)
+            {
+                nbEvaluated += size;
+                if(!cancelled && callback && !callback(nbEvaluated, nbSamples))
+                    cancelled = true;
+            }
+        }
+        if(!error.empty())
+            throw std::runtime_error ("Impossible to evaluate samples: " + error);
+        return !cancelled;
+    }
+
+    bool addEvaluatedValue(SampleDB& database, const std::string& valueName, const batchEvaluate& eval, const evaluate& sampleEval,
+                           bool isStaticValue, bool sortSamples, const std::size_t nbThreads, const progress& callback)
+    {
+        T_Values::const_iterator cit = database.values_.find(valueName);
+        if(cit != database.values_.end())
+        {
+            hppDout (warning, "value already existing for database " << valueName);
+            return true;
+        }
+        T_Double values;
+        if(!evaluateSamples(database, eval, nbThreads, callback, values))
+        {
+            hppDout (info, "evaluation of value " << valueName << " cancelled");
+            return false;
+        }
         double maxValue = -std::numeric_limits<double>::max() ;
         double minValue = std::numeric_limits<double>::max() ;
-        T_Double values; values.reserve(database.samples_.size());
-        for(T_Sample::iterator it = database.samples_.begin(); it != database.samples_.end(); ++it)
+        for(std::size_t i = 0; i < values.size(); ++i)
         {
-            double val = eval(database, *it);
+            const double val = values[i];
             maxValue = std::max(maxValue, val);
             minValue = std::min(minValue, val);
-            values.push_back(val);
             if(isStaticValue)
-                it->staticValue_ = val;
+                database.storage_->staticValues_[database.samples_[i].id_] = val;
         }
         database.valueBounds_.insert(std::make_pair(valueName, std::make_pair(minValue,maxValue)));
         // now normalize values
@@ -209,61 +327,553 @@ SampleDB& hpp::rbprm::sampling::addValue(SampleDB& database, const std::string&
             *it = (max_min != 0) ? (*it - minValue) / max_min : 0;
         }
         database.values_.insert(std::make_pair(valueName, values));
-        if(sortSamples)
+        database.evaluators_.insert(std::make_pair(valueName, sampleEval));
+        if(isStaticValue)
+            database.staticValueName_ = valueName;
+        if(sortSamples && !database.pendingSamplesInVoxels_.empty())
+            hppDout (info, "samples pending, sorting delayed until commit");
+        else if(sortSamples)
             sortDB(database);
+        return true;
     }
+}
+
+batchEvaluate hpp::rbprm::sampling::MakeBatchEvaluate(const evaluate eval)
+{
+    return boost::bind(&evaluateBlock, eval, _1, _2, _3, _4);
+}
+
+SampleDB& hpp::rbprm::sampling::addValue(SampleDB& database, const std::string& valueName, const evaluate eval, bool isStaticValue, bool sortSamples,
+                                         const std::size_t nbThreads, const progress& callback)
+{
+    if(database.readOnly_)
+        throw std::runtime_error ("Impossible to add value " + valueName + "; database is shared");
+    addEvaluatedValue(database, valueName, MakeBatchEvaluate(eval), eval, isStaticValue, sortSamples, nbThreads, callback);
     return database;
 }
 
-// TODO Samples should be Vec3f
+bool hpp::rbprm::sampling::addBatchValue(SampleDB& database, const std::string& valueName, const batchEvaluate eval, bool isStaticValue, bool sortSamples,
+                                         const std::size_t nbThreads, const progress& callback)
+{
+    if(database.readOnly_)
+        throw std::runtime_error ("Impossible to add value " + valueName + "; database is shared");
+    return addEvaluatedValue(database, valueName, eval, boost::bind(&evaluateSample, eval, _1, _2),
+                             isStaticValue, sortSamples, nbThreads, callback);
+}
+
+namespace
+{
+    // evaluates the samples [first, end) for all the values of the database,
+    // extending the value bounds and normalizing again the values if required.
+    void evaluateAppendedSamples(SampleDB& database, const std::size_t first)
+    {
+        for(T_Values::iterator vit = database.values_.begin(); vit != database.values_.end(); ++vit)
+        {
+            T_Double& values = vit->second;
+            T_evaluate::const_iterator eit = database.evaluators_.find(vit->first);
+            if(eit == database.evaluators_.end())
+            {
+                hppDout (warning, "no evaluation function for value " << vit->first << ", appended samples set to 0");
+                values.resize(database.samples_.size(), 0);
+                continue;
+            }
+            ValueBound& bounds = database.valueBounds_[vit->first];
+            const ValueBound previous = bounds;
+            T_Double rawValues; rawValues.reserve(database.samples_.size() - first);
+            for(std::size_t i = first; i < database.samples_.size(); ++i)
+            {
+                const double val = eit->second(database, database.samples_[i]);
+                bounds.first = std::min(bounds.first, val);
+                bounds.second = std::max(bounds.second, val);
+                rawValues.push_back(val);
+                if(vit->first == database.staticValueName_)
+                    database.storage_->staticValues_[database.samples_[i].id_] = val;
+            }
+            double max_min = bounds.second - bounds.first;
+            if(bounds != previous)
+            {
+                // values of previous samples are expressed with the previous bounds
+                const double previous_max_min = previous.second - previous.first;
+                for(T_Double::iterator it = values.begin(); it != values.end(); ++it)
+                {
+                    const double val = *it * previous_max_min + previous.first;
+                    *it = (max_min != 0) ? (val - bounds.first) / max_min : 0;
+                }
+            }
+            for(T_Double::const_iterator it = rawValues.begin(); it != rawValues.end(); ++it)
+            {
+                values.push_back((max_min != 0) ? (*it - bounds.first) / max_min : 0);
+            }
+        }
+    }
+
+    long int voxelId(const octomap::OcTree& tree, const fcl::Vec3f& position)
+    {
+        return tree.search(position[0],position[1],position[2]) - tree.getRoot();
+    }
+
+    // depth of a node of the octree containing a position, 0 if not found
+    unsigned int nodeDepth(const octomap::OcTree& tree, const fcl::Vec3f& position, const octomap::OcTreeNode* node)
+    {
+        for(unsigned int depth = 1; depth <= tree.getTreeDepth(); ++depth)
+            if(tree.search(position[0],position[1],position[2],depth) == node)
+                return depth;
+        return 0;
+    }
+
+    // generates again the boxes of the leaves in the cube of a node, given by a position
+    // inside the node and its depth. The bounding box of the octree is only extended
+    void updateBoxes(SampleDB& db, const fcl::Vec3f& position, const unsigned int depth)
+    {
+        const octomap::OcTree& tree = *db.octomapTree_;
+        const octomap::OcTreeNode* root = tree.getRoot();
+        const octomap::point3d center = tree.keyToCoord(tree.coordToKey(position[0],position[1],position[2]), depth);
+        // the cube is shrunk so that the neighbour leaves are not visited
+        const double half = 0.5 * tree.getNodeSize(depth) - 0.25 * tree.getResolution();
+        const octomap::point3d extent((float)half, (float)half, (float)half);
+        for(octomap::OcTree::leaf_bbx_iterator it = tree.begin_leafs_bbx(center - extent, center + extent),
+            end = tree.end_leafs_bbx(); it != end; ++it)
+        {
+            const std::size_t id = &(*it) - root;
+            std::map<std::size_t, fcl::CollisionObject*>::iterator bit = db.boxes_.find(id);
+            if(bit != db.boxes_.end())
+            {
+                delete bit->second;
+                db.boxes_.erase(bit);
+            }
+            if(!db.octree_->isNodeOccupied(&(*it)))
+                continue;
+            fcl::CollisionObject* box = generateBox(tree, it);
+            db.aabb_ += box->getAABB();
+            db.boxes_.insert(std::make_pair(id, box));
+        }
+    }
+
+    // inserts samples in the storage, the octree and the pending samples of a database.
+    // \return the position of the first inserted sample in samples_
+    std::size_t insertSamples(SampleDB& database, const SampleStorage& samples)
+    {
+        SampleStorage& storage = *database.storage_;
+        if(storage.size() == 0)
+        {
+            storage = SampleStorage(samples.length_, samples.startRank_, samples.jacobianCols_, samples.storeJacobians_);
+            storage.jacobianCache_ = samples.jacobianCache_;
+        }
+        else if(storage.length_ != samples.length_ || storage.startRank_ != samples.startRank_
+                || storage.jacobianCols_ != samples.jacobianCols_)
+            throw std::runtime_error ("Impossible to append samples; samples do not belong to the database limb");
+        else if(storage.storeJacobians_ != samples.storeJacobians_)
+            throw std::runtime_error ("Impossible to append samples; jacobians must be stored in both or neither");
+        const std::size_t first = database.samples_.size();
+        storage.append(samples);
+        for(std::size_t id = first; id < storage.size(); ++id)
+            database.samples_.push_back(Sample(database.storage_, id));
+
+        // insert the new samples without pruning, so that existing leaves are kept.
+        // A pruned leaf containing a new sample is expanded, its samples are then
+        // moved to the pending samples of the new leaves.
+        octomap::OcTree& tree = *database.octomapTree_;
+        std::set<long int> expanded;
+        // nodes whose leaves changed, by a position inside the node and its depth
+        std::map<long int, std::pair<fcl::Vec3f, unsigned int> > touched;
+        for(std::size_t i = first; i < database.samples_.size(); ++i)
+        {
+            const fcl::Vec3f position = database.samples_[i].effectorPosition();
+            const octomap::OcTreeNode* previous = tree.search(position[0],position[1],position[2]);
+            long int previousId = previous ? previous - tree.getRoot() : 0;
+            tree.updateNode(octomap::point3d((float)position[0],(float)position[1],(float)position[2]), true, true);
+            const long int id = voxelId(tree, position);
+            if(previous && id != previousId && expanded.insert(previousId).second)
+                touched[previousId] = std::make_pair(position, nodeDepth(tree, position, previous));
+            touched[id] = std::make_pair(position, tree.getTreeDepth());
+        }
+        tree.updateInnerOccupancy();
+
+        T_VoxelSamples& pending = database.pendingSamplesInVoxels_;
+        for(std::set<long int>::const_iterator vit = expanded.begin(); vit != expanded.end(); ++vit)
+        {
+            std::vector<std::size_t> positions;
+            const std::size_t slot = database.samplesInVoxels_.find(*vit);
+            if(slot != VoxelIndex::NOT_FOUND)
+            {
+                const VoxelSampleId& range = database.samplesInVoxels_.samples(slot);
+                for(std::size_t pos = range.first; pos < range.first + range.second; ++pos)
+                    positions.push_back(pos);
+                database.samplesInVoxels_.update(slot, std::make_pair(range.first, 0));
+            }
+            T_VoxelSamples::iterator pit = pending.find(*vit);
+            if(pit != pending.end())
+            {
+                positions.insert(positions.end(), pit->second.begin(), pit->second.end());
+                pending.erase(pit);
+            }
+            for(std::vector<std::size_t>::const_iterator sit = positions.begin(); sit != positions.end(); ++sit)
+                pending[voxelId(tree, database.samples_[*sit].effectorPosition())].push_back(*sit);
+        }
+        for(std::size_t i = first; i < database.samples_.size(); ++i)
+            pending[voxelId(tree, database.samples_[i].effectorPosition())].push_back(i);
+        // only the boxes of the modified leaves are generated again
+        for(std::set<long int>::const_iterator vit = expanded.begin(); vit != expanded.end(); ++vit)
+        {
+            std::map<std::size_t, fcl::CollisionObject*>::iterator bit = database.boxes_.find((std::size_t)*vit);
+            if(bit != database.boxes_.end())
+            {
+                delete bit->second;
+                database.boxes_.erase(bit);
+            }
+        }
+        for(std::map<long int, std::pair<fcl::Vec3f, unsigned int> >::const_iterator cit = touched.begin(); cit != touched.end(); ++cit)
+            updateBoxes(database, cit->second.first, cit->second.second);
+        return first;
+    }
+}
+
+SampleDB& hpp::rbprm::sampling::appendSamples(SampleDB& database, const SampleStorage& samples)
+{
+    if(database.readOnly_)
+        throw std::runtime_error ("Impossible to append samples; database is shared");
+    if(samples.size() == 0)
+        return database;
+    evaluateAppendedSamples(database, insertSamples(database, samples));
+    return database;
+}
+
+SampleDB& hpp::rbprm::sampling::appendSamples(SampleDB& database, const model::JointPtr_t limb, const std::string& effector,
+                                              const std::size_t nbSamples, const fcl::Vec3f& offset, const std::size_t nbThreads)
+{
+    if(database.readOnly_)
+        throw std::runtime_error ("Impossible to append samples; database is shared");
+    // the seed depends on the database size, so that new samples differ from the existing ones
+    const bool storeJacobians = database.storage_->size() == 0 || database.storage_->storeJacobians_;
+    return appendSamples(database, *GenerateSampleStorage(limb, effector, nbSamples, offset, nbThreads, database.samples_.size(), storeJacobians));
+}
+
+SampleDB& hpp::rbprm::sampling::commit(SampleDB& database)
+{
+    if(!database.pendingSamplesInVoxels_.empty())
+        sortDB(database);
+    return database;
+}
+
+SampleDB& hpp::rbprm::sampling::encode(SampleDB& database, const SampleEncoding encoding)
+{
+    if(!database.pendingSamplesInVoxels_.empty())
+        throw std::runtime_error ("Impossible to encode database; samples appended since last commit");
+    if(database.readOnly_ && database.storage_->encoding_ != encoding)
+        throw std::runtime_error ("Impossible to encode database; database is shared");
+    if(database.storage_->encoding_ == encoding)
+        return database;
+    database.storage_->encode(encoding);
+    buildOctree(database);
+    alignSampleOrderWithOctree(database);
+    return database;
+}
+
+namespace
+{
+    std::size_t databaseMemory(const SampleDB& database)
+    {
+        std::size_t res = database.storage_->memory();
+        for(T_Values::const_iterator cit = database.values_.begin(); cit != database.values_.end(); ++cit)
+            res += cit->second.size() * sizeof(double);
+        return res;
+    }
+
+    void candidateStatistics(const SampleDB& database, std::size_t& maxCandidates, double& meanCandidates)
+    {
+        const VoxelIndex& voxels = database.samplesInVoxels_;
+        maxCandidates = 0;
+        for(std::size_t slot = 0; slot < voxels.size(); ++slot)
+            maxCandidates = std::max(maxCandidates, voxels.samples(slot).second);
+        meanCandidates = voxels.empty() ? 0 : (double)database.samples_.size() / (double)voxels.size();
+    }
+
+    struct value_greater
+    {
+        value_greater(const SampleDB& database, const T_Double* values) : database_(database), values_(values) {}
+        bool operator() (const std::size_t lhs, const std::size_t rhs) const
+        {
+            return value(lhs) > value(rhs);
+        }
+        double value(const std::size_t pos) const
+        {
+            return values_ ? (*values_)[pos] : database_.samples_[pos].staticValue();
+        }
+        const SampleDB& database_;
+        const T_Double* values_;
+    };
+
+    // greedy farthest point selection, starting from the best sample
+    void selectDiverse(const SampleDB& database, std::vector<std::size_t>& positions, const std::size_t nbKept)
+    {
+        const SampleStorage& storage = *database.storage_;
+        std::vector<model::Configuration_t> configurations(positions.size(), model::Configuration_t(storage.length_));
+        for(std::size_t i = 0; i < positions.size(); ++i)
+            storage.configuration(database.samples_[positions[i]].id_, configurations[i]);
+        std::vector<double> distances(positions.size(), std::numeric_limits<double>::max());
+        for(std::size_t kept = 0; kept < nbKept; ++kept)
+        {
+            if(kept > 0)
+            {
+                std::size_t farthest = kept;
+                for(std::size_t i = kept; i < positions.size(); ++i)
+                    if(distances[i] > distances[farthest])
+                        farthest = i;
+                std::swap(positions[kept], positions[farthest]);
+                std::swap(configurations[kept], configurations[farthest]);
+                std::swap(distances[kept], distances[farthest]);
+            }
+            for(std::size_t i = kept + 1; i < positions.size(); ++i)
+                distances[i] = std::min(distances[i], (configurations[i] - configurations[kept]).squaredNorm());
+        }
+    }
+}
+
+PruningReport hpp::rbprm::sampling::prune(SampleDB& database, const std::size_t maxSamplesPerVoxel,
+                                           const PruningCriterion criterion, const std::string& valueName)
+{
+    if(!database.pendingSamplesInVoxels_.empty())
+        throw std::runtime_error ("Impossible to prune database; samples appended since last commit");
+    if(database.readOnly_)
+        throw std::runtime_error ("Impossible to prune database; database is shared");
+    if(maxSamplesPerVoxel == 0)
+        throw std::runtime_error ("Impossible to prune database; at least one sample must be kept per voxel");
+    const T_Double* values = 0;
+    if(!valueName.empty())
+    {
+        T_Values::const_iterator cit = database.values_.find(valueName);
+        if(cit == database.values_.end())
+            throw std::runtime_error ("Impossible to prune database; unknown value " + valueName);
+        values = &cit->second;
+    }
+    PruningReport report;
+    report.nbSamplesBefore_ = database.samples_.size();
+    report.memoryBefore_ = databaseMemory(database);
+    report.nbVoxels_ = database.samplesInVoxels_.size();
+    candidateStatistics(database, report.maxCandidatesBefore_, report.meanCandidatesBefore_);
+
+    // kept positions in samples_ first, then the removed ones
+    std::vector<std::size_t> kept, removed;
+    const value_greater compare(database, values);
+    for(std::size_t slot = 0; slot < database.samplesInVoxels_.size(); ++slot)
+    {
+        const VoxelSampleId& range = database.samplesInVoxels_.samples(slot);
+        std::vector<std::size_t> positions;
+        for(std::size_t pos = range.first; pos < range.first + range.second; ++pos)
+            positions.push_back(pos);
+        const std::size_t nbKept = std::min(maxSamplesPerVoxel, positions.size());
+        std::stable_sort(positions.begin(), positions.end(), compare);
+        if(criterion == PRUNE_BY_DIVERSITY)
+            selectDiverse(database, positions, nbKept);
+        kept.insert(kept.end(), positions.begin(), positions.begin() + nbKept);
+        removed.insert(removed.end(), positions.begin() + nbKept, positions.end());
+    }
+    std::sort(kept.begin(), kept.end());
+    const std::size_t nbKept = kept.size();
+    kept.insert(kept.end(), removed.begin(), removed.end());
+
+    // values are indexed by position in samples_, the storage by sample id
+    std::vector<std::size_t> storageOrder; storageOrder.reserve(kept.size());
+    for(std::vector<std::size_t>::const_iterator cit = kept.begin(); cit != kept.end(); ++cit)
+        storageOrder.push_back(database.samples_[*cit].id_);
+    for(T_Values::iterator vit = database.values_.begin(); vit != database.values_.end(); ++vit)
+    {
+        T_Double prunedValues; prunedValues.reserve(nbKept);
+        for(std::size_t i = 0; i < nbKept; ++i)
+            prunedValues.push_back(vit->second[kept[i]]);
+        vit->second.swap(prunedValues);
+    }
+    database.storage_->permute(storageOrder);
+    database.storage_->resize(nbKept);
+    // copy to release the memory of the removed samples
+    database.storage_ = SampleStoragePtr_t(new SampleStorage(*database.storage_));
+    database.samples_ = CreateSamples(database.storage_);
+    alignSampleOrderWithOctree(database);
+
+    report.nbSamplesAfter_ = database.samples_.size();
+    report.memoryAfter_ = databaseMemory(database);
+    candidateStatistics(database, report.maxCandidatesAfter_, report.meanCandidatesAfter_);
+    return report;
+}
+
+namespace
+{
+    void collideOctree(const SampleDB& sc, const fcl::Transform3f& treeTrf, const fcl::CollisionObjectPtr_t& obj,
+                       fcl::CollisionResult& cResult)
+    {
+        fcl::CollisionRequest req(1000, true);
+        fcl::collide(sc.geometry_.get(), treeTrf, obj->collisionGeometry().get(), obj->getTransform(), req, cResult);
+    }
+
+    // collisions of the given voxels and triangles of an object, for the current octree transform
+    void collidePairs(const SampleDB& sc, const fcl::Transform3f& treeTrf, const fcl::CollisionObjectPtr_t& obj,
+                      const std::vector<std::pair<int, int> >& pairs, fcl::CollisionResult& cResult)
+    {
+        const BVHModel<OBBRSS>* mesh = static_cast<const BVHModel<OBBRSS>*>(obj->collisionGeometry().get());
+        fcl::CollisionRequest req(1, true);
+        for(std::vector<std::pair<int, int> >::const_iterator pit = pairs.begin(); pit != pairs.end(); ++pit)
+        {
+            std::map<std::size_t, fcl::CollisionObject*>::const_iterator box = sc.boxes_.find((std::size_t)pit->first);
+            if(box == sc.boxes_.end())
+                continue;
+            const Triangle& triangle = mesh->tri_indices[pit->second];
+            const TriangleP shape(mesh->vertices[triangle[0]], mesh->vertices[triangle[1]], mesh->vertices[triangle[2]]);
+            fcl::CollisionResult pairResult;
+            if(fcl::collide(box->second->collisionGeometry().get(), treeTrf * box->second->getTransform(),
+                            &shape, obj->getTransform(), req, pairResult) == 0)
+                continue;
+            Contact contact = pairResult.getContact(0);
+            contact.o1 = sc.geometry_.get();
+            contact.o2 = obj->collisionGeometry().get();
+            contact.b1 = pit->first;
+            contact.b2 = pit->second;
+            cResult.addContact(contact);
+        }
+    }
+
+    std::vector<std::pair<int, int> > collidingPairs(const fcl::CollisionResult& cResult)
+    {
+        std::vector<std::pair<int, int> > res;
+        for(std::size_t index = 0; index < cResult.numContacts(); ++index)
+            res.push_back(std::make_pair(cResult.getContact(index).b1, cResult.getContact(index).b2));
+        return res;
+    }
+
+    // TODO Samples should be Vec3f
+    void addCandidates(const SampleDB& sc, const fcl::CollisionObjectPtr_t& obj, const fcl::CollisionResult& cResult,
+                       const fcl::Vec3f& direction, T_OctreeReport& reports, const heuristic evaluate)
+    {
+        if(cResult.numContacts() == 0)
+            return;
+        Eigen::Vector3d eDir(direction[0], direction[1], direction[2]);
+        assert(obj->collisionGeometry()->getObjectType() == fcl::OT_BVH); // only works with meshes
+        const AffordanceGeometryConstPtr_t surface = AffordanceGeometry::Get(obj->collisionGeometry());
+        for(std::size_t index=0; index<cResult.numContacts(); ++index)
+        {
+            const Contact& contact = cResult.getContact(index);
+            //verifying that position is theoritically reachable from next position
+            const std::size_t voxel = sc.samplesInVoxels_.find(contact.b1);
+            T_VoxelSamples::const_iterator pending = sc.pendingSamplesInVoxels_.empty() ?
+                        sc.pendingSamplesInVoxels_.end() : sc.pendingSamplesInVoxels_.find(contact.b1);
+            if(voxel == VoxelIndex::NOT_FOUND && pending == sc.pendingSamplesInVoxels_.end())
+                continue;
+            const fcl::Vec3f& normal = surface->normals_[contact.b2];
+            Eigen::Vector3d eNormal(normal[0], normal[1], normal[2]);
+            if(voxel != VoxelIndex::NOT_FOUND)
+            {
+                const VoxelSampleId& voxelSampleIds = sc.samplesInVoxels_.samples(voxel);
+                for(T_Sample::const_iterator sit = sc.samples_.begin()+ voxelSampleIds.first;
+                    sit != sc.samples_.begin()+ voxelSampleIds.first + voxelSampleIds.second; ++sit)
+                {
+                    OctreeReport report(&(*sit), contact, evaluate ? ((*evaluate)(*sit, eDir, eNormal)) :0, normal);
+                    reports.insert(report);
+                }
+            }
+            if(pending != sc.pendingSamplesInVoxels_.end())
+            {
+                for(std::vector<std::size_t>::const_iterator pit = pending->second.begin(); pit != pending->second.end(); ++pit)
+                {
+                    const Sample& sample = sc.samples_[*pit];
+                    OctreeReport report(&sample, contact, evaluate ? ((*evaluate)(sample, eDir, eNormal)) :0, normal);
+                    reports.insert(report);
+                }
+            }
+        }
+    }
+}
+
 bool rbprm::sampling::GetCandidates(const SampleDB& sc, const fcl::Transform3f& treeTrf,
                                     const hpp::model::CollisionObjectPtr_t& o2,
                                     const fcl::Vec3f& direction, hpp::rbprm::sampling::T_OctreeReport &reports,
                                     const heuristic evaluate)
 {
-    fcl::CollisionRequest req(1000, true);
     fcl::CollisionResult cResult;
     fcl::CollisionObjectPtr_t obj = o2->fcl();
-    fcl::collide(sc.geometry_.get(), treeTrf, obj->collisionGeometry().get(), obj->getTransform(), req, cResult);
-    sampling::T_VoxelSampleId::const_iterator voxelIt;
-    Eigen::Vector3d eDir(direction[0], direction[1], direction[2]);
-    std::vector<long int> visited;
-    int totalSamples = 0;
-    int okay = 0;
-    for(std::size_t index=0; index<cResult.numContacts(); ++index)
-    {
-        const Contact& contact = cResult.getContact(index);
-        if(std::find(visited.begin(), visited.end(), contact.b1) == visited.end())
-            visited.push_back(contact.b1);
-        //verifying that position is theoritically reachable from next position
-        {
-            voxelIt = sc.samplesInVoxels_.find(contact.b1);
-            const VoxelSampleId& voxelSampleIds = voxelIt->second;
-            totalSamples += (int)voxelSampleIds.second;
-            for(T_Sample::const_iterator sit = sc.samples_.begin()+ voxelSampleIds.first;
-                sit != sc.samples_.begin()+ voxelSampleIds.first + voxelSampleIds.second; ++sit)
+    collideOctree(sc, treeTrf, obj, cResult);
+    addCandidates(sc, obj, cResult, direction, reports, evaluate);
+    return !reports.empty();
+}
+
+
+bool rbprm::sampling::GetCandidates(const SampleDB& sc, const fcl::Transform3f& treeTrf,
+                                    const AffordanceIndex& affordances,
+                                    const fcl::Vec3f& direction, T_OctreeReport& reports, const heuristic evaluate,
+                                    const std::size_t nbThreads, CandidateCache* cache)
+{
+    if(sc.boxes_.empty())
+        return !reports.empty();
+    // world bounding box of the octree
+    fcl::AABB box;
+    for(int i = 0; i < 8; ++i)
+    {
+        const fcl::Vec3f corner((i & 1) ? sc.aabb_.max_[0] : sc.aabb_.min_[0],
+                                (i & 2) ? sc.aabb_.max_[1] : sc.aabb_.min_[1],
+                                (i & 4) ? sc.aabb_.max_[2] : sc.aabb_.min_[2]);
+        box += treeTrf.transform(corner);
+    }
+    std::vector<std::size_t> objects;
+    affordances.query(box, objects);
+    // collisions are computed concurrently, candidates are evaluated in the order
+    // of the objects since heuristics may not be thread safe
+    std::vector<fcl::CollisionResult> results(objects.size());
+    // only the colliding pairs of the cached objects are tested, the other objects are fully tested
+    const CandidateCache::EntryConstPtr_t cached = cache ? cache->find(sc, treeTrf, affordances) : CandidateCache::EntryConstPtr_t();
+    std::vector<long int> cachedPairs(objects.size(), -1);
+    std::vector<std::size_t> missing;
+    for(std::size_t i = 0; i < objects.size(); ++i)
+    {
+        if(cached)
+        {
+            std::vector<std::size_t>::const_iterator cit = std::lower_bound(cached->objects_.begin(), cached->objects_.end(), objects[i]);
+            if(cit != cached->objects_.end() && *cit == objects[i])
             {
-                //find normal id
-                assert(contact.o2->getObjectType() == fcl::OT_BVH); // only works with meshes
-                const fcl::BVHModel<fcl::OBBRSS>* surface = static_cast<const fcl::BVHModel<fcl::OBBRSS>*> (contact.o2);
-                fcl::Vec3f normal;
-                const fcl::Triangle& tr = surface->tri_indices[contact.b2];
-                const fcl::Vec3f& v1 = surface->vertices[tr[0]];
-                const fcl::Vec3f& v2 = surface->vertices[tr[1]];
-                const fcl::Vec3f& v3 = surface->vertices[tr[2]];
-                normal = (v2 - v1).cross(v3 - v1);
-                normal.normalize();
-                Eigen::Vector3d eNormal(normal[0], normal[1], normal[2]);
-                OctreeReport report(&(*sit), contact, evaluate ? ((*evaluate)(*sit, eDir, eNormal)) :0, normal);
-                ++okay;
-                reports.insert(report);
+                cachedPairs[i] = cit - cached->objects_.begin();
+                continue;
             }
         }
+        missing.push_back(i);
+    }
+#ifdef _OPENMP
+    const int nbWorkers = nbThreads > 0 ? (int)nbThreads : omp_get_max_threads();
+#else
+    const int nbWorkers = 1;
+#endif
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(nbWorkers) if(nbWorkers > 1 && objects.size() > 1)
+    for(long int i = 0; i < (long int)objects.size(); ++i)
+    {
+        const fcl::CollisionObjectPtr_t& obj = affordances.objects_[objects[i]]->fcl();
+        if(cachedPairs[i] >= 0)
+            collidePairs(sc, treeTrf, obj, cached->pairs_[cachedPairs[i]], results[i]);
+        else
+            collideOctree(sc, treeTrf, obj, results[i]);
+    }
+    for(std::size_t i = 0; i < objects.size(); ++i)
+        addCandidates(sc, affordances.objects_[objects[i]]->fcl(), results[i], direction, reports, evaluate);
+    if(cache && (!cached || !missing.empty()))
+    {
+        // on a hit, the pairs of the new objects are added to the entry, which keeps its root transform
+        // as reference for the thresholds
+        CandidateCache::Entry* entry = cached ? new CandidateCache::Entry(*cached) : new CandidateCache::Entry;
+        CandidateCache::EntryConstPtr_t stored(entry);
+        if(!cached)
+        {
+            entry->treeTrf_ = treeTrf;
+            entry->database_ = &sc;
+            entry->octree_ = sc.geometry_.get();
+            entry->nbSamples_ = sc.samples_.size();
+            entry->affordances_ = affordances.objects_;
+        }
+        for(std::vector<std::size_t>::const_iterator mit = missing.begin(); mit != missing.end(); ++mit)
+        {
+            std::vector<std::size_t>::iterator pos = std::lower_bound(entry->objects_.begin(), entry->objects_.end(), objects[*mit]);
+            entry->pairs_.insert(entry->pairs_.begin() + (pos - entry->objects_.begin()), collidingPairs(results[*mit]));
+            entry->objects_.insert(pos, objects[*mit]);
+        }
+        cache->store(stored);
     }
     return !reports.empty();
 }
 
-
 rbprm::sampling::T_OctreeReport rbprm::sampling::GetCandidates(const SampleDB& sc, const fcl::Transform3f& treeTrf,
                                                                const hpp::model::CollisionObjectPtr_t& o2,
                                                                const fcl::Vec3f& direction, const heuristic evaluate)
@@ -280,16 +890,16 @@ void writeSample(const Sample& sample, std::ostream& output)
 {
     output << "sample" << std::endl;
     output << sample.id_<< std::endl;
-    output << sample.length_ << std::endl;
-    output << sample.startRank_ << std::endl;
-    output << sample.staticValue_ << std::endl;
-    writeVecFCL(sample.effectorPosition_,output);
+    output << sample.length() << std::endl;
+    output << sample.startRank() << std::endl;
+    output << sample.staticValue() << std::endl;
+    writeVecFCL(sample.effectorPosition(),output);
     output << std::endl;
-    writeMatrix(sample.configuration_,output);
+    writeMatrix(sample.configuration(),output);
     output << std::endl;
-    writeMatrix(sample.jacobian_,output);
+    writeMatrix(sample.jacobian(),output);
     output << std::endl;
-    writeMatrix(sample.jacobianProduct_,output);
+    writeMatrix(sample.jacobianProduct(),output);
     output << std::endl;
 }
 
@@ -314,14 +924,14 @@ void writeValues(const SampleDB& database, std::ostream& output)
     }
 }
 
-Sample readSample(std::ifstream& myfile, std::string& line)
+void readSample(SampleStoragePtr_t& storage, const std::size_t size, std::ifstream& myfile, std::string& line)
 {
-    std::size_t id, length, startRank;
+    std::size_t length, startRank;
     double staticValue;
     fcl::Vec3f effpos;
     Eigen::VectorXd conf;
     Eigen::MatrixXd jav, ajcprod;
-    id = StrToI(myfile);
+    StrToI(myfile); // id, samples are realigned after loading
     length = StrToI(myfile);
     startRank = StrToI(myfile);
     staticValue = StrToD(myfile);
@@ -329,7 +939,12 @@ Sample readSample(std::ifstream& myfile, std::string& line)
     conf = readMatrix(myfile,line);
     jav = readMatrix(myfile,line);
     ajcprod = readMatrix(myfile,line);
-    return Sample(id, length, startRank, staticValue, effpos, conf,jav,ajcprod);
+    if(!storage)
+    {
+        storage = SampleStoragePtr_t(new SampleStorage(length, startRank, jav.cols()));
+        storage->reserve(size);
+    }
+    storage->add(staticValue, effpos, conf, jav, ajcprod);
 }
 
 void readValue(T_Values& values, const std::size_t& size, std::ifstream& myfile, std::string& line)
@@ -357,6 +972,7 @@ bool hpp::rbprm::sampling::saveLimbDatabase(const SampleDB& database, std::ofstr
 
 SampleDB::SampleDB(std::ifstream& myfile, bool loadValues)
     : treeObject_(boost::shared_ptr<CollisionGeometry> (new fcl::Box (1, 1, 1)))
+    , readOnly_(false)
 {
     if (!myfile.good())
         throw std::runtime_error ("Impossible to open database");
@@ -365,22 +981,444 @@ SampleDB::SampleDB(std::ifstream& myfile, bool loadValues)
         std::string line;
         getline(myfile, line);
         std::size_t size = StrToI(line);
-        samples_.reserve(size);
         getline(myfile, line);
         resolution_ = StrToD(line);
         while (myfile.good())
         {
             getline(myfile, line);
             if(line.find("sample") != std::string::npos)
-                samples_.push_back(readSample(myfile, line));
+                readSample(storage_, size, myfile, line);
             else if(line.find("value") != std::string::npos && loadValues)
                 readValue(values_,size,myfile,line);
         }
     }
-    octomapTree_ = boost::shared_ptr<const octomap::OcTree>(generateOctree(samples_, resolution_));
-    octree_ = new fcl::OcTree(octomapTree_);
-    geometry_ = boost::shared_ptr<fcl::CollisionGeometry>(octree_);
-    treeObject_ = fcl::CollisionObject(geometry_);
-    boxes_ = generateBoxesFromOctomap(octomapTree_, octree_);
+    if(!storage_)
+        storage_ = SampleStoragePtr_t(new SampleStorage(0, 0, 0));
+    samples_ = CreateSamples(storage_);
+    buildOctree(*this);
     alignSampleOrderWithOctree(*this);
 }
+
+namespace
+{
+    template<typename T>
+    void writeBinary(std::ostream& output, const T& data)
+    {
+        output.write(reinterpret_cast<const char*>(&data), sizeof(T));
+    }
+
+    typedef std::pair<octomap::OcTreeKey, unsigned int> KeyDepth;
+    typedef std::map<long int, KeyDepth> T_VoxelKey;
+    T_VoxelKey getVoxelKeys(const boost::shared_ptr<const octomap::OcTree>& octTree)
+    {
+        T_VoxelKey res;
+        const octomap::OcTreeNode* root = octTree->getRoot();
+        for(octomap::OcTree::leaf_iterator it = octTree->begin_leafs(), end = octTree->end_leafs();
+            it != end; ++it)
+        {
+            res.insert(std::make_pair(&(*it) - root, std::make_pair(it.getKey(), it.getDepth())));
+        }
+        return res;
+    }
+
+    boost::uint64_t packKey(const octomap::OcTreeKey& key, const unsigned int depth)
+    {
+        return ((boost::uint64_t)depth << 48) | ((boost::uint64_t)key[0] << 32)
+                | ((boost::uint64_t)key[1] << 16) | (boost::uint64_t)key[2];
+    }
+
+    typedef std::map<boost::uint64_t, long int> T_KeyVoxel;
+    T_KeyVoxel getVoxelIds(const boost::shared_ptr<const octomap::OcTree>& octTree)
+    {
+        T_KeyVoxel res;
+        const octomap::OcTreeNode* root = octTree->getRoot();
+        for(octomap::OcTree::leaf_iterator it = octTree->begin_leafs(), end = octTree->end_leafs();
+            it != end; ++it)
+        {
+            res.insert(std::make_pair(packKey(it.getKey(), it.getDepth()), &(*it) - root));
+        }
+        return res;
+    }
+
+    std::size_t padded(const std::size_t size)
+    {
+        return ((size + 7) / 8) * 8;
+    }
+
+    // sections are written contiguously, in the order of the header
+    void computeOffsets(binary::DatabaseHeader& header)
+    {
+        using namespace binary;
+        const std::size_t arena = header.nbSamples_ * sizeof(double);
+        std::size_t positionSize = sizeof(float), configurationSize = sizeof(boost::uint16_t), nbBounds = header.length_;
+        if(header.encoding_ == DOUBLE_ENCODING)
+        {
+            positionSize = sizeof(double); configurationSize = sizeof(double); nbBounds = 0;
+        }
+        else if(header.encoding_ == FLOAT_ENCODING)
+        {
+            configurationSize = sizeof(float); nbBounds = 0;
+        }
+        header.staticValuesOffset_ = sizeof(DatabaseHeader);
+        header.effectorPositionsOffset_ = header.staticValuesOffset_ + arena;
+        header.configurationsOffset_ = header.effectorPositionsOffset_ + padded(3 * header.nbSamples_ * positionSize);
+        header.boundsOffset_ = header.configurationsOffset_ + padded(header.length_ * header.nbSamples_ * configurationSize);
+        // jacobian sections are empty when jacobians are not stored
+        const std::size_t jacobianArena = header.flags_ & JACOBIANS_STORED ? arena : 0;
+        header.jacobiansOffset_ = header.boundsOffset_ + 2 * nbBounds * sizeof(double);
+        header.jacobianProductsOffset_ = header.jacobiansOffset_ + 6 * header.jacobianCols_ * jacobianArena;
+        header.valuesOffset_ = header.jacobianProductsOffset_ + 36 * jacobianArena;
+        header.voxelsOffset_ = header.valuesOffset_ + header.nbValues_ * (sizeof(ValueHeader) + arena);
+        header.octreeOffset_ = header.voxelsOffset_ + header.nbVoxels_ * sizeof(VoxelRecord);
+        header.endOffset_ = header.octreeOffset_ + padded(header.octreeSize_);
+    }
+
+    bool sameOffsets(const binary::DatabaseHeader& lhs, const binary::DatabaseHeader& rhs)
+    {
+        return lhs.staticValuesOffset_ == rhs.staticValuesOffset_
+            && lhs.effectorPositionsOffset_ == rhs.effectorPositionsOffset_
+            && lhs.configurationsOffset_ == rhs.configurationsOffset_
+            && lhs.boundsOffset_ == rhs.boundsOffset_
+            && lhs.jacobiansOffset_ == rhs.jacobiansOffset_
+            && lhs.jacobianProductsOffset_ == rhs.jacobianProductsOffset_
+            && lhs.valuesOffset_ == rhs.valuesOffset_
+            && lhs.voxelsOffset_ == rhs.voxelsOffset_
+            && lhs.octreeOffset_ == rhs.octreeOffset_
+            && lhs.endOffset_ == rhs.endOffset_;
+    }
+
+    // arenas are padded to keep the sections 8 bytes aligned
+    template<typename T>
+    void writeArena(std::ostream& output, const std::vector<T>& arena)
+    {
+        const std::size_t size = arena.size() * sizeof(T);
+        if(!arena.empty())
+            output.write(reinterpret_cast<const char*>(&arena[0]), size);
+        const char padding[8] = {0,0,0,0,0,0,0,0};
+        output.write(padding, padded(size) - size);
+    }
+
+    template<typename T>
+    void readArena(const char* block, const std::size_t offset, const std::size_t size, std::vector<T>& arena)
+    {
+        const T* data = reinterpret_cast<const T*>(block + offset);
+        arena.assign(data, data + size);
+    }
+
+    // reads the rows of a sample section, for all the samples if ids is NULL,
+    // or for the given samples, in the given order
+    template<typename T>
+    void readSamples(const char* block, const std::size_t offset, const std::size_t stride, const std::size_t nbSamples,
+                     const std::vector<std::size_t>* ids, std::vector<T>& arena)
+    {
+        const T* data = reinterpret_cast<const T*>(block + offset);
+        if(!ids)
+        {
+            arena.assign(data, data + stride * nbSamples);
+            return;
+        }
+        arena.resize(stride * ids->size());
+        for(std::size_t i = 0; i < ids->size(); ++i)
+            std::copy(data + (*ids)[i] * stride, data + ((*ids)[i] + 1) * stride, arena.begin() + i * stride);
+    }
+
+    const binary::DatabaseHeader& readHeader(const binary::MappedFilePtr_t& file, const std::size_t offset)
+    {
+        using namespace binary;
+        if(offset + sizeof(DatabaseHeader) > file->size())
+            throw std::runtime_error ("Impossible to open database; file is truncated");
+        const DatabaseHeader& header = *reinterpret_cast<const DatabaseHeader*>(file->data() + offset);
+        if(offset + header.endOffset_ > file->size())
+            throw std::runtime_error ("Impossible to open database; file is truncated");
+        DatabaseHeader expected = header;
+        computeOffsets(expected);
+        if(!sameOffsets(header, expected))
+            throw std::runtime_error ("Impossible to open database; corrupted header");
+        if(header.encoding_ > FIXED16_ENCODING)
+            throw std::runtime_error ("Impossible to open database; unknown sample encoding");
+        return header;
+    }
+
+    SampleStoragePtr_t readStorage(const char* block, const binary::DatabaseHeader& header, const std::vector<std::size_t>* ids)
+    {
+        using namespace binary;
+        const bool storeJacobians = header.flags_ & JACOBIANS_STORED;
+        const std::size_t nbSamples = header.nbSamples_;
+        SampleStoragePtr_t storage(new SampleStorage(header.length_, header.startRank_, header.jacobianCols_, storeJacobians));
+        storage->encoding_ = static_cast<SampleEncoding>(header.encoding_);
+        readSamples(block, header.staticValuesOffset_, 1, nbSamples, ids, storage->staticValues_);
+        switch(storage->encoding_)
+        {
+        case DOUBLE_ENCODING:
+            readSamples(block, header.effectorPositionsOffset_, 3, nbSamples, ids, storage->effectorPositions_);
+            readSamples(block, header.configurationsOffset_, header.length_, nbSamples, ids, storage->configurations_);
+            break;
+        case FLOAT_ENCODING:
+            readSamples(block, header.effectorPositionsOffset_, 3, nbSamples, ids, storage->compactEffectorPositions_);
+            readSamples(block, header.configurationsOffset_, header.length_, nbSamples, ids, storage->floatConfigurations_);
+            break;
+        case FIXED16_ENCODING:
+            readSamples(block, header.effectorPositionsOffset_, 3, nbSamples, ids, storage->compactEffectorPositions_);
+            readSamples(block, header.configurationsOffset_, header.length_, nbSamples, ids, storage->fixedConfigurations_);
+            readArena(block, header.boundsOffset_, header.length_, storage->lowerBounds_);
+            readArena(block, header.boundsOffset_ + header.length_ * sizeof(double), header.length_, storage->upperBounds_);
+            break;
+        }
+        if(storeJacobians)
+        {
+            readSamples(block, header.jacobiansOffset_, 6 * header.jacobianCols_, nbSamples, ids, storage->jacobians_);
+            readSamples(block, header.jacobianProductsOffset_, 36, nbSamples, ids, storage->jacobianProducts_);
+        }
+        return storage;
+    }
+
+    // values are normalized with the bounds of the whole database
+    void readValueColumns(T_Values& values, T_ValueBound& valueBounds, const char* block, const binary::DatabaseHeader& header,
+                          const std::vector<std::size_t>* ids)
+    {
+        using namespace binary;
+        const ValueHeader* valueHeaders = reinterpret_cast<const ValueHeader*>(block + header.valuesOffset_);
+        for(std::size_t i = 0; i < header.nbValues_; ++i)
+        {
+            const ValueHeader& value = valueHeaders[i];
+            const std::string valueName = ReadName(value.name_, VALUE_NAME_SIZE);
+            const std::size_t columnOffset = header.valuesOffset_ + header.nbValues_ * sizeof(ValueHeader)
+                                           + i * header.nbSamples_ * sizeof(double);
+            T_Double column;
+            readSamples(block, columnOffset, 1, header.nbSamples_, ids, column);
+            values[valueName].swap(column);
+            if(!boost::math::isnan(value.min_) && !boost::math::isnan(value.max_))
+                valueBounds.insert(std::make_pair(valueName, std::make_pair(value.min_, value.max_)));
+        }
+    }
+
+    octomap::OcTree* readOctree(const char* block, const binary::DatabaseHeader& header)
+    {
+        boost::interprocess::ibufferstream input(block + header.octreeOffset_, header.octreeSize_);
+        octomap::AbstractOcTree* tree = octomap::AbstractOcTree::read(input);
+        octomap::OcTree* octTree = dynamic_cast<octomap::OcTree*>(tree);
+        if(!octTree)
+        {
+            delete tree;
+            throw std::runtime_error ("Impossible to open database; corrupted octree");
+        }
+        return octTree;
+    }
+
+    // Samples of a binary database are saved aligned with the octree,
+    // the saved voxel ranges are checked for consistency only.
+    bool readVoxelIndex(SampleDB& db, const char* block, const binary::DatabaseHeader& header)
+    {
+        const binary::VoxelRecord* voxels = reinterpret_cast<const binary::VoxelRecord*>(block + header.voxelsOffset_);
+        const T_KeyVoxel voxelIds = getVoxelIds(db.octomapTree_);
+        T_VoxelSampleId samplesInVoxels;
+        samplesInVoxels.reserve(header.nbVoxels_);
+        std::size_t expectedFirst = 0;
+        for(std::size_t i = 0; i < header.nbVoxels_; ++i)
+        {
+            const binary::VoxelRecord& voxel = voxels[i];
+            if(voxel.first_ != expectedFirst || voxel.count_ == 0 || voxel.first_ + voxel.count_ > db.samples_.size())
+                return false;
+            T_KeyVoxel::const_iterator vit = voxelIds.find(
+                        packKey(octomap::OcTreeKey(voxel.key_[0], voxel.key_[1], voxel.key_[2]), voxel.depth_));
+            if(vit == voxelIds.end())
+                return false;
+            if(!samplesInVoxels.insert(vit->second, std::make_pair(voxel.first_, voxel.count_)))
+                return false;
+            expectedFirst += voxel.count_;
+        }
+        if(expectedFirst != db.samples_.size())
+            return false;
+        db.samplesInVoxels_ = samplesInVoxels;
+        return true;
+    }
+}
+
+bool hpp::rbprm::sampling::saveLimbDatabaseBinary(const SampleDB& database, std::ofstream& fp)
+{
+    using namespace binary;
+    if(!database.pendingSamplesInVoxels_.empty())
+        throw std::runtime_error ("Impossible to save database; samples appended since last commit");
+    const SampleStorage& storage = *database.storage_;
+    const std::size_t nbSamples = storage.size();
+    DatabaseHeader header;
+    header.nbSamples_ = nbSamples;
+    header.length_ = storage.length_;
+    header.startRank_ = storage.startRank_;
+    header.jacobianCols_ = storage.jacobianCols_;
+    header.nbValues_ = database.values_.size();
+    header.nbVoxels_ = database.samplesInVoxels_.size();
+    header.resolution_ = database.resolution_;
+    header.flags_ = storage.storeJacobians_ ? JACOBIANS_STORED : 0;
+    header.encoding_ = storage.encoding_;
+    std::ostringstream octree;
+    if(!database.octomapTree_->write(octree))
+        throw std::runtime_error ("Impossible to save database; could not serialize octree");
+    const std::string octreeData = octree.str();
+    header.octreeSize_ = octreeData.size();
+    computeOffsets(header);
+    writeBinary(fp, header);
+    // samples, stored in the octree order
+    writeArena(fp, storage.staticValues_);
+    writeArena(fp, storage.effectorPositions_);
+    writeArena(fp, storage.compactEffectorPositions_);
+    writeArena(fp, storage.configurations_);
+    writeArena(fp, storage.floatConfigurations_);
+    writeArena(fp, storage.fixedConfigurations_);
+    writeArena(fp, storage.lowerBounds_);
+    writeArena(fp, storage.upperBounds_);
+    writeArena(fp, storage.jacobians_);
+    writeArena(fp, storage.jacobianProducts_);
+    // values
+    for(T_Values::const_iterator cit = database.values_.begin(); cit != database.values_.end(); ++cit)
+    {
+        ValueHeader value;
+        WriteName(cit->first, value.name_, VALUE_NAME_SIZE);
+        T_ValueBound::const_iterator bit = database.valueBounds_.find(cit->first);
+        value.min_ = bit != database.valueBounds_.end() ? bit->second.first  : std::numeric_limits<double>::quiet_NaN();
+        value.max_ = bit != database.valueBounds_.end() ? bit->second.second : std::numeric_limits<double>::quiet_NaN();
+        writeBinary(fp, value);
+    }
+    for(T_Values::const_iterator cit = database.values_.begin(); cit != database.values_.end(); ++cit)
+    {
+        writeArena(fp, cit->second);
+    }
+    // voxel index
+    const T_VoxelKey keys = getVoxelKeys(database.octomapTree_);
+    for(std::size_t slot = 0; slot < database.samplesInVoxels_.size(); ++slot)
+    {
+        T_VoxelKey::const_iterator kit = keys.find(database.samplesInVoxels_.voxel(slot));
+        if(kit == keys.end())
+            throw std::runtime_error ("Impossible to save database; voxel not found in octree");
+        VoxelRecord voxel;
+        for(std::size_t i = 0; i < 3; ++i)
+            voxel.key_[i] = kit->second.first[i];
+        voxel.depth_ = (boost::uint16_t)(kit->second.second);
+        voxel.first_ = database.samplesInVoxels_.samples(slot).first;
+        voxel.count_ = database.samplesInVoxels_.samples(slot).second;
+        writeBinary(fp, voxel);
+    }
+    // octree
+    fp.write(octreeData.c_str(), octreeData.size());
+    const char padding[8] = {0,0,0,0,0,0,0,0};
+    fp.write(padding, header.endOffset_ - header.octreeOffset_ - header.octreeSize_);
+    return fp.good();
+}
+
+SampleDB::SampleDB(const binary::MappedFilePtr_t& file, const std::size_t offset, bool loadValues)
+    : treeObject_(boost::shared_ptr<CollisionGeometry> (new fcl::Box (1, 1, 1)))
+    , readOnly_(false)
+{
+    using namespace binary;
+    const DatabaseHeader& header = readHeader(file, offset);
+    const char* block = file->data() + offset;
+    resolution_ = header.resolution_;
+    storage_ = readStorage(block, header, 0);
+    samples_ = CreateSamples(storage_);
+    if(loadValues)
+        readValueColumns(values_, valueBounds_, block, header, 0);
+    setOctree(*this, readOctree(block, header));
+    if(!readVoxelIndex(*this, block, header))
+    {
+        hppDout (warning, "voxel index of binary database does not match octree, rebuilding octree");
+        buildOctree(*this);
+        alignSampleOrderWithOctree(*this);
+    }
+}
+
+SampleDB::SampleDB(const binary::MappedFilePtr_t& file, const std::size_t offset, bool loadValues,
+                   const std::vector<std::size_t>& ids)
+    : treeObject_(boost::shared_ptr<CollisionGeometry> (new fcl::Box (1, 1, 1)))
+    , readOnly_(false)
+{
+    using namespace binary;
+    const DatabaseHeader& header = readHeader(file, offset);
+    const char* block = file->data() + offset;
+    for(std::vector<std::size_t>::const_iterator cit = ids.begin(); cit != ids.end(); ++cit)
+        if(*cit >= header.nbSamples_)
+            throw std::runtime_error ("Impossible to open database; sample id out of range");
+    resolution_ = header.resolution_;
+    storage_ = readStorage(block, header, &ids);
+    samples_ = CreateSamples(storage_);
+    if(loadValues)
+        readValueColumns(values_, valueBounds_, block, header, &ids);
+    // the saved octree contains all the samples, it is built again for the loaded ones
+    buildOctree(*this);
+    alignSampleOrderWithOctree(*this);
+}
+
+namespace
+{
+    struct static_value_greater
+    {
+        static_value_greater(const double* values) : values_(values) {}
+        bool operator() (const std::size_t lhs, const std::size_t rhs) const
+        {
+            return values_[lhs] > values_[rhs];
+        }
+        const double* values_;
+    };
+}
+
+SampleDBLoader::SampleDBLoader(const binary::MappedFilePtr_t& file, const std::size_t offset, bool loadValues,
+                               const model::JointPtr_t& limb, const std::string& effector)
+    : file_(file)
+    , offset_(offset)
+    , loadValues_(loadValues)
+    , limb_(limb)
+    , effector_(effector)
+    , next_(0)
+{
+    const binary::DatabaseHeader& header = readHeader(file, offset);
+    order_.resize(header.nbSamples_);
+    for(std::size_t i = 0; i < order_.size(); ++i)
+        order_[i] = i;
+    const double* staticValues = reinterpret_cast<const double*>(file->data() + offset + header.staticValuesOffset_);
+    std::stable_sort(order_.begin(), order_.end(), static_value_greater(staticValues));
+}
+
+SampleDBPtr_t SampleDBLoader::load(const std::size_t nbSamples)
+{
+    const std::size_t end = std::min(next_ + nbSamples, order_.size());
+    const std::vector<std::size_t> ids(order_.begin() + next_, order_.begin() + end);
+    if(!database_)
+    {
+        database_ = SampleDBPtr_t(new SampleDB(file_, offset_, loadValues_, ids));
+        SampleStorage& storage = *database_->storage_;
+        if(!storage.storeJacobians_ && !storage.jacobianCache_ && limb_)
+            storage.jacobianCache_ = JacobianCache::create(limb_, effector_);
+    }
+    else if(!ids.empty())
+    {
+        const binary::DatabaseHeader& header = readHeader(file_, offset_);
+        const char* block = file_->data() + offset_;
+        insertSamples(*database_, *readStorage(block, header, &ids));
+        if(loadValues_)
+        {
+            // the value bounds are those of the whole file, values are appended as stored
+            T_Values values; T_ValueBound bounds;
+            readValueColumns(values, bounds, block, header, &ids);
+            for(T_Values::const_iterator cit = values.begin(); cit != values.end(); ++cit)
+            {
+                T_Double& column = database_->values_[cit->first];
+                column.insert(column.end(), cit->second.begin(), cit->second.end());
+            }
+        }
+    }
+    next_ = end;
+    return database_;
+}
+
+SampleDBPtr_t SampleDBLoader::loadAll(const std::size_t chunkSize, const progress& callback)
+{
+    const std::size_t step = std::max(chunkSize, (std::size_t)1);
+    do
+    {
+        load(step);
+        if(callback && !callback(next_, order_.size()))
+            break;
+    }
+    while(!finished());
+    commit(*database_);
+    return database_;
+}
@@ -20,6 +20,16 @@
 
 #include <Eigen/Eigen>
 
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace hpp;
 using namespace hpp::model;
 using namespace hpp::rbprm;
@@ -61,88 +71,597 @@ double Manipulability(const Eigen::MatrixXd& product)
     return det > 0 ? sqrt(det) : 0;
 }
 
-Sample::Sample(const model::JointPtr_t limb, const model::JointPtr_t effector, const fcl::Vec3f& offset, std::size_t id)
-    : startRank_(limb->rankInConfiguration())
-    , length_ (ComputeLength(limb, effector))
-    , configuration_ (limb->robot()->currentConfiguration().segment(startRank_, length_))
-    , effectorPosition_(ComputeEffectorPosition(limb, effector,offset))
-    , jacobian_(Jacobian(limb, effector))
-    , jacobianProduct_(jacobian_*jacobian_.transpose())
-    , id_(id)
-    , staticValue_(Manipulability(jacobianProduct_))
+SampleStorage::SampleStorage(const std::size_t length, const std::size_t startRank, const std::size_t jacobianCols,
+                             const bool storeJacobians)
+    : length_(length)
+    , startRank_(startRank)
+    , jacobianCols_(jacobianCols)
+    , storeJacobians_(storeJacobians)
+    , encoding_(DOUBLE_ENCODING)
 {
     // NOTHING
 }
 
-Sample::Sample(const std::size_t id, const std::size_t length, const std::size_t startRank, const double staticValue,
-               const fcl::Vec3f& effectorPosition, const model::ConfigurationIn_t configuration, const Eigen::MatrixXd& jacobian,
-               const Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct)
-    : startRank_(startRank)
-    , length_ (length)
-    , configuration_ (configuration)
-    , effectorPosition_(effectorPosition)
-    , jacobian_(jacobian)
-    , jacobianProduct_(jacobianProduct)
-    , id_(id)
-    , staticValue_(staticValue)
+void SampleStorage::reserve(const std::size_t nbSamples)
 {
-    // NOTHING
+    staticValues_.reserve(nbSamples);
+    switch(encoding_)
+    {
+    case DOUBLE_ENCODING:
+        effectorPositions_.reserve(3 * nbSamples);
+        configurations_.reserve(length_ * nbSamples);
+        break;
+    case FLOAT_ENCODING:
+        compactEffectorPositions_.reserve(3 * nbSamples);
+        floatConfigurations_.reserve(length_ * nbSamples);
+        break;
+    case FIXED16_ENCODING:
+        compactEffectorPositions_.reserve(3 * nbSamples);
+        fixedConfigurations_.reserve(length_ * nbSamples);
+        break;
+    }
+    if(storeJacobians_)
+    {
+        jacobians_.reserve(6 * jacobianCols_ * nbSamples);
+        jacobianProducts_.reserve(36 * nbSamples);
+    }
+}
+
+void SampleStorage::resize(const std::size_t nbSamples)
+{
+    staticValues_.resize(nbSamples);
+    switch(encoding_)
+    {
+    case DOUBLE_ENCODING:
+        effectorPositions_.resize(3 * nbSamples);
+        configurations_.resize(length_ * nbSamples);
+        break;
+    case FLOAT_ENCODING:
+        compactEffectorPositions_.resize(3 * nbSamples);
+        floatConfigurations_.resize(length_ * nbSamples);
+        break;
+    case FIXED16_ENCODING:
+        compactEffectorPositions_.resize(3 * nbSamples);
+        fixedConfigurations_.resize(length_ * nbSamples);
+        break;
+    }
+    if(storeJacobians_)
+    {
+        jacobians_.resize(6 * jacobianCols_ * nbSamples);
+        jacobianProducts_.resize(36 * nbSamples);
+    }
+}
+
+std::size_t SampleStorage::memory() const
+{
+    return staticValues_.size() * sizeof(double)
+         + (effectorPositions_.size() + configurations_.size() + lowerBounds_.size() + upperBounds_.size()) * sizeof(double)
+         + (compactEffectorPositions_.size() + floatConfigurations_.size()) * sizeof(float)
+         + fixedConfigurations_.size() * sizeof(boost::uint16_t)
+         + (jacobians_.size() + jacobianProducts_.size()) * sizeof(double);
+}
+
+namespace
+{
+    template<typename Derived>
+    void assign(std::vector<double>& arena, const std::size_t id, const Eigen::DenseBase<Derived>& data)
+    {
+        Eigen::Map<Eigen::Matrix<double, Derived::RowsAtCompileTime, Derived::ColsAtCompileTime> >
+                (&arena[id * data.size()], data.rows(), data.cols()) = data;
+    }
+
+    template<typename T>
+    void permuteArena(std::vector<T>& arena, const std::vector<std::size_t>& order, const std::size_t stride)
+    {
+        if(arena.empty())
+            return;
+        std::vector<T> res(arena.size());
+        for(std::size_t i = 0; i < order.size(); ++i)
+        {
+            std::copy(arena.begin() + order[i] * stride, arena.begin() + (order[i] + 1) * stride, res.begin() + i * stride);
+        }
+        arena.swap(res);
+    }
+
+    const double FIXED16_MAX = 65535.;
+
+    boost::uint16_t quantize(const double value, const double lower, const double upper)
+    {
+        if(upper <= lower)
+            return 0;
+        const double normalized = (value - lower) / (upper - lower);
+        return (boost::uint16_t)(std::min(std::max(normalized, 0.), 1.) * FIXED16_MAX + 0.5);
+    }
+
+    double dequantize(const boost::uint16_t value, const double lower, const double upper)
+    {
+        return lower + (upper - lower) * ((double)value / FIXED16_MAX);
+    }
+}
+
+std::size_t SampleStorage::add(const double staticValue, const fcl::Vec3f& effectorPosition, model::ConfigurationIn_t configuration,
+                                const Eigen::MatrixXd& jacobian, const Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct)
+{
+    const std::size_t id = size();
+    resize(id + 1);
+    set(id, staticValue, effectorPosition, configuration, jacobian, jacobianProduct);
+    return id;
+}
+
+void SampleStorage::set(const std::size_t id, const double staticValue, const fcl::Vec3f& effectorPosition, model::ConfigurationIn_t configuration,
+                        const Eigen::MatrixXd& jacobian, const Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct)
+{
+    assert(id < size() && configuration.rows() == (int)length_ && jacobian.cols() == (int)jacobianCols_);
+    staticValues_[id] = staticValue;
+    switch(encoding_)
+    {
+    case DOUBLE_ENCODING:
+        for(std::size_t i = 0; i < 3; ++i)
+            effectorPositions_[3 * id + i] = effectorPosition[i];
+        assign(configurations_, id, configuration);
+        break;
+    case FLOAT_ENCODING:
+        for(std::size_t i = 0; i < 3; ++i)
+            compactEffectorPositions_[3 * id + i] = (float)effectorPosition[i];
+        for(std::size_t i = 0; i < length_; ++i)
+            floatConfigurations_[id * length_ + i] = (float)configuration[i];
+        break;
+    case FIXED16_ENCODING:
+        // values out of the stored ranges are clamped
+        for(std::size_t i = 0; i < 3; ++i)
+            compactEffectorPositions_[3 * id + i] = (float)effectorPosition[i];
+        for(std::size_t i = 0; i < length_; ++i)
+            fixedConfigurations_[id * length_ + i] = quantize(configuration[i], lowerBounds_[i], upperBounds_[i]);
+        break;
+    }
+    if(storeJacobians_)
+    {
+        assign(jacobians_, id, jacobian);
+        assign(jacobianProducts_, id, jacobianProduct);
+    }
+}
+
+void SampleStorage::append(const SampleStorage& other)
+{
+    assert(other.length_ == length_ && other.jacobianCols_ == jacobianCols_ && other.storeJacobians_ == storeJacobians_);
+    // samples encoded identically, e.g. read from the same file, are copied as is
+    if(other.encoding_ == encoding_ && encoding_ != DOUBLE_ENCODING
+            && (encoding_ != FIXED16_ENCODING || (other.lowerBounds_ == lowerBounds_ && other.upperBounds_ == upperBounds_)))
+    {
+        staticValues_.insert(staticValues_.end(), other.staticValues_.begin(), other.staticValues_.end());
+        compactEffectorPositions_.insert(compactEffectorPositions_.end(), other.compactEffectorPositions_.begin(), other.compactEffectorPositions_.end());
+        floatConfigurations_.insert(floatConfigurations_.end(), other.floatConfigurations_.begin(), other.floatConfigurations_.end());
+        fixedConfigurations_.insert(fixedConfigurations_.end(), other.fixedConfigurations_.begin(), other.fixedConfigurations_.end());
+        jacobians_.insert(jacobians_.end(), other.jacobians_.begin(), other.jacobians_.end());
+        jacobianProducts_.insert(jacobianProducts_.end(), other.jacobianProducts_.begin(), other.jacobianProducts_.end());
+        return;
+    }
+    // otherwise compact samples are appended at full precision and encoded again,
+    // such that the fixed-point ranges include the new samples.
+    if(other.encoding_ != DOUBLE_ENCODING)
+    {
+        SampleStorage decoded(other);
+        decoded.encode(DOUBLE_ENCODING);
+        append(decoded);
+        return;
+    }
+    if(encoding_ != DOUBLE_ENCODING)
+    {
+        const SampleEncoding encoding = encoding_;
+        encode(DOUBLE_ENCODING);
+        append(other);
+        encode(encoding);
+        return;
+    }
+    staticValues_.insert(staticValues_.end(), other.staticValues_.begin(), other.staticValues_.end());
+    effectorPositions_.insert(effectorPositions_.end(), other.effectorPositions_.begin(), other.effectorPositions_.end());
+    configurations_.insert(configurations_.end(), other.configurations_.begin(), other.configurations_.end());
+    jacobians_.insert(jacobians_.end(), other.jacobians_.begin(), other.jacobians_.end());
+    jacobianProducts_.insert(jacobianProducts_.end(), other.jacobianProducts_.begin(), other.jacobianProducts_.end());
+}
+
+void SampleStorage::permute(const std::vector<std::size_t>& order)
+{
+    assert(order.size() == size());
+    permuteArena(staticValues_, order, 1);
+    permuteArena(effectorPositions_, order, 3);
+    permuteArena(compactEffectorPositions_, order, 3);
+    permuteArena(configurations_, order, length_);
+    permuteArena(floatConfigurations_, order, length_);
+    permuteArena(fixedConfigurations_, order, length_);
+    permuteArena(jacobians_, order, 6 * jacobianCols_);
+    permuteArena(jacobianProducts_, order, 36);
+    if(jacobianCache_)
+        jacobianCache_->clear();
+}
+
+void SampleStorage::configuration(const std::size_t id, model::ConfigurationOut_t configuration) const
+{
+    assert(id < size() && configuration.rows() == (int)length_);
+    switch(encoding_)
+    {
+    case DOUBLE_ENCODING:
+        configuration = Eigen::Map<const Configuration_t>(&configurations_[id * length_], length_);
+        break;
+    case FLOAT_ENCODING:
+        configuration = Eigen::Map<const Eigen::VectorXf>(&floatConfigurations_[id * length_], length_).cast<double>();
+        break;
+    case FIXED16_ENCODING:
+        for(std::size_t i = 0; i < length_; ++i)
+            configuration[i] = dequantize(fixedConfigurations_[id * length_ + i], lowerBounds_[i], upperBounds_[i]);
+        break;
+    }
 }
 
-Sample::Sample(const model::JointPtr_t limb, const model::JointPtr_t effector, model::ConfigurationIn_t configuration,  const fcl::Vec3f& offset, std::size_t id)
-    : startRank_(limb->rankInConfiguration())
-    , length_ (ComputeLength(limb, effector))
-    , configuration_ (configuration)
-    , effectorPosition_(ComputeEffectorPosition(limb,effector,offset))
-    , jacobian_(Jacobian(limb,effector))
-    , jacobianProduct_(jacobian_*jacobian_.transpose())
+void SampleStorage::encode(const SampleEncoding encoding)
+{
+    if(encoding == encoding_)
+        return;
+    const std::size_t nbSamples = size();
+    std::vector<double> positions(3 * nbSamples);
+    std::vector<double> configurations(length_ * nbSamples);
+    for(std::size_t id = 0; id < nbSamples; ++id)
+    {
+        const fcl::Vec3f position = effectorPosition(id);
+        for(std::size_t i = 0; i < 3; ++i)
+            positions[3 * id + i] = position[i];
+        configuration(id, Eigen::Map<Configuration_t>(&configurations[id * length_], length_));
+    }
+    std::vector<double>().swap(effectorPositions_);
+    std::vector<float>().swap(compactEffectorPositions_);
+    std::vector<double>().swap(configurations_);
+    std::vector<float>().swap(floatConfigurations_);
+    std::vector<boost::uint16_t>().swap(fixedConfigurations_);
+    lowerBounds_.clear();
+    upperBounds_.clear();
+    encoding_ = encoding;
+    switch(encoding_)
+    {
+    case DOUBLE_ENCODING:
+        effectorPositions_.swap(positions);
+        configurations_.swap(configurations);
+        break;
+    case FLOAT_ENCODING:
+        compactEffectorPositions_.assign(positions.begin(), positions.end());
+        floatConfigurations_.assign(configurations.begin(), configurations.end());
+        break;
+    case FIXED16_ENCODING:
+        compactEffectorPositions_.assign(positions.begin(), positions.end());
+        lowerBounds_.assign(length_, std::numeric_limits<double>::max());
+        upperBounds_.assign(length_, -std::numeric_limits<double>::max());
+        for(std::size_t id = 0; id < nbSamples; ++id)
+        {
+            for(std::size_t i = 0; i < length_; ++i)
+            {
+                lowerBounds_[i] = std::min(lowerBounds_[i], configurations[id * length_ + i]);
+                upperBounds_[i] = std::max(upperBounds_[i], configurations[id * length_ + i]);
+            }
+        }
+        fixedConfigurations_.resize(length_ * nbSamples);
+        for(std::size_t j = 0; j < configurations.size(); ++j)
+            fixedConfigurations_[j] = quantize(configurations[j], lowerBounds_[j % length_], upperBounds_[j % length_]);
+        break;
+    }
+}
+
+Sample::Sample(const SampleStoragePtr_t& storage, const std::size_t id)
+    : storage_(storage)
     , id_(id)
-    , staticValue_(Manipulability(jacobianProduct_))
 {
     // NOTHING
 }
 
-Sample::Sample(const Sample &clone)
+model::Configuration_t Sample::configuration() const
+{
+    Configuration_t res(storage_->length_);
+    storage_->configuration(id_, res);
+    return res;
+}
 
-    : startRank_(clone.startRank_)
-    , length_ (clone.length_)
-    , configuration_ (clone.configuration_)
-    , effectorPosition_(clone.effectorPosition_)
-    , jacobian_(clone.jacobian_)
-    , jacobianProduct_(clone.jacobianProduct_)
-    , id_(clone.id_)
-    , staticValue_(clone.staticValue_)
+void Sample::configuration(ConfigurationOut_t configuration) const
 {
-    // NOTHING
+    storage_->configuration(id_, configuration);
+}
+
+Eigen::MatrixXd Sample::jacobian() const
+{
+    if(storage_->storeJacobians_)
+        return Eigen::Map<const Eigen::MatrixXd>(&storage_->jacobians_[id_ * 6 * storage_->jacobianCols_], 6, storage_->jacobianCols_);
+    if(!storage_->jacobianCache_)
+        throw std::runtime_error ("Impossible to compute sample jacobian; jacobians are not stored and no jacobian cache is set");
+    Eigen::MatrixXd jacobian;
+    Eigen::Matrix <model::value_type, 6, 6> jacobianProduct;
+    storage_->jacobianCache_->get(*storage_, id_, jacobian, jacobianProduct);
+    return jacobian;
+}
+
+Eigen::Matrix <model::value_type, 6, 6> Sample::jacobianProduct() const
+{
+    if(storage_->storeJacobians_)
+        return Eigen::Map<const Eigen::Matrix <model::value_type, 6, 6> >(&storage_->jacobianProducts_[id_ * 36]);
+    if(!storage_->jacobianCache_)
+        throw std::runtime_error ("Impossible to compute sample jacobian; jacobians are not stored and no jacobian cache is set");
+    Eigen::MatrixXd jacobian;
+    Eigen::Matrix <model::value_type, 6, 6> jacobianProduct;
+    storage_->jacobianCache_->get(*storage_, id_, jacobian, jacobianProduct);
+    return jacobianProduct;
+}
+
+void Sample::jacobianProduct(Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct) const
+{
+    if(storage_->storeJacobians_)
+    {
+        jacobianProduct = Eigen::Map<const Eigen::Matrix <model::value_type, 6, 6> >(&storage_->jacobianProducts_[id_ * 36]);
+        return;
+    }
+    if(!storage_->jacobianCache_)
+        throw std::runtime_error ("Impossible to compute sample jacobian; jacobians are not stored and no jacobian cache is set");
+    storage_->jacobianCache_->get(*storage_, id_, jacobianProduct);
 }
 
 void hpp::rbprm::sampling::Load(const Sample& sample, ConfigurationOut_t configuration)
 {
-    configuration.segment(sample.startRank_, sample.length_) = sample.configuration_;
+    sample.storage_->configuration(sample.id_, configuration.segment(sample.startRank(), sample.length()));
 }
 
-hpp::rbprm::sampling::SampleVector_t hpp::rbprm::sampling::GenerateSamples(const model::JointPtr_t model, const std::string& effector
-                                                         , const std::size_t nbSamples, const fcl::Vec3f& offset)
+hpp::rbprm::sampling::SampleVector_t hpp::rbprm::sampling::CreateSamples(const SampleStoragePtr_t& storage)
+{
+    SampleVector_t result; result.reserve(storage->size());
+    for(std::size_t i = 0; i < storage->size(); ++i)
+    {
+        result.push_back(Sample(storage, i));
+    }
+    return result;
+}
+
+namespace
+{
+    // counter based generator: the value only depends on the seed, the sample
+    // and the dimension, whatever the order in which samples are computed.
+    boost::uint64_t mix(boost::uint64_t z)
+    {
+        z += 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    struct SampleGenerator
+    {
+        SampleGenerator(const std::size_t seed, const std::size_t sampleId)
+            : state_(mix(mix(seed) ^ sampleId))
+            , dimension_(0) {}
+
+        /// uniform value in [0, 1)
+        double operator()()
+        {
+            return (double)(mix(state_ ^ mix(dimension_++)) >> 11) * (1. / 9007199254740992.);
+        }
+
+        double operator()(const double lower, const double upper)
+        {
+            return lower + (upper - lower) * (*this)();
+        }
+
+        const boost::uint64_t state_;
+        boost::uint64_t dimension_;
+    };
+
+    void uniformlySample(const JointPtr_t joint, SampleGenerator& generator, ConfigurationOut_t config)
+    {
+        const std::size_t rank = joint->rankInConfiguration();
+        if(joint->configSize() == 4 && joint->numberDof() == 3)
+        {
+            // SO3 joint, uniform quaternion (Shoemake)
+            const double u1 = generator(), u2 = generator(0, 2 * M_PI), u3 = generator(0, 2 * M_PI);
+            config[rank+0] = sqrt(u1) * cos(u3);
+            config[rank+1] = sqrt(1 - u1) * sin(u2);
+            config[rank+2] = sqrt(1 - u1) * cos(u2);
+            config[rank+3] = sqrt(u1) * sin(u3);
+        }
+        else if(joint->configSize() == 2 && joint->numberDof() == 1 && !joint->isBounded(0))
+        {
+            // unbounded rotation, stored as (cos, sin)
+            const double angle = generator(-M_PI, M_PI);
+            config[rank+0] = cos(angle);
+            config[rank+1] = sin(angle);
+        }
+        else
+        {
+            // unbounded dofs are rotations, see checkBounds
+            for(std::size_t i = 0; i < joint->configSize(); ++i)
+            {
+                config[rank+i] = joint->isBounded(i) ? generator(joint->lowerBound(i), joint->upperBound(i))
+                                                     : generator(-M_PI, M_PI);
+            }
+        }
+    }
+
+    // as the joint configurations, only rotations can be sampled without bounds
+    void checkBounds(const JointPtr_t limb)
+    {
+        for(Joint* joint = limb; joint; joint = joint->numberChildJoints() != 0 ? joint->childJoint(0) : 0)
+        {
+            if((joint->configSize() == 4 && joint->numberDof() == 3) || dynamic_cast<const model::JointRotation*>(joint))
+                continue;
+            for(std::size_t i = 0; i < joint->configSize(); ++i)
+                if(!joint->isBounded(i))
+                    throw std::runtime_error ("Impossible to sample joint " + joint->name()
+                                              + "; unbounded translation degrees of freedom can not be sampled uniformly");
+        }
+    }
+
+    struct LimbClone
+    {
+        LimbClone(const model::JointPtr_t model, const std::string& effector)
+            : device_(model->robot()->clone())
+            , config_(device_->currentConfiguration())
+            , limb_(device_->getJointByName(model->name()))
+            , effector_(device_->getJointByName(effector)) {}
+
+        model::DevicePtr_t device_;
+        Configuration_t config_;
+        JointPtr_t limb_;
+        JointPtr_t effector_;
+    };
+}
+
+JacobianCachePtr_t JacobianCache::create(const model::JointPtr_t limb, const std::string& effector, const std::size_t capacity)
+{
+    return JacobianCachePtr_t(new JacobianCache(limb, effector, capacity));
+}
+
+JacobianCache::JacobianCache(const model::JointPtr_t limb, const std::string& effector, const std::size_t capacity)
+    : device_(limb->robot()->clone())
+    , limb_(device_->getJointByName(limb->name()))
+    , effector_(device_->getJointByName(effector))
+    , config_(device_->currentConfiguration())
+    , capacity_(capacity)
+{
+    // NOTHING
+}
+
+void JacobianCache::capacity(const std::size_t capacity)
+{
+    #pragma omp critical (rbprm_jacobian_cache)
+    {
+        capacity_ = capacity;
+        while(entries_.size() > capacity_)
+        {
+            entries_.erase(lru_.back());
+            lru_.pop_back();
+        }
+    }
+}
+
+void JacobianCache::clear()
+{
+    #pragma omp critical (rbprm_jacobian_cache)
+    {
+        entries_.clear();
+        lru_.clear();
+    }
+}
+
+void JacobianCache::get(const SampleStorage& storage, const std::size_t id,
+                        Eigen::MatrixXd& jacobian, Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct)
+{
+    // the robot copy is shared, so the computation is done in the critical section as well
+    #pragma omp critical (rbprm_jacobian_cache)
+    {
+        T_Entry::iterator it = entries_.find(id);
+        if(it != entries_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_);
+        }
+        else
+        {
+            storage.configuration(id, config_.segment(storage.startRank_, storage.length_));
+            device_->currentConfiguration(config_);
+            device_->computeForwardKinematics();
+            Entry entry;
+            entry.jacobian_ = Jacobian(limb_, effector_);
+            entry.jacobianProduct_ = entry.jacobian_ * entry.jacobian_.transpose();
+            if(capacity_ > 0)
+            {
+                if(entries_.size() >= capacity_)
+                {
+                    entries_.erase(lru_.back());
+                    lru_.pop_back();
+                }
+                lru_.push_front(id);
+                entry.lru_ = lru_.begin();
+                it = entries_.insert(std::make_pair(id, entry)).first;
+            }
+            else
+            {
+                jacobian = entry.jacobian_;
+                jacobianProduct = entry.jacobianProduct_;
+            }
+        }
+        if(it != entries_.end())
+        {
+            jacobian = it->second.jacobian_;
+            jacobianProduct = it->second.jacobianProduct_;
+        }
+    }
+}
+
+void JacobianCache::get(const SampleStorage& storage, const std::size_t id,
+                        Eigen::Matrix <model::value_type, 6, 6>& jacobianProduct)
 {
-    SampleVector_t result; result.reserve(nbSamples);
-    model::DevicePtr_t device (model->robot()->clone());
-    Configuration_t config = device->currentConfiguration();
-    JointPtr_t clone = device->getJointByName(model->name());
-    JointPtr_t effectorClone = device->getJointByName(effector);
+    // cache hits do not copy the jacobian
+    bool found = false;
+    #pragma omp critical (rbprm_jacobian_cache)
+    {
+        T_Entry::iterator it = entries_.find(id);
+        if(it != entries_.end())
+        {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_);
+            jacobianProduct = it->second.jacobianProduct_;
+            found = true;
+        }
+    }
+    if(!found)
+    {
+        Eigen::MatrixXd jacobian;
+        get(storage, id, jacobian, jacobianProduct);
+    }
+}
+
+hpp::rbprm::sampling::SampleStoragePtr_t hpp::rbprm::sampling::GenerateSampleStorage(const model::JointPtr_t model, const std::string& effector
+                                                         , const std::size_t nbSamples, const fcl::Vec3f& offset
+                                                         , const std::size_t nbThreads, const std::size_t seed
+                                                         , const bool storeJacobians, const SampleEncoding encoding)
+{
+#ifdef _OPENMP
+    const int nbWorkers = nbThreads > 0 ? (int)nbThreads : omp_get_max_threads();
+#else
+    const int nbWorkers = 1;
+#endif
+    // exceptions can not leave the parallel region
+    checkBounds(model);
+    // devices are cloned before entering the parallel region
+    std::vector<LimbClone> clones;
+    for(int i = 0; i < std::max(nbWorkers, 1); ++i)
+        clones.push_back(LimbClone(model, effector));
     std::size_t startRank_(model->rankInConfiguration());
-    std::size_t length_ (ComputeLength(model, effectorClone));
-    for(std::size_t i = 0; i< nbSamples; ++i)
+    std::size_t length_ (ComputeLength(model, clones.front().effector_));
+    SampleStoragePtr_t result (new SampleStorage(length_, startRank_, Jacobian(clones.front().limb_, clones.front().effector_).cols(),
+                                                 storeJacobians));
+    if(!storeJacobians)
+        result->jacobianCache_ = JacobianCache::create(model, effector);
+    result->resize(nbSamples);
+    #pragma omp parallel for schedule(dynamic, 64) num_threads(nbWorkers)
+    for(long int i = 0; i< (long int)nbSamples; ++i)
     {
-        clone->configuration ()->uniformlySample (clone->rankInConfiguration (), config);
-        Joint* current = clone;
+#ifdef _OPENMP
+        LimbClone& worker = clones[omp_get_thread_num()];
+#else
+        LimbClone& worker = clones.front();
+#endif
+        SampleGenerator generator(seed, (std::size_t)i);
+        Configuration_t& config = worker.config_;
+        uniformlySample(worker.limb_, generator, config);
+        Joint* current = worker.limb_;
         while(current->numberChildJoints() !=0)
         {
             current = current->childJoint(0);
-            current->configuration ()->uniformlySample (current->rankInConfiguration(), config);
+            uniformlySample(current, generator, config);
         }
-        device->currentConfiguration (config);
-        device->computeForwardKinematics();
-        result.push_back(Sample(clone, effectorClone, config.segment(startRank_, length_), offset, i));
+        worker.device_->currentConfiguration (config);
+        worker.device_->computeForwardKinematics();
+        const Eigen::MatrixXd jacobian = Jacobian(worker.limb_, worker.effector_);
+        const Eigen::Matrix <model::value_type, 6, 6> jacobianProduct = jacobian*jacobian.transpose();
+        result->set((std::size_t)i, Manipulability(jacobianProduct), ComputeEffectorPosition(worker.limb_, worker.effector_, offset),
+                    config.segment(startRank_, length_), jacobian, jacobianProduct);
     }
+    result->encode(encoding);
     return result;
 }
+
+hpp::rbprm::sampling::SampleVector_t hpp::rbprm::sampling::GenerateSamples(const model::JointPtr_t model, const std::string& effector
+                                                         , const std::size_t nbSamples, const fcl::Vec3f& offset, const std::size_t nbThreads)
+{
+    return CreateSamples(GenerateSampleStorage(model, effector, nbSamples, offset, nbThreads));
+}
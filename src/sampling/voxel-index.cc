@@ -0,0 +1,76 @@
+// Copyright (c) 2014, LAAS-CNRS
+// Authors: Steve Tonneau (steve.tonneau@laas.fr)
+//
+// This file is part of hpp-rbprm.
+// hpp-rbprm is free software: you can redistribute it
+// and/or modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation, either version
+// 3 of the License, or (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be
+// useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+// of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Lesser Public License for more details.  You should have
+// received a copy of the GNU Lesser General Public License along with
+// hpp-rbprm. If not, see <http://www.gnu.org/licenses/>.
+
+#include <hpp/rbprm/sampling/voxel-index.hh>
+
+using namespace hpp::rbprm::sampling;
+
+const std::size_t VoxelIndex::NOT_FOUND = std::numeric_limits<std::size_t>::max();
+
+VoxelIndex::VoxelIndex()
+    : mask_(0)
+{
+    // NOTHING
+}
+
+void VoxelIndex::clear()
+{
+    voxels_.clear();
+    samples_.clear();
+    table_.clear();
+    mask_ = 0;
+}
+
+void VoxelIndex::reserve(const std::size_t nbVoxels)
+{
+    voxels_.reserve(nbVoxels);
+    samples_.reserve(nbVoxels);
+    // keep the load factor under 0.5
+    if(2 * nbVoxels > table_.size())
+        rehash(2 * nbVoxels);
+}
+
+bool VoxelIndex::insert(const long int voxel, const VoxelSampleId& samples)
+{
+    if(2 * (voxels_.size() + 1) > table_.size())
+        rehash(2 * (voxels_.size() + 1));
+    std::size_t bucket = hash(voxel);
+    for(; table_[bucket] != NOT_FOUND; bucket = (bucket + 1) & mask_)
+    {
+        if(voxels_[table_[bucket]] == voxel)
+            return false;
+    }
+    table_[bucket] = voxels_.size();
+    voxels_.push_back(voxel);
+    samples_.push_back(samples);
+    return true;
+}
+
+void VoxelIndex::rehash(const std::size_t capacity)
+{
+    std::size_t size = 16;
+    while(size < capacity)
+        size *= 2;
+    table_.assign(size, NOT_FOUND);
+    mask_ = size - 1;
+    for(std::size_t slot = 0; slot < voxels_.size(); ++slot)
+    {
+        std::size_t bucket = hash(voxels_[slot]);
+        while(table_[bucket] != NOT_FOUND)
+            bucket = (bucket + 1) & mask_;
+        table_[bucket] = slot;
+    }
+}
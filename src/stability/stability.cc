@@ -22,6 +22,9 @@
 #include <hpp/model/joint.hh>
 #include <hpp/model/center-of-mass-computation.hh>
 #include <hpp/rbprm/tools.hh>
+#include <hpp/rbprm/kinematics-workspace.hh>
+
+#include <boost/scoped_ptr.hpp>
 
 #include <robust-equilibrium-lib/static_equilibrium.hh>
 
@@ -144,15 +147,20 @@ namespace stability{
     robust_equilibrium::Vector3 setupLibrary(const RbPrmFullBodyPtr_t fullbody, State& state, StaticEquilibrium& sEq, StaticEquilibriumAlgorithm alg,
                                              const core::value_type friction = 0.3)
     {
-        hpp::model::ConfigurationIn_t save = fullbody->device_->currentConfiguration();
+        // the previous configuration is reloaded when leaving.
+        // Within a contact query, the state is usually already loaded, with its kinematics computed
+        boost::scoped_ptr<KinematicsWorkspace> workspace;
+        if(fullbody->device_->currentConfiguration() != state.configuration_)
+        {
+            workspace.reset(new KinematicsWorkspace(fullbody->device_, fullbody->GetKinematicsLock()));
+            workspace->configuration(state.configuration_);
+        }
         std::vector<std::string> contacts;
         for(std::map<std::string,bool>::const_iterator cit = state.contacts_.begin();
             cit!=state.contacts_.end(); ++ cit)
         {
             if(cit->second) contacts.push_back(cit->first);
         }
-        fullbody->device_->currentConfiguration(state.configuration_);
-        fullbody->device_->computeForwardKinematics();
         const T_Limb limbs = fullbody->GetLimbs();
         std::size_t nbContactPoints(0);
         std::vector<std::size_t> contactPointsInc = numContactPoints(limbs, contacts,nbContactPoints);
@@ -185,7 +193,6 @@ const fcl::Vec3f comfcl = comcptr->com();*/
         const fcl::Vec3f comfcl = fullbody->device_->positionCenterOfMass();
         state.com_ = comfcl;
         for(int i=0; i< 3; ++i) com(i)=comfcl[i];
-        fullbody->device_->currentConfiguration(save);
         sEq.setNewContacts(positions,normals,friction,alg);
         return com;
     }
@@ -179,15 +179,14 @@ namespace hpp {
         projector->add(lockedJoint);
     }
 
-    void LockJointRec(const std::string& spared, const model::JointPtr_t joint, core::ConfigProjectorPtr_t& projector)
+    void LockJointRec(const std::string& spared, const model::JointPtr_t joint, core::ConfigProjectorPtr_t& projector,
+                      const bool constant)
     {
         if(joint->name() == spared) return;
-        const core::Configuration_t& c = joint->robot()->currentConfiguration();
-        core::size_type rankInConfiguration (joint->rankInConfiguration ());
-        projector->add(core::LockedJoint::create(joint,c.segment(rankInConfiguration, joint->configSize())));
+        LockJoint(joint, projector, constant);
         for(std::size_t i=0; i< joint->numberChildJoints(); ++i)
         {
-            LockJointRec(spared,joint->childJoint(i), projector);
+            LockJointRec(spared,joint->childJoint(i), projector, constant);
         }
     }
 
@@ -0,0 +1,114 @@
+// Copyright (C) 2014 LAAS-CNRS
+// Author: Steve Tonneau
+//
+// This file is part of the hpp-rbprm.
+//
+// hpp-core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// test-hpp is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with hpp-core.  If not, see <http://www.gnu.org/licenses/>.
+
+// Measures the latency of candidate queries on a large limb database,
+// comparing the std::map based voxel lookup with the VoxelIndex used by GetCandidates.
+
+#include "test-tools.hh"
+#include <hpp/rbprm/sampling/sample-db.hh>
+#include <hpp/fcl/collision.h>
+#include "utils/stop-watch.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using namespace hpp;
+using namespace hpp::model;
+using namespace rbprm;
+using namespace sampling;
+
+namespace
+{
+    typedef std::map<long int, VoxelSampleId> T_MapVoxelSampleId;
+
+    T_MapVoxelSampleId toMap(const VoxelIndex& index)
+    {
+        T_MapVoxelSampleId res;
+        for(std::size_t slot = 0; slot < index.size(); ++slot)
+            res.insert(std::make_pair(index.voxel(slot), index.samples(slot)));
+        return res;
+    }
+
+    // candidate query as implemented before the VoxelIndex
+    bool GetCandidatesMap(const SampleDB& sc, const T_MapVoxelSampleId& samplesInVoxels, const fcl::Transform3f& treeTrf,
+                          const hpp::model::CollisionObjectPtr_t& o2, const fcl::Vec3f& direction, T_OctreeReport& reports)
+    {
+        fcl::CollisionRequest req(1000, true);
+        fcl::CollisionResult cResult;
+        fcl::CollisionObjectPtr_t obj = o2->fcl();
+        fcl::collide(sc.geometry_.get(), treeTrf, obj->collisionGeometry().get(), obj->getTransform(), req, cResult);
+        Eigen::Vector3d eDir(direction[0], direction[1], direction[2]);
+        std::vector<long int> visited;
+        for(std::size_t index=0; index<cResult.numContacts(); ++index)
+        {
+            const fcl::Contact& contact = cResult.getContact(index);
+            if(std::find(visited.begin(), visited.end(), contact.b1) == visited.end())
+                visited.push_back(contact.b1);
+            T_MapVoxelSampleId::const_iterator voxelIt = samplesInVoxels.find(contact.b1);
+            const VoxelSampleId& voxelSampleIds = voxelIt->second;
+            for(T_Sample::const_iterator sit = sc.samples_.begin()+ voxelSampleIds.first;
+                sit != sc.samples_.begin()+ voxelSampleIds.first + voxelSampleIds.second; ++sit)
+            {
+                const fcl::BVHModel<fcl::OBBRSS>* surface = static_cast<const fcl::BVHModel<fcl::OBBRSS>*> (contact.o2);
+                const fcl::Triangle& tr = surface->tri_indices[contact.b2];
+                const fcl::Vec3f& v1 = surface->vertices[tr[0]];
+                const fcl::Vec3f& v2 = surface->vertices[tr[1]];
+                const fcl::Vec3f& v3 = surface->vertices[tr[2]];
+                fcl::Vec3f normal = (v2 - v1).cross(v3 - v1);
+                normal.normalize();
+                reports.insert(OctreeReport(&(*sit), contact, 0, normal));
+            }
+        }
+        return !reports.empty();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t nbSamples = argc > 1 ? (std::size_t)std::atoi(argv[1]) : 100000;
+    const std::size_t nbQueries = argc > 2 ? (std::size_t)std::atoi(argv[2]) : 200;
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    CollisionObjectPtr_t obstacle = MeshObstacleBox();
+    SampleDB sc(joint, "elbow", nbSamples, fcl::Vec3f(0,0,0), 0.02);
+    const T_MapVoxelSampleId samplesInVoxels = toMap(sc.samplesInVoxels_);
+    std::cout << sc.samples_.size() << " samples, " << sc.samplesInVoxels_.size() << " voxels" << std::endl;
+
+    Stopwatch watch(REAL_TIME);
+    std::size_t nbCandidatesMap = 0, nbCandidatesIndex = 0;
+    for(std::size_t i = 0; i < nbQueries; ++i)
+    {
+        // move the octree around the obstacle surface
+        const double x = 1. + 0.5 * ((double)i / (double)nbQueries - 0.5);
+        const fcl::Transform3f treeTrf(fcl::Vec3f(x, 0, 0));
+        T_OctreeReport mapReports, indexReports;
+        watch.start("std::map");
+        GetCandidatesMap(sc, samplesInVoxels, treeTrf, obstacle, fcl::Vec3f(1,0,0), mapReports);
+        watch.stop("std::map");
+        watch.start("VoxelIndex");
+        GetCandidates(sc, treeTrf, obstacle, fcl::Vec3f(1,0,0), indexReports);
+        watch.stop("VoxelIndex");
+        nbCandidatesMap += mapReports.size();
+        nbCandidatesIndex += indexReports.size();
+    }
+    std::cout << "candidates per query: " << nbCandidatesMap / nbQueries
+              << " (std::map), " << nbCandidatesIndex / nbQueries << " (VoxelIndex)" << std::endl;
+    watch.report_all(3);
+    return nbCandidatesMap == nbCandidatesIndex ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Copyright (C) 2014 LAAS-CNRS
+// Author: Steve Tonneau
+//
+// This file is part of the hpp-rbprm.
+//
+// hpp-core is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// test-hpp is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with hpp-core.  If not, see <http://www.gnu.org/licenses/>.
+
+// Compares the damped least squares limb solver ik::apply with the ConfigProjector
+// used by default to project limbs on contact surfaces. Each query starts from a sample
+// and targets the effector transform of the next sample of the database, which lies in
+// the same or in a neighbouring voxel.
+
+#include "test-tools.hh"
+#include <hpp/rbprm/ik-solver.hh>
+#include <hpp/rbprm/limb-projector.hh>
+#include <hpp/rbprm/tools.hh>
+#include <hpp/core/config-projector.hh>
+#include <hpp/core/locked-joint.hh>
+#include <hpp/core/numerical-constraint.hh>
+#include <hpp/constraints/generic-transformation.hh>
+#include "utils/stop-watch.hh"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace hpp;
+using namespace hpp::model;
+using namespace rbprm;
+using namespace sampling;
+
+namespace
+{
+    // projector equivalent to the LimbProjector, which does not expose its iteration cap
+    core::ConfigProjectorPtr_t createProjector(const DevicePtr_t& device, const RbPrmLimb& limb,
+                                               const fcl::Vec3f& positionTarget, const fcl::Matrix3f& rotationTarget)
+    {
+        core::ConfigProjectorPtr_t proj = core::ConfigProjector::create(device,"proj", 1e-4, 20);
+        tools::LockJointRec(limb.limb_->name(), device->rootJoint(), proj);
+        fcl::Transform3f localFrame, globalFrame;
+        globalFrame.setTranslation(positionTarget);
+        proj->add(core::NumericalConstraint::create (constraints::Position::create("",device, limb.effector_,
+                                                                                   localFrame, globalFrame, std::vector<bool>(3, true))));
+        proj->add(core::NumericalConstraint::create (constraints::Orientation::create("",device, limb.effector_,
+                                                                                      fcl::Transform3f(rotationTarget),
+                                                                                      std::vector<bool>(3, true))));
+        return proj;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t nbSamples = argc > 1 ? (std::size_t)std::atoi(argv[1]) : 10000;
+    const std::size_t nbQueries = argc > 2 ? (std::size_t)std::atoi(argv[2]) : 500;
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    RbPrmLimbPtr_t limb = RbPrmLimb::create(joint, "elbow", fcl::Vec3f(0,0,0), fcl::Vec3f(0,0,1), 0.1, 0.1, nbSamples);
+    const T_Sample& samples = limb->sampleContainer_.samples_;
+    const std::size_t nbTests = std::min(nbQueries, samples.size() - 1);
+
+    Stopwatch watch(REAL_TIME);
+    std::size_t successProjector = 0, successDLS = 0, iterationsProjector = 0, iterationsDLS = 0;
+    for(std::size_t i = 0; i < nbTests; ++i)
+    {
+        Configuration_t target = robot->neutralConfiguration();
+        Load(samples[i+1], target);
+        robot->currentConfiguration(target);
+        robot->computeForwardKinematics();
+        const fcl::Vec3f position = limb->effector_->currentTransformation().getTranslation();
+        const fcl::Matrix3f rotation = limb->effector_->currentTransformation().getRotation();
+        Configuration_t start = robot->neutralConfiguration();
+        Load(samples[i], start);
+
+        robot->currentConfiguration(start);
+        Configuration_t configuration = start;
+        watch.start("ConfigProjector");
+        const bool projected = GetLimbProjector(*limb, robot, std::vector<bool>(3, true))->apply(configuration, rotation, position);
+        watch.stop("ConfigProjector");
+        if(projected)
+        {
+            ++successProjector;
+            // smallest iteration cap for which a projector converges
+            core::ConfigProjectorPtr_t proj = createProjector(robot, *limb, position, rotation);
+            std::size_t k = 1;
+            for(; k < 20; ++k)
+            {
+                configuration = start;
+                proj->maxIterations(k);
+                if(proj->apply(configuration))
+                    break;
+            }
+            iterationsProjector += k;
+        }
+
+        configuration = start;
+        watch.start("damped least squares");
+        const ik::IKReport report = ik::apply(robot, *limb, configuration, position, rotation);
+        watch.stop("damped least squares");
+        if(report.success_)
+        {
+            ++successDLS;
+            iterationsDLS += report.nbIterations_;
+        }
+    }
+    std::cout << nbTests << " projections" << std::endl;
+    std::cout << "ConfigProjector: " << successProjector << " successes, "
+              << (successProjector ? (double)iterationsProjector / (double)successProjector : 0.) << " iterations per success" << std::endl;
+    std::cout << "damped least squares: " << successDLS << " successes, "
+              << (successDLS ? (double)iterationsDLS / (double)successDLS : 0.) << " iterations per success" << std::endl;
+    watch.report_all(3);
+    return 0;
+}
@@ -23,6 +23,12 @@
 #include "hpp/rbprm/rbprm-state.hh"
 #include "hpp/core/straight-path.hh"
 #include "hpp/rbprm/tools.hh"
+#include "hpp/rbprm/limb-collision-validation.hh"
+#include "hpp/rbprm/limb-projector.hh"
+#include "hpp/core/collision-validation-report.hh"
+
+#include <algorithm>
+#include <cmath>
 
 #define BOOST_TEST_MODULE test-fullbody
 #include <boost/test/included/unit_test.hpp>
@@ -34,6 +40,74 @@ using namespace hpp::model;
 using namespace hpp::rbprm;
 using namespace hpp::rbprm::interpolation;
 
+namespace
+{
+    // obstacle above the robot, in reach of the elbow box for some arm configurations
+    ObjectVector_t initObstacles()
+    {
+        CollisionObjectPtr_t obstacle = MeshObstacleBox();
+        obstacle->move(fcl::Vec3f(0,0,3));
+        ObjectVector_t objects;
+        objects.push_back(obstacle);
+        return objects;
+    }
+
+    // limb "arm", from the arm joint to the elbow joint, the elbow carrying a box
+    hpp::rbprm::RbPrmFullBodyPtr_t initFullBody(const ObjectVector_t& collisionObjects)
+    {
+        DevicePtr_t device = initDevice();
+        CollisionGeometryPtr_t elbowGeometry (new fcl::Box (0.5, 0.5, 0.5));
+        CollisionObjectPtr_t elbowBox = CollisionObject::create
+            (elbowGeometry, fcl::Transform3f (), "elbowbox");
+        elbowBox->move(fcl::Vec3f(2,0,0));
+        BodyPtr_t body = new Body;
+        body->name ("elbow");
+        device->getJointByName("elbow")->setLinkedBody (body);
+        body->addInnerObject(elbowBox, true, true);
+        hpp::rbprm::RbPrmFullBodyPtr_t robot = RbPrmFullBody::create(device);
+        robot->AddLimb("arm", "arm", "elbow", fcl::Vec3f(0,0,0), fcl::Vec3f(0,0,1), 0.1, 0.1,
+                       collisionObjects, 1000, "static", 0.1);
+        return robot;
+    }
+    // support surface in reach of the elbow, below the obstacle
+    affMap_t initAffordances()
+    {
+        CollisionObjectPtr_t support = MeshObstacleBox();
+        support->move(fcl::Vec3f(0,0,1.8));
+        affMap_t affordances;
+        affordances["Support"].push_back(support);
+        return affordances;
+    }
+
+    T_AffordanceFilters initAffordanceFilters()
+    {
+        T_AffordanceFilters filters;
+        filters["arm"].push_back("Support");
+        return filters;
+    }
+
+    // arm configurations turned around z from the initial one
+    std::vector<Configuration_t> initConfigurations(const DevicePtr_t& device, const std::size_t nbConfigurations)
+    {
+        std::vector<Configuration_t> configurations;
+        const std::size_t rank = device->getJointByName("arm")->rankInConfiguration();
+        for(std::size_t i = 0; i < nbConfigurations; ++i)
+        {
+            Configuration_t configuration = device->currentConfiguration();
+            const double angle = 0.5 * (double)i;
+            configuration.segment<4>(rank) << std::cos(angle / 2), 0, 0, std::sin(angle / 2);
+            configurations.push_back(configuration);
+        }
+        return configurations;
+    }
+
+    bool sameState(const State& lhs, const State& rhs)
+    {
+        return lhs.configuration_ == rhs.configuration_ && lhs.contacts_ == rhs.contacts_
+                && lhs.nbContacts == rhs.nbContacts;
+    }
+} // namespace
+
 
 /*hpp::rbprm::RbPrmInterpolationPtr_t initInterpolation(const ObjectVector_t& collisionObjects)
 {
@@ -171,6 +245,206 @@ BOOST_AUTO_TEST_CASE (FilteringStates) {
     addState(s0, states);
     BOOST_CHECK(FilterStates(states, true).size() == 2);
 }
+
+BOOST_AUTO_TEST_CASE (kinematicsWorkspace) {
+    DevicePtr_t device = initDevice();
+    KinematicsLockPtr_t lock = KinematicsLock::create();
+    device->computeForwardKinematics();
+    const Configuration_t initial = device->currentConfiguration();
+    JointPtr_t elbow = device->getJointByName("elbow");
+    const fcl::Vec3f initialElbow = elbow->currentTransformation().getTranslation();
+    // quarter turn of the arm around z
+    Configuration_t moved = initial;
+    moved.segment<4>(device->getJointByName("arm")->rankInConfiguration()) << std::sqrt(0.5), 0, 0, std::sqrt(0.5);
+    {
+        KinematicsWorkspace workspace(device, lock);
+        workspace.configuration(moved);
+        BOOST_CHECK_MESSAGE((elbow->currentTransformation().getTranslation() - fcl::Vec3f(0,1,0)).norm() < 1e-6,
+                            "joint transforms should be computed for the new configuration");
+        {
+            KinematicsWorkspace nested(device, lock);
+            BOOST_CHECK_MESSAGE(nested.saved() == moved, "nested workspace should save the current configuration");
+        }
+        BOOST_CHECK_MESSAGE(device->currentConfiguration() == moved
+                            && (elbow->currentTransformation().getTranslation() - fcl::Vec3f(0,1,0)).norm() < 1e-6,
+                            "unmodified nested workspace should leave the device unchanged");
+        {
+            KinematicsWorkspace nested(device, lock);
+            nested.configuration(initial);
+        }
+        BOOST_CHECK_MESSAGE((elbow->currentTransformation().getTranslation() - fcl::Vec3f(0,1,0)).norm() < 1e-6,
+                            "nested workspace should restore the configuration of the enclosing one");
+    }
+    BOOST_CHECK_MESSAGE(device->currentConfiguration() == initial
+                        && (elbow->currentTransformation().getTranslation() - initialElbow).norm() < 1e-6,
+                        "workspace should restore the initial configuration");
+}
+
+BOOST_AUTO_TEST_CASE (limbCollisionValidation) {
+    const ObjectVector_t objects = initObstacles();
+    RbPrmFullBodyPtr_t fb = initFullBody(objects);
+    DevicePtr_t device = fb->device_;
+    const RbPrmLimbPtr_t& limb = fb->GetLimbs().at("arm");
+    // same setup as the limb validations of the full body, with and without the limb only path
+    LimbCollisionValidationPtr_t limbValidation = LimbCollisionValidation::create(device, limb->limb_);
+    core::CollisionValidationPtr_t fullValidation = core::CollisionValidation::create(device);
+    for(ObjectVector_t::const_iterator cit = objects.begin(); cit != objects.end(); ++cit)
+    {
+        limbValidation->addObstacle(*cit);
+        fullValidation->addObstacle(*cit);
+    }
+    tools::RemoveNonLimbCollisionRec<LimbCollisionValidation>(device->rootJoint(), "arm", objects, *limbValidation);
+    tools::RemoveNonLimbCollisionRec<core::CollisionValidation>(device->rootJoint(), "arm", objects, *fullValidation);
+    const core::RelativeMotion::matrix_type m = core::RelativeMotion::matrix(device);
+    limbValidation->filterCollisionPairs(m);
+    fullValidation->filterCollisionPairs(m);
+
+    Configuration_t configuration = device->currentConfiguration();
+    device->computeForwardKinematics();
+    core::ValidationReportPtr_t report (new core::CollisionValidationReport);
+    const sampling::T_Sample& samples = limb->sampleContainer_.samples_;
+    std::size_t nbLimbOnly = 0, nbValid = 0, nbDisagree = 0;
+    for(sampling::T_Sample::const_iterator cit = samples.begin(); cit != samples.end(); ++cit)
+    {
+        sampling::Load(*cit, configuration);
+        if(limbValidation->limbOnly(configuration)) ++nbLimbOnly;
+        const bool limbValid = limbValidation->validate(configuration, report);
+        const bool fullValid = fullValidation->validate(configuration, report);
+        if(limbValid != fullValid) ++nbDisagree;
+        if(fullValid) ++nbValid;
+    }
+    BOOST_CHECK_MESSAGE(nbLimbOnly == samples.size(), "samples should be validated on the limb only path");
+    BOOST_CHECK_MESSAGE(nbDisagree == 0, "limb only validation should agree with the full validation");
+    BOOST_CHECK_MESSAGE(nbValid > 0 && nbValid < samples.size(), "the obstacle should be in reach of some samples only");
+}
+
+BOOST_AUTO_TEST_CASE (fallbackSamples) {
+    RbPrmFullBodyPtr_t fb = initFullBody(initObstacles());
+    DevicePtr_t device = fb->device_;
+    RbPrmLimb& limb = *fb->GetLimbs().at("arm");
+    KinematicsWorkspace workspace(device, fb->GetKinematicsLock());
+    workspace.configuration(Configuration_t(device->currentConfiguration()));
+    const Configuration_t initial = device->currentConfiguration();
+    const std::size_t maxSamples = 10;
+    const std::vector<std::size_t> fallback = GetFallbackSamples(limb, maxSamples);
+    BOOST_CHECK_MESSAGE(GetFallbackSamples(limb, maxSamples) == fallback, "fallback samples should be computed once");
+
+    // self collisions only, as for the fallback samples
+    LimbCollisionValidationPtr_t validation = LimbCollisionValidation::create(device, limb.limb_);
+    validation->filterCollisionPairs(core::RelativeMotion::matrix(device));
+    const fcl::Vec3f origin = (fcl::inverse(limb.limb_->parentJoint()->currentTransformation())
+                               * limb.limb_->currentTransformation()).getTranslation();
+    const sampling::T_Sample& samples = limb.sampleContainer_.samples_;
+    Configuration_t configuration = initial;
+    core::ValidationReportPtr_t report (new core::CollisionValidationReport);
+    bool valid = true, sorted = true;
+    double last = 0;
+    for(std::vector<std::size_t>::const_iterator cit = fallback.begin(); cit != fallback.end(); ++cit)
+    {
+        sampling::Load(samples[*cit], configuration);
+        valid = valid && validation->validate(configuration, report);
+        const double distance = (samples[*cit].effectorPosition() - origin).norm();
+        sorted = sorted && distance >= last;
+        last = distance;
+    }
+    // the other collision free samples are less folded
+    bool folded = true;
+    for(std::size_t i = 0; i < samples.size(); ++i)
+    {
+        if(std::find(fallback.begin(), fallback.end(), i) != fallback.end())
+            continue;
+        sampling::Load(samples[i], configuration);
+        if(validation->validate(configuration, report))
+            folded = folded && (samples[i].effectorPosition() - origin).norm() >= last;
+    }
+    BOOST_CHECK_MESSAGE(fallback.size() == maxSamples, "fallback samples should be found");
+    BOOST_CHECK_MESSAGE(valid, "fallback samples should be collision free");
+    BOOST_CHECK_MESSAGE(sorted, "fallback samples should be sorted by effector distance");
+    BOOST_CHECK_MESSAGE(folded, "the most folded collision free samples should be returned first");
+}
+
+BOOST_AUTO_TEST_CASE (batchComputeContacts) {
+    RbPrmFullBodyPtr_t fb = initFullBody(initObstacles());
+    const affMap_t affordances = initAffordances();
+    const T_AffordanceFilters filters = initAffordanceFilters();
+    const std::vector<Configuration_t> configurations = initConfigurations(fb->device_, 3);
+    std::vector<fcl::Vec3f> directions;
+    for(std::size_t i = 0; i < configurations.size(); ++i)
+        directions.push_back(fcl::Vec3f(0, 0, i % 2 ? 1 : -1));
+    const std::vector<State> batch = ComputeContacts(fb, configurations, affordances, filters, directions);
+    const std::vector<State> shared = ComputeContacts(fb, configurations, affordances, filters,
+                                                      std::vector<fcl::Vec3f>(1, directions.front()));
+    bool same = batch.size() == configurations.size() && shared.size() == configurations.size();
+    bool sameShared = same;
+    for(std::size_t i = 0; same && i < configurations.size(); ++i)
+    {
+        same = sameState(batch[i], ComputeContacts(fb, configurations[i], affordances, filters, directions[i]));
+        sameShared = sameShared && sameState(shared[i], ComputeContacts(fb, configurations[i], affordances, filters,
+                                                                         directions.front()));
+    }
+    BOOST_CHECK_MESSAGE(same, "batch contacts should match the contacts computed per configuration");
+    BOOST_CHECK_MESSAGE(sameShared, "a single direction should be used for the whole batch");
+    BOOST_CHECK_THROW(ComputeContacts(fb, configurations, affordances, filters, std::vector<fcl::Vec3f>(2, directions.front())),
+                      std::runtime_error);
+    BOOST_CHECK_THROW(ComputeContacts(fb, configurations, affordances, filters, std::vector<fcl::Vec3f>()),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE (parallelContactSearch) {
+    RbPrmFullBodyPtr_t fb = initFullBody(initObstacles());
+    const affMap_t affordances = initAffordances();
+    const T_AffordanceFilters filters = initAffordanceFilters();
+    const std::vector<Configuration_t> configurations = initConfigurations(fb->device_, 3);
+    const fcl::Vec3f direction(0,0,1);
+    std::vector<State> serial;
+    fb->SetContactSearchThreads(1);
+    for(std::size_t i = 0; i < configurations.size(); ++i)
+        serial.push_back(ComputeContacts(fb, configurations[i], affordances, filters, direction));
+    bool sameAll = true, sameFew = true;
+    fb->SetContactSearchThreads(0);
+    for(std::size_t i = 0; i < configurations.size(); ++i)
+        sameAll = sameAll && sameState(serial[i], ComputeContacts(fb, configurations[i], affordances, filters, direction));
+    fb->SetContactSearchThreads(3);
+    for(std::size_t i = 0; i < configurations.size(); ++i)
+        sameFew = sameFew && sameState(serial[i], ComputeContacts(fb, configurations[i], affordances, filters, direction));
+    BOOST_CHECK_MESSAGE(sameAll, "contacts found with all threads should match the serial search");
+    BOOST_CHECK_MESSAGE(sameFew, "contacts found with 3 threads should match the serial search");
+}
+
+BOOST_AUTO_TEST_CASE (limbProjectorReuse) {
+    RbPrmFullBodyPtr_t fb = initFullBody(initObstacles());
+    DevicePtr_t device = fb->device_;
+    RbPrmLimb& limb = *fb->GetLimbs().at("arm");
+    JointPtr_t elbow = device->getJointByName("elbow");
+    const std::vector<bool> rotationFilter(3, true);
+    const fcl::Matrix3f rotationTarget(1,0,0, 0,1,0, 0,0,1);
+    KinematicsWorkspace workspace(device, fb->GetKinematicsLock());
+    const Configuration_t initial = device->currentConfiguration();
+    LimbProjectorPtr_t projector = GetLimbProjector(limb, device, rotationFilter);
+
+    Configuration_t first = initial;
+    const bool firstSuccess = projector->apply(first, rotationTarget, fcl::Vec3f(0,1,0));
+    workspace.configuration(first);
+    const fcl::Vec3f firstPosition = elbow->currentTransformation().getTranslation();
+
+    // the root joint, locked by the projector, is moved between the two projections
+    Configuration_t moved = initial;
+    moved.head<3>() << 0.5, 0, 0;
+    workspace.configuration(moved);
+    BOOST_CHECK_MESSAGE(GetLimbProjector(limb, device, rotationFilter) == projector, "the projector should be reused");
+    Configuration_t second = moved;
+    const bool secondSuccess = projector->apply(second, rotationTarget, fcl::Vec3f(0.5,0,1));
+    workspace.configuration(second);
+    const fcl::Vec3f secondPosition = elbow->currentTransformation().getTranslation();
+
+    BOOST_CHECK_MESSAGE(firstSuccess && secondSuccess, "both projections should converge");
+    BOOST_CHECK_MESSAGE(first.head<3>().norm() < 1e-6 && (firstPosition - fcl::Vec3f(0,1,0)).norm() < 1e-3,
+                        "first projection should reach its target");
+    BOOST_CHECK_MESSAGE((second.head<3>() - moved.head<3>()).norm() < 1e-6,
+                        "locked joints should keep their values in the current configuration");
+    BOOST_CHECK_MESSAGE((secondPosition - fcl::Vec3f(0.5,0,1)).norm() < 1e-3,
+                        "second projection should reach the new target");
+}
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -18,10 +18,17 @@
 
 #include "test-tools.hh"
 #include <hpp/rbprm/sampling/sample-db.hh>
+#include <hpp/rbprm/sampling/database-registry.hh>
+#include <hpp/rbprm/rbprm-limb.hh>
+#include <hpp/rbprm/projection-failure-cache.hh>
 #include <hpp/fcl/octree.h>
 #include <hpp/fcl/distance.h>
 #include <hpp/fcl/collision.h>
 
+#include <cstdio>
+#include <limits>
+#include <fstream>
+
 #define BOOST_TEST_MODULE test-sampling
 #include <boost/test/included/unit_test.hpp>
 
@@ -33,6 +40,16 @@ using namespace sampling;
 namespace
 {
 
+double configurationNorm(const SampleDB& /*sampleDB*/, const Sample& sample)
+{
+    return sample.configuration().norm();
+}
+
+bool cancelAfterFirstBlock(const std::size_t nbEvaluated, const std::size_t nbSamples)
+{
+    return nbEvaluated == nbSamples;
+}
+
 BOOST_AUTO_TEST_SUITE(test_generation_samples)
 
 BOOST_AUTO_TEST_CASE (sampleGeneration) {
@@ -43,11 +60,32 @@ BOOST_AUTO_TEST_CASE (sampleGeneration) {
         cit != res.end(); ++cit)
     {
         const Sample& s = *cit;
-        BOOST_CHECK_MESSAGE (s.configuration_.rows()==8,
+        BOOST_CHECK_MESSAGE (s.configuration().rows()==8,
                                                   "Sample should contain 8  variables");
     }
 }
 
+BOOST_AUTO_TEST_CASE (unboundedTranslation) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t root = robot->rootJoint();
+    for(std::size_t i = 0; i < 3; ++i)
+        root->isBounded(i, false);
+    BOOST_CHECK_THROW (GenerateSamples(root, "elbow", 10), std::runtime_error);
+    BOOST_CHECK_MESSAGE (GenerateSamples(robot->getJointByName("arm"), "elbow", 10).size() == 10,
+                         "bounded limbs should still be sampled");
+}
+
+BOOST_AUTO_TEST_CASE (parallelSampleGeneration) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleStoragePtr_t single = GenerateSampleStorage(joint, "elbow", 200, fcl::Vec3f(0,0,0), 1);
+    SampleStoragePtr_t multiple = GenerateSampleStorage(joint, "elbow", 200, fcl::Vec3f(0,0,0), 4);
+    BOOST_CHECK_MESSAGE (single->configurations_ == multiple->configurations_
+                         && single->jacobians_ == multiple->jacobians_
+                         && single->effectorPositions_ == multiple->effectorPositions_,
+                         "samples should not depend on the number of threads");
+}
+
 BOOST_AUTO_TEST_CASE (sampleContainerGeneration) {
     DevicePtr_t robot = initDevice();
     JointPtr_t joint = robot->getJointByName("arm");
@@ -56,9 +94,15 @@ BOOST_AUTO_TEST_CASE (sampleContainerGeneration) {
         cit != sc.samples_.end(); ++cit)
     {
         const Sample& s = *cit;
-        BOOST_CHECK_MESSAGE (s.configuration_.rows()==8,
+        BOOST_CHECK_MESSAGE (s.configuration().rows()==8,
                                                   "Sample should contain 8  variables");
     }
+    BOOST_CHECK_MESSAGE (sc.storage_->size() == sc.samples_.size(), "each sample should be stored once");
+    for(std::size_t i = 0; i < sc.samples_.size(); ++i)
+    {
+        BOOST_CHECK_MESSAGE (sc.samples_[i].id_ == i && sc.samples_[i].storage_ == sc.storage_,
+                             "samples should be stored in the octree order");
+    }
 }
 
 
@@ -81,6 +125,338 @@ BOOST_AUTO_TEST_CASE (octreeRequest) {
     reports = rbprm::sampling::GetCandidates(sc, toofarLocation, obstacle,fcl::Vec3f(1,0,0));
     BOOST_CHECK_MESSAGE (reports.empty(), "samples found by request");
 }
+
+BOOST_AUTO_TEST_CASE (affordanceBroadphase) {
+    ObjectVector_t affordances;
+    affordances.push_back(MeshObstacleBox());
+    AffordanceIndexPtr_t index = AffordanceIndex::create(affordances);
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB sc(joint,"elbow",100,0.1);
+    T_OctreeReport reports;
+    GetCandidates(sc, fcl::Transform3f(), *index, fcl::Vec3f(1,0,0), reports);
+    BOOST_CHECK_MESSAGE (reports.size() == GetCandidates(sc, fcl::Transform3f(), affordances.front(), fcl::Vec3f(1,0,0)).size(),
+                         "broadphase should keep the objects in reach");
+    fcl::Transform3f toofarLocation;
+    toofarLocation.setTranslation(fcl::Vec3f(-10,-10,-10));
+    T_OctreeReport farReports;
+    BOOST_CHECK_MESSAGE (!GetCandidates(sc, toofarLocation, *index, fcl::Vec3f(1,0,0), farReports), "objects out of reach should be culled");
+}
+
+BOOST_AUTO_TEST_CASE (candidateCache) {
+    ObjectVector_t affordances;
+    affordances.push_back(MeshObstacleBox());
+    AffordanceIndexPtr_t index = AffordanceIndex::create(affordances);
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB sc(joint,"elbow",100,0.1);
+    CandidateCache cache(0.05, 0.1);
+    T_OctreeReport reports, cachedReports, nearReports, farReports;
+    GetCandidates(sc, fcl::Transform3f(), *index, fcl::Vec3f(1,0,0), reports, 0, 1, &cache);
+    GetCandidates(sc, fcl::Transform3f(), *index, fcl::Vec3f(1,0,0), cachedReports, 0, 1, &cache);
+    BOOST_CHECK_MESSAGE (cache.misses() == 1 && cache.hits() == 1, "identical query should reuse the cached collisions");
+    BOOST_CHECK_MESSAGE (reports.size() == cachedReports.size(), "cached query should return the same candidates");
+    const fcl::Transform3f near(fcl::Vec3f(0.01,0,0));
+    T_OctreeReport exactReports;
+    GetCandidates(sc, near, *index, fcl::Vec3f(1,0,0), nearReports, 0, 1, &cache);
+    GetCandidates(sc, near, *index, fcl::Vec3f(1,0,0), exactReports);
+    // cached pairs are tested again under the new transform
+    bool moved = true;
+    for(T_OctreeReport::const_iterator cit = nearReports.begin(); cit != nearReports.end(); ++cit)
+    {
+        bool found = false;
+        for(T_OctreeReport::const_iterator eit = exactReports.begin(); !found && eit != exactReports.end(); ++eit)
+            found = eit->sample_ == cit->sample_ && eit->contact_.b2 == cit->contact_.b2
+                    && (eit->contact_.pos - cit->contact_.pos).norm() < 0.1;
+        moved = moved && found;
+    }
+    BOOST_CHECK_MESSAGE (cache.hits() == 2 && !nearReports.empty() && nearReports.size() <= exactReports.size(),
+                         "close query should reuse the cached collisions");
+    BOOST_CHECK_MESSAGE (moved, "reused candidates should be computed for the new root transform");
+    GetCandidates(sc, fcl::Transform3f(fcl::Vec3f(-10,-10,-10)), *index, fcl::Vec3f(1,0,0), farReports, 0, 1, &cache);
+    BOOST_CHECK_MESSAGE (cache.misses() == 2 && farReports.empty(), "distant query should not use the cache");
+    // with thresholds large enough to reuse the pairs, those out of reach are dropped.
+    // The box is still in the bounding box of the octree, but not in reach of the effector
+    CandidateCache wide(100., 10.);
+    T_OctreeReport first, dropped;
+    GetCandidates(sc, fcl::Transform3f(), *index, fcl::Vec3f(1,0,0), first, 0, 1, &wide);
+    GetCandidates(sc, fcl::Transform3f(fcl::Vec3f(1.8,1.8,0)), *index, fcl::Vec3f(1,0,0), dropped, 0, 1, &wide);
+    BOOST_CHECK_MESSAGE (!first.empty() && wide.hits() == 1 && dropped.empty(), "pairs no longer in collision should be dropped");
+}
+
+BOOST_AUTO_TEST_CASE (projectionFailureCache) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB sc(joint,"elbow",100,0.1);
+    T_OctreeReport reports = GetCandidates(sc, fcl::Transform3f(), MeshObstacleBox(), fcl::Vec3f(1,0,0));
+    BOOST_CHECK_MESSAGE (reports.size() > 2, "candidates should be found");
+    ProjectionFailureCache failures(2);
+    failures.update(sc);
+    const std::pair<std::size_t, std::size_t> limbDofs(joint->rankInConfiguration(), (std::size_t)robot->configSize());
+    std::map<std::string, bool> contacts;
+    contacts["arm"] = false;
+    const int validation = 0, otherValidation = 0;
+    const std::size_t context = failures.context(robot->currentConfiguration(), limbDofs, contacts, &validation);
+    for(std::size_t i = 0; i < 3; ++i)
+        failures.insert(failures.key(reports.at(i), context), ProjectionFailureCache::COLLISION_FAILURE);
+    ProjectionFailureCache::Record record;
+    BOOST_CHECK_MESSAGE (failures.size() == 2, "the cache should be bounded");
+    BOOST_CHECK_MESSAGE (!failures.find(failures.key(reports.at(0), context), record), "the oldest failure should be dropped");
+    BOOST_CHECK_MESSAGE (failures.find(failures.key(reports.at(2), context), record) && record.failure_ == ProjectionFailureCache::COLLISION_FAILURE,
+                         "recent failures should be found");
+    BOOST_CHECK_MESSAGE (!failures.find(failures.key(reports.at(2), context + 1), record), "failures depend on the configuration");
+    BOOST_CHECK_MESSAGE (failures.hits() == 1 && failures.misses() == 2, "lookups should be counted");
+    BOOST_CHECK_MESSAGE (failures.context(robot->currentConfiguration(), limbDofs, contacts, &otherValidation) != context,
+                         "failures depend on the collision validation");
+    std::map<std::string, bool> otherContacts(contacts);
+    otherContacts["leg"] = true;
+    BOOST_CHECK_MESSAGE (failures.context(robot->currentConfiguration(), limbDofs, otherContacts, &validation) != context,
+                         "failures depend on the limbs in contact");
+}
+
+BOOST_AUTO_TEST_CASE (affordanceGeometry) {
+    CollisionObjectPtr_t obstacle = MeshObstacleBox();
+    AffordanceGeometryConstPtr_t geometry = AffordanceGeometry::Get(obstacle->fcl()->collisionGeometry());
+    BOOST_CHECK_MESSAGE (geometry == AffordanceGeometry::Get(obstacle->fcl()->collisionGeometry()), "normals should be computed once per mesh");
+    BOOST_CHECK_MESSAGE (geometry->size() > 0 && geometry->areas_.size() == geometry->size(), "all triangles should be processed");
+    for(std::size_t i = 0; i < geometry->size(); ++i)
+        BOOST_CHECK_MESSAGE (std::abs(geometry->normals_[i].norm() - 1) < 1e-6 && geometry->areas_[i] > 0, "normals should be unit vectors");
+}
+
+BOOST_AUTO_TEST_CASE (candidateSet) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB sc(joint, "elbow", 100, fcl::Vec3f(0,0,0), 0.1);
+    CandidateSet all, best(10);
+    for(std::size_t i = 0; i < sc.samples_.size(); ++i)
+    {
+        const OctreeReport report(&sc.samples_[i], fcl::Contact(), (double)(i % 7), fcl::Vec3f(0,0,1));
+        all.insert(report);
+        best.insert(report);
+    }
+    BOOST_CHECK_MESSAGE (all.size() == 100 && best.size() == 10, "only the best candidates should be kept");
+    CandidateSet::const_iterator previous = all.begin();
+    for(CandidateSet::const_iterator cit = ++all.begin(); cit != all.end(); ++cit, ++previous)
+    {
+        BOOST_CHECK_MESSAGE (previous->value_ >= cit->value_, "candidates must be ordered by decreasing value");
+        if(previous->value_ == cit->value_)
+            BOOST_CHECK_MESSAGE (previous->sample_ < cit->sample_, "equal candidates must keep their insertion order");
+    }
+    std::size_t i = 0;
+    for(CandidateSet::const_iterator cit = best.begin(); cit != best.end(); ++cit, ++i)
+        BOOST_CHECK_MESSAGE (cit->sample_ == all.at(i).sample_, "bounded set should contain the best candidates");
+}
+
+BOOST_AUTO_TEST_CASE (incrementalInsertion) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB sc(joint, "elbow", 100, fcl::Vec3f(0,0,0), 0.1);
+    appendSamples(sc, joint, "elbow", 50);
+    BOOST_CHECK_MESSAGE (sc.samples_.size() == 150, "samples should be appended");
+    BOOST_CHECK_MESSAGE (!sc.pendingSamplesInVoxels_.empty(), "appended samples should be pending");
+    commit(sc);
+    BOOST_CHECK_MESSAGE (sc.pendingSamplesInVoxels_.empty(), "no sample should be pending after commit");
+    std::size_t nbIndexed = 0;
+    for(std::size_t slot = 0; slot < sc.samplesInVoxels_.size(); ++slot)
+        nbIndexed += sc.samplesInVoxels_.samples(slot).second;
+    BOOST_CHECK_MESSAGE (nbIndexed == 150, "all samples should be indexed after commit");
+}
+
+BOOST_AUTO_TEST_CASE (lazyJacobians) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleStoragePtr_t stored = GenerateSampleStorage(joint, "elbow", 200, fcl::Vec3f(0,0,0), 1, 0, true);
+    SampleStoragePtr_t lazy = GenerateSampleStorage(joint, "elbow", 200, fcl::Vec3f(0,0,0), 1, 0, false);
+    BOOST_CHECK_MESSAGE (lazy->jacobians_.empty() && lazy->jacobianProducts_.empty(), "jacobians should not be stored");
+    lazy->jacobianCache_->capacity(50);
+    const SampleVector_t storedSamples = CreateSamples(stored);
+    const SampleVector_t lazySamples = CreateSamples(lazy);
+    for(std::size_t i = 0; i < lazySamples.size(); ++i)
+    {
+        BOOST_CHECK_MESSAGE (lazySamples[i].staticValue() == storedSamples[i].staticValue(), "static values should not depend on storage");
+        BOOST_CHECK_MESSAGE (lazySamples[i].jacobianProduct().isApprox(storedSamples[i].jacobianProduct()),
+                             "computed jacobians should match stored ones");
+        Eigen::Matrix <value_type, 6, 6> lazyProduct, storedProduct;
+        lazySamples[i].jacobianProduct(lazyProduct);
+        storedSamples[i].jacobianProduct(storedProduct);
+        BOOST_CHECK_MESSAGE (lazyProduct == lazySamples[i].jacobianProduct() && storedProduct == storedSamples[i].jacobianProduct(),
+                             "jacobian products should not depend on the accessor");
+        Configuration_t configuration(lazySamples[i].length());
+        lazySamples[i].configuration(configuration);
+        BOOST_CHECK_MESSAGE (configuration == lazySamples[i].configuration(), "configurations should not depend on the accessor");
+    }
+    BOOST_CHECK_MESSAGE (lazy->jacobianCache_->size() == 50, "cache should be bounded");
+}
+
+BOOST_AUTO_TEST_CASE (compactEncoding) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleStoragePtr_t full = GenerateSampleStorage(joint, "elbow", 200);
+    SampleStoragePtr_t fixed = GenerateSampleStorage(joint, "elbow", 200, fcl::Vec3f(0,0,0), 0, 0, true, FIXED16_ENCODING);
+    BOOST_CHECK_MESSAGE (fixed->configurations_.empty() && fixed->fixedConfigurations_.size() == full->configurations_.size(),
+                         "configurations should be stored in fixed-point");
+    Configuration_t config = robot->currentConfiguration();
+    const SampleVector_t fullSamples = CreateSamples(full);
+    const SampleVector_t fixedSamples = CreateSamples(fixed);
+    for(std::size_t i = 0; i < fixedSamples.size(); ++i)
+    {
+        Load(fixedSamples[i], config);
+        const Configuration_t decoded = config.segment(fixedSamples[i].startRank(), fixedSamples[i].length());
+        BOOST_CHECK_MESSAGE ((decoded - fullSamples[i].configuration()).lpNorm<Eigen::Infinity>() < 1e-3,
+                             "decoded configuration should be close to the original one");
+        BOOST_CHECK_MESSAGE ((fixedSamples[i].effectorPosition() - fullSamples[i].effectorPosition()).norm() < 1e-5,
+                             "effector positions should be stored as float");
+    }
+}
+
+BOOST_AUTO_TEST_CASE (parallelValueEvaluation) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB db(joint, "elbow", 1000, fcl::Vec3f(0,0,0), 0.1);
+    addValue(db, "serial", &configurationNorm, false, false);
+    BOOST_CHECK_MESSAGE (addBatchValue(db, "parallel", MakeBatchEvaluate(&configurationNorm), false, false, 4),
+                         "evaluation should not be cancelled");
+    BOOST_CHECK_MESSAGE (db.values_["serial"] == db.values_["parallel"], "parallel evaluation should match serial one");
+    BOOST_CHECK_MESSAGE (!addBatchValue(db, "cancelled", MakeBatchEvaluate(&configurationNorm), false, false, 1, &cancelAfterFirstBlock),
+                         "evaluation should be cancelled");
+    BOOST_CHECK_MESSAGE (db.values_.find("cancelled") == db.values_.end(), "cancelled value should not be added");
+}
+
+BOOST_AUTO_TEST_CASE (binaryDatabase) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    RbPrmLimbPtr_t limb = RbPrmLimb::create(joint, "elbow", fcl::Vec3f(0,0,0), fcl::Vec3f(0,0,1), 0.1, 0.1, 100);
+    const std::string filename("test-sampling-binary.db");
+    std::ofstream fp(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    BOOST_CHECK_MESSAGE (saveLimbInfoAndDatabaseBinary(limb, fp), "binary database could not be written");
+    fp.close();
+    BOOST_CHECK_MESSAGE (binary::IsBinaryDatabase(filename), "binary database not detected");
+    RbPrmLimbPtr_t loaded = RbPrmLimb::create(robot, binary::MappedFile::create(filename));
+    const SampleDB& original = limb->sampleContainer_;
+    const SampleDB& db = loaded->sampleContainer_;
+    BOOST_CHECK_MESSAGE (loaded->effector_ == limb->effector_, "effector should be preserved");
+    BOOST_CHECK_MESSAGE (db.samples_.size() == original.samples_.size(), "all samples should be loaded");
+    BOOST_CHECK_MESSAGE (db.samplesInVoxels_.size() == original.samplesInVoxels_.size(), "voxel index should be preserved");
+    BOOST_CHECK_MESSAGE (db.octomapTree_->getNumLeafNodes() == original.octomapTree_->getNumLeafNodes(), "octree should be preserved");
+    BOOST_CHECK_MESSAGE (db.boxes_.size() == original.boxes_.size(), "octree boxes should be preserved");
+    for(std::size_t i = 0; i < db.samples_.size(); ++i)
+    {
+        BOOST_CHECK_MESSAGE (db.samples_[i].configuration() == original.samples_[i].configuration(),
+                             "sample order and configurations should be preserved");
+        BOOST_CHECK_MESSAGE (db.samples_[i].jacobianProduct() == original.samples_[i].jacobianProduct(),
+                             "jacobians should be preserved");
+    }
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE (bestFirstLoading) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    RbPrmLimbPtr_t limb = RbPrmLimb::create(joint, "elbow", fcl::Vec3f(0,0,0), fcl::Vec3f(0,0,1), 0.1, 0.1, 100);
+    const std::string filename("test-sampling-best-first.db");
+    std::ofstream fp(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    saveLimbInfoAndDatabaseBinary(limb, fp);
+    fp.close();
+    binary::MappedFilePtr_t file = binary::MappedFile::create(filename);
+    SampleDBLoader loader(file, file->databaseOffset());
+    SampleDBPtr_t db = loader.load(20);
+    BOOST_CHECK_MESSAGE (db->samples_.size() == 20 && loader.nbLoaded() == 20, "only the best samples should be loaded");
+    double worstLoaded = std::numeric_limits<double>::max();
+    for(T_Sample::const_iterator sit = db->samples_.begin(); sit != db->samples_.end(); ++sit)
+        worstLoaded = std::min(worstLoaded, sit->staticValue());
+    std::size_t nbBetter = 0;
+    for(T_Sample::const_iterator sit = limb->sampleContainer_.samples_.begin(); sit != limb->sampleContainer_.samples_.end(); ++sit)
+        if(sit->staticValue() > worstLoaded)
+            ++nbBetter;
+    BOOST_CHECK_MESSAGE (nbBetter < 20, "loaded samples should have the highest static values");
+    BOOST_CHECK_MESSAGE (loader.loadAll(30) == db && loader.finished(), "remaining samples should be appended");
+    BOOST_CHECK_MESSAGE (db->samples_.size() == limb->sampleContainer_.samples_.size(), "all samples should be loaded");
+    BOOST_CHECK_MESSAGE (db->pendingSamplesInVoxels_.empty(), "database should be committed");
+    for(T_Values::const_iterator cit = db->values_.begin(); cit != db->values_.end(); ++cit)
+        BOOST_CHECK_MESSAGE (cit->second.size() == db->samples_.size(), "values should be loaded for all samples");
+    // the boxes updated chunk by chunk are those of the occupied leaves
+    std::size_t nbOccupied = 0, nbBoxes = 0;
+    for(octomap::OcTree::leaf_iterator it = db->octomapTree_->begin_leafs(); it != db->octomapTree_->end_leafs(); ++it)
+    {
+        if(!db->octomapTree_->isNodeOccupied(*it))
+            continue;
+        ++nbOccupied;
+        if(db->boxes_.find((std::size_t)(&(*it) - db->octomapTree_->getRoot())) != db->boxes_.end())
+            ++nbBoxes;
+    }
+    BOOST_CHECK_MESSAGE (nbOccupied == db->boxes_.size() && nbBoxes == nbOccupied, "each occupied leaf should have a box");
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE (loaderJacobianCache) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    RbPrmLimbPtr_t limb = RbPrmLimb::create(joint, "elbow", fcl::Vec3f(0,0,0), fcl::Vec3f(0,0,1), 0.1, 0.1, 100,
+                                            0, 0.1, _6_DOF, false, 0, false);
+    const std::string filename("test-sampling-loader-jacobians.db");
+    std::ofstream fp(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    saveLimbInfoAndDatabaseBinary(limb, fp);
+    fp.close();
+    binary::MappedFilePtr_t file = binary::MappedFile::create(filename);
+    SampleDBLoader loader(file, file->databaseOffset(), true, joint, "elbow");
+    SampleDBPtr_t db = loader.load(20);
+    BOOST_CHECK_MESSAGE (db->storage_->jacobianCache_, "the loader should attach a jacobian cache");
+    BOOST_CHECK_MESSAGE (db->samples_.front().jacobian().rows() == 6 && db->samples_.front().jacobian().cols() > 0,
+                         "jacobians should be computed");
+    SampleDBLoader noLimb(file, file->databaseOffset());
+    SampleDBPtr_t noCache = noLimb.load(20);
+    BOOST_CHECK_THROW (noCache->samples_.front().jacobian(), std::runtime_error);
+    BOOST_CHECK_THROW (noCache->samples_.front().jacobianProduct(), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE (pruning) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    SampleDB db(joint, "elbow", 1000, fcl::Vec3f(0,0,0), 0.5);
+    addValue(db, "manipulability", &configurationNorm, true, true);
+    const std::size_t nbVoxels = db.samplesInVoxels_.size();
+    const PruningReport report = prune(db, 2, PRUNE_BY_DIVERSITY);
+    BOOST_CHECK_MESSAGE (report.nbSamplesBefore_ == 1000 && report.nbSamplesAfter_ == db.samples_.size(), "sample counts should be reported");
+    BOOST_CHECK_MESSAGE (report.memoryAfter_ < report.memoryBefore_ || report.nbSamplesAfter_ == 1000, "memory should be saved");
+    BOOST_CHECK_MESSAGE (report.maxCandidatesAfter_ <= 2, "at most 2 samples should be kept per voxel");
+    BOOST_CHECK_MESSAGE (db.samplesInVoxels_.size() == nbVoxels, "no voxel should be emptied");
+    BOOST_CHECK_MESSAGE (db.values_["manipulability"].size() == db.samples_.size(), "values should be pruned");
+    prune(db, 1, PRUNE_BY_VALUE, "manipulability");
+    BOOST_CHECK_MESSAGE (db.samples_.size() == nbVoxels, "one sample should be kept per voxel");
+}
+
+BOOST_AUTO_TEST_CASE (sharedDatabase) {
+    DevicePtr_t robot = initDevice();
+    JointPtr_t joint = robot->getJointByName("arm");
+    RbPrmLimbPtr_t limb = RbPrmLimb::create(joint, "elbow", fcl::Vec3f(0,0,0), fcl::Vec3f(0,0,1), 0.1, 0.1, 100);
+    const std::string filename("test-sampling-shared.db");
+    std::ofstream fp(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    saveLimbInfoAndDatabaseBinary(limb, fp);
+    fp.close();
+    DatabaseRegistry& registry = DatabaseRegistry::Instance();
+    binary::MappedFilePtr_t file = binary::MappedFile::create(filename);
+    const boost::uint64_t hash = ContentHash(file->data(), file->size());
+    BOOST_CHECK_MESSAGE (hash == ContentHash(filename), "file and buffer hashes should match");
+    BOOST_CHECK_MESSAGE (!registry.find(filename, hash, true), "database should not be registered yet");
+    RbPrmLimbPtr_t first = RbPrmLimb::create(robot, file);
+    BOOST_CHECK_MESSAGE (registry.insert(filename, hash, true, first->sampleDatabase_) == first->sampleDatabase_,
+                         "the first database should be registered");
+    RbPrmLimbPtr_t second = RbPrmLimb::create(robot, file, true, 0, false, registry.find(filename, hash, true));
+    BOOST_CHECK_MESSAGE (&first->sampleContainer_ == &second->sampleContainer_, "limbs should share their database");
+    // a database loaded concurrently is not registered, the registered one is returned
+    RbPrmLimbPtr_t concurrent = RbPrmLimb::create(robot, file);
+    BOOST_CHECK_MESSAGE (registry.insert(filename, hash, true, concurrent->sampleDatabase_) == first->sampleDatabase_
+                         && !concurrent->sampleContainer_.readOnly_, "the registered database should be kept");
+    concurrent.reset();
+    BOOST_CHECK_MESSAGE (first->sampleContainer_.readOnly_, "registered databases should be read only");
+    BOOST_CHECK_THROW (prune(first->sampleContainer_, 1), std::runtime_error);
+    BOOST_CHECK_THROW (appendSamples(first->sampleContainer_, joint, "elbow", 10), std::runtime_error);
+    BOOST_CHECK_MESSAGE (!registry.find(filename, hash, false), "databases without values should not be shared");
+    first.reset(); second.reset();
+    BOOST_CHECK_MESSAGE (!registry.find(filename, hash, true), "unused databases should be released");
+    std::remove(filename.c_str());
+}
 }
 
 BOOST_AUTO_TEST_SUITE_END()
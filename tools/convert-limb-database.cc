@@ -0,0 +1,56 @@
+// Copyright (C) 2014 LAAS-CNRS
+// Author: Steve Tonneau
+//
+// This file is part of the hpp-rbprm.
+//
+// hpp-rbprm is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with hpp-rbprm.  If not, see <http://www.gnu.org/licenses/>.
+
+// Converts a limb database saved in the text format into
+// the binary, memory mappable format.
+//
+// usage: convert-limb-database input.db output.db
+
+#include <hpp/rbprm/rbprm-limb.hh>
+
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char** argv)
+{
+    if(argc != 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <text database> <binary database>" << std::endl;
+        return 1;
+    }
+    const std::string input(argv[1]), output(argv[2]);
+    if(hpp::rbprm::sampling::binary::IsBinaryDatabase(input))
+    {
+        std::cerr << input << " is already a binary database" << std::endl;
+        return 1;
+    }
+    try
+    {
+        if(!hpp::rbprm::convertLimbDatabase(input, output))
+        {
+            std::cerr << "failed to write " << output << std::endl;
+            return 1;
+        }
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Copyright (C) 2014 LAAS-CNRS
+// Author: Steve Tonneau
+//
+// This file is part of the hpp-rbprm.
+//
+// hpp-rbprm is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// hpp-rbprm is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with hpp-rbprm.  If not, see <http://www.gnu.org/licenses/>.
+
+// Keeps at most K samples per voxel of a limb database, and saves
+// the result in the binary format. Samples are ranked by the static value,
+// or by the given value, and chosen either by value or by configuration diversity.
+//
+// usage: prune-limb-database input.db output.db K [value|diversity] [valueName]
+
+#include <hpp/rbprm/rbprm-limb.hh>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char** argv)
+{
+    using namespace hpp::rbprm::sampling;
+    if(argc < 4 || argc > 6)
+    {
+        std::cerr << "usage: " << argv[0] << " <database> <binary database> <samples per voxel> [value|diversity] [value name]" << std::endl;
+        return 1;
+    }
+    const std::string input(argv[1]), output(argv[2]);
+    const int maxSamplesPerVoxel = std::atoi(argv[3]);
+    if(maxSamplesPerVoxel <= 0)
+    {
+        std::cerr << "the number of samples per voxel must be positive" << std::endl;
+        return 1;
+    }
+    PruningCriterion criterion = PRUNE_BY_VALUE;
+    if(argc > 4)
+    {
+        const std::string criterionName(argv[4]);
+        if(criterionName == "diversity")
+            criterion = PRUNE_BY_DIVERSITY;
+        else if(criterionName != "value")
+        {
+            std::cerr << "unknown criterion " << criterionName << std::endl;
+            return 1;
+        }
+    }
+    const std::string valueName = argc > 5 ? argv[5] : "";
+    try
+    {
+        const PruningReport report = hpp::rbprm::pruneLimbDatabase(input, output, (std::size_t)maxSamplesPerVoxel, criterion, valueName);
+        std::cout << "samples: " << report.nbSamplesBefore_ << " -> " << report.nbSamplesAfter_
+                  << " in " << report.nbVoxels_ << " voxels" << std::endl;
+        std::cout << "memory: " << report.memoryBefore_ / 1024 << " KiB -> " << report.memoryAfter_ / 1024
+                  << " KiB (" << (report.memoryBefore_ - report.memoryAfter_) / 1024 << " KiB saved)" << std::endl;
+        std::cout << "candidates per voxel: mean " << report.meanCandidatesBefore_ << " -> " << report.meanCandidatesAfter_
+                  << ", max " << report.maxCandidatesBefore_ << " -> " << report.maxCandidatesAfter_ << std::endl;
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}